@@ -1,25 +1,109 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
 #include <alsa/asoundlib.h>
+#include "ringbuf.h"
+#include "wav_writer.h"
+#include "lac.h"
+#include "pcm_stats.h"
+#include "pcm_mmap.h"
+#include "rt.h"
 
-// --- 定义 WAV 文件头结构体 ---
-// 所有的 WAV 文件开头都有这 44 个字节的说明书
-struct WAV_HEADER {
-    char riff_id[4];      // "RIFF"
-    uint32_t riff_sz;     // 文件总大小 - 8
-    char riff_fmt[4];     // "WAVE"
-    char fmt_id[4];       // "fmt "
-    uint32_t fmt_sz;      // fmt块大小 (16)
-    uint16_t audio_fmt;   // 格式 (1 = PCM)
-    uint16_t num_chn;     // 通道数 (2)
-    uint32_t sample_rate; // 采样率 (44100)
-    uint32_t byte_rate;   // 字节率 = 采样率 * 帧大小
-    uint16_t block_align; // 帧大小 (4)
-    uint16_t bits_per_sample; // 位深 (16)
-    char data_id[4];      // "data"
-    uint32_t data_sz;     // 纯音频数据的大小
-};
+#define RING_BYTES (8 * 1024 * 1024)   // 8MB，44.1kHz 立体声能扛 40 多秒的磁盘卡顿
+#define WRITE_BATCH (64 * 1024)        // 写盘线程一次最少攒这么多再写
+
+// --- 录音线程和写盘线程共享的东西 ---
+static ringbuf ring;
+static sem_t data_ready;                        // 攒够一批就叫醒写盘线程
+static volatile sig_atomic_t keep_running = 1;  // Ctrl+C 或者时间到
+static atomic_int capture_done;                 // 录音线程已经不会再写了
+
+// 统计 (录音线程自己写，最后打印)
+static size_t ring_high_water;
+static unsigned long dropped_frames;
+static pcm_stream_stats *cap_stats;
+static size_t frame_bytes;      // 声道数 * 采样字节数，格式和声卡商量好之后才定
+
+// --- 输出文件：WAV 或者 .lac 压缩 (编码在写盘线程里做，不耽误录音线程) ---
+typedef struct {
+    int compressed;
+    wav_writer wav;
+    lac_writer lac;
+} rec_output;
+
+static int output_write(rec_output *o, const void *data, size_t len) {
+    return o->compressed ? lac_writer_write(&o->lac, data, len) : wav_writer_write(&o->wav, data, len);
+}
+
+// --- mmap 录音：直接从驱动的 DMA 区域拷进写盘的环，不经过周期缓冲区 ---
+typedef struct {
+    size_t keep;    // 这次还要存多少帧 (时间快到了只要最后一截)
+    int drop;       // 环里放不下：读出来直接丢掉，声卡不能等
+} capture_cursor;
+
+static void copy_from_area(void *user, void *ptr, snd_pcm_uframes_t frames) {
+    capture_cursor *c = (capture_cursor *)user;
+    size_t n = frames < c->keep ? frames : c->keep;
+    if (!c->drop && n) ringbuf_write(&ring, ptr, n * frame_bytes);
+    c->keep -= n;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    keep_running = 0;
+}
+
+// --- 写盘线程：只管从环里取数据写文件 (要压缩的话先编码) ---
+void *writer_thread_func(void *arg) {
+    rec_output *out = (rec_output *)arg;
+
+    while (1) {
+        int done = atomic_load(&capture_done);
+        size_t avail = ringbuf_read_avail(&ring);
+
+        // 没攒够一批就先睡，最多 100ms 醒一次看看
+        if (!done && avail < WRITE_BATCH) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 100 * 1000000;
+            if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+            sem_timedwait(&data_ready, &ts);
+            continue;
+        }
+        if (done && avail == 0) break;
+
+        // 直接从环里拿连续的一段写出去，录音还在进行时只写整批
+        const void *p;
+        size_t n = ringbuf_read_ptr(&ring, &p);
+        if (!done && n >= WRITE_BATCH) n -= n % WRITE_BATCH;
+
+        if (output_write(out, p, n) < 0) {
+            keep_running = 0; // 盘写不进去了，录下去也没意义
+            ringbuf_read_advance(&ring, avail);
+            continue;
+        }
+        ringbuf_read_advance(&ring, n);
+    }
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "用法: %s [-d 秒数] [-o 文件名] [-p 周期帧数] [-f 格式] [-c 声道数] [-J 文件] [-m] [-F 优先级[:CPU]] [-z]\n"
+                    "  -d 0 (默认) 一直录到 Ctrl+C\n"
+                    "  -f s16 (默认) / s24_3 / s32 / f32 / auto，声卡不支持就用它支持的，\n"
+                    "     auto 直接挑声卡最好的；文件和声卡格式一致，录的时候不做转换\n"
+                    "  -c 声道数 (默认 2)\n"
+                    "  -m 用 mmap 直接读声卡的 DMA 缓冲区 (不支持时自动退回 readi)\n"
+                    "  -J 每秒往文件里追加一行 JSON 统计 (kill -USR1 随时打印统计)\n"
+                    "  -F 实时模式：录音线程 SCHED_FIFO (rr:优先级 用 SCHED_RR)，可以绑到一个 CPU，锁内存\n"
+                    "  -z 存成无损压缩的 .lac (LPC + Rice，文件名以 .lac 结尾也会自动压缩)，\n"
+                    "     默认文件名变成 output.lac；只支持整数格式，player / visualizer 直接能放\n", prog);
+}
 
 int main(int argc, char *argv[]) {
     int rc;
@@ -27,13 +111,56 @@ int main(int argc, char *argv[]) {
     snd_pcm_hw_params_t *params;
     unsigned int val = 44100;
     int dir;
-    snd_pcm_uframes_t frames = 32;
+    snd_pcm_uframes_t frames = 1024;
     char *buffer;
     int size;
-    
-    // 我们录制 5 秒
-    int seconds = 5; 
-    
+    const char *default_path = "output.wav";
+    const char *path = default_path;
+    rec_output out = {0};
+    pthread_t writer;
+    const char *json_path = NULL;
+    int use_mmap = 0;
+    sf_format want_fmt = SF_S16;
+    int channels = 2;
+    rt_opts rt;
+    int opt;
+
+    // 录多少秒，0 表示不限
+    int seconds = 0;
+
+    // 要在开写盘线程之前，让所有线程都屏蔽 SIGUSR1
+    pcm_stats_init("alsa_record");
+    rt_default(&rt);
+
+    while ((opt = getopt(argc, argv, "d:o:p:f:c:J:mF:zh")) != -1) {
+        switch (opt) {
+        case 'd': seconds = atoi(optarg); break;
+        case 'o': path = optarg; break;
+        case 'p': frames = atoi(optarg); break;
+        case 'f':
+            want_fmt = strcmp(optarg, "auto") == 0 ? SF_UNKNOWN : sf_parse(optarg);
+            if (want_fmt == SF_UNKNOWN && strcmp(optarg, "auto") != 0) {
+                fprintf(stderr, "不认识的格式: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'c': channels = atoi(optarg); break;
+        case 'J': json_path = optarg; break;
+        case 'm': use_mmap = 1; break;
+        case 'F':
+            if (rt_parse(&rt, optarg) < 0) return 1;
+            break;
+        case 'z': out.compressed = 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+
+    size_t plen = strlen(path);
+    if (plen > 4 && strcmp(path + plen - 4, ".lac") == 0) out.compressed = 1;
+    if (out.compressed && path == default_path) path = "output.lac";
+    // 压缩只认整数格式，float 先换成 32 位整数再问声卡
+    if (out.compressed && want_fmt == SF_F32) want_fmt = SF_S32;
+
     // 打开 PCM 设备
     rc = snd_pcm_open(&handle, "default", SND_PCM_STREAM_CAPTURE, 0);
     if (rc < 0) {
@@ -44,64 +171,129 @@ int main(int argc, char *argv[]) {
     // 设置参数
     snd_pcm_hw_params_alloca(&params);
     snd_pcm_hw_params_any(handle, params);
-    snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE);
-    snd_pcm_hw_params_set_channels(handle, params, 2);
+    int mmap_mode = pcm_set_access(handle, params, use_mmap);
+    // 声卡给什么格式就录什么格式，文件也写成这个格式，一路不转换
+    sf_format fmt = pcm_set_format(handle, params, want_fmt);
+    if (fmt == SF_UNKNOWN) {
+        fprintf(stderr, "声卡不支持任何已知的采样格式\n");
+        return 1;
+    }
+    if (out.compressed && fmt == SF_F32) {
+        fprintf(stderr, "声卡只给 float，压缩格式存不了，去掉 -z 录 WAV\n");
+        return 1;
+    }
+    snd_pcm_hw_params_set_channels(handle, params, channels);
     snd_pcm_hw_params_set_rate_near(handle, params, &val, &dir);
+    snd_pcm_hw_params_set_period_size_near(handle, params, &frames, &dir);
     rc = snd_pcm_hw_params(handle, params);
+    if (rc < 0) {
+        fprintf(stderr, "无法设置硬件参数 (%s, %d 声道): %s\n", sf_name(fmt), channels, snd_strerror(rc));
+        return 1;
+    }
 
     snd_pcm_hw_params_get_period_size(params, &frames, &dir);
-    size = frames * 4; // 2 channels * 16 bit(2 bytes) = 4 bytes frame
-    buffer = (char *) malloc(size);
-
-    // 计算总数据量
-    // 总字节 = 秒数 * 采样率 * 帧大小
-    uint32_t total_data_len = seconds * val * 4;
-    long loops = total_data_len / size;
-
-    // --- 准备 WAV 头 ---
-    struct WAV_HEADER header;
-    memcpy(header.riff_id, "RIFF", 4);
-    header.riff_sz = total_data_len + 36; // 36 = header(44) - 8
-    memcpy(header.riff_fmt, "WAVE", 4);
-    memcpy(header.fmt_id, "fmt ", 4);
-    header.fmt_sz = 16;
-    header.audio_fmt = 1;       // PCM
-    header.num_chn = 2;         // Stereo
-    header.sample_rate = val;   // 44100
-    header.block_align = 4;     // 2 * 16/8
-    header.byte_rate = val * 4; // 44100 * 4
-    header.bits_per_sample = 16;
-    memcpy(header.data_id, "data", 4);
-    header.data_sz = total_data_len;
-
-    // 打开文件，这次我们叫它 .wav
-    FILE *fp = fopen("output.wav", "wb");
-    
-    // 1. 先写入头信息
-    fwrite(&header, sizeof(struct WAV_HEADER), 1, fp);
-
-    printf("开始录音 5 秒...\n");
-    
-    // 2. 循环写入数据
-    while (loops > 0) {
-        loops--;
-        rc = snd_pcm_readi(handle, buffer, frames);
-        if (rc == -EPIPE) {
+    frame_bytes = channels * sf_bytes(fmt);
+    size = frames * frame_bytes;
+    // mmap 模式直接从 DMA 区域拷进环，用不着周期缓冲区
+    buffer = mmap_mode == 1 ? NULL : (char *) malloc(size);
+
+    // 文件头先占位，录完再补真实大小
+    if (out.compressed ? lac_writer_open(&out.lac, path, val, channels, fmt) < 0
+                       : wav_writer_open(&out.wav, path, val, channels, fmt) < 0)
+        return 1;
+
+    if (ringbuf_init(&ring, RING_BYTES) < 0) {
+        fprintf(stderr, "内存不足\n");
+        return 1;
+    }
+    // 周期缓冲区和整个环先摸一遍，录的时候不缺页
+    rt_prefault(buffer, buffer ? size : 0);
+    rt_prefault(ring.buf, ring.size);
+    sem_init(&data_ready, 0, 0);
+    cap_stats = pcm_stats_stream("capture", val);
+    if (pcm_stats_start(json_path, 1000) < 0) return 1;
+    pthread_create(&writer, NULL, writer_thread_func, &out);
+    // 写盘线程开好了再切实时，它不该继承实时优先级
+    rt_enter(&rt, "alsa_record");
+
+    // 不带 SA_RESTART：Ctrl+C 能把阻塞中的 readi 打断
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    unsigned long total_frames = 0;
+    unsigned long limit = seconds > 0 ? (unsigned long)seconds * val : 0;
+
+    printf("格式: %s, %d 声道, %u Hz%s\n", sf_name(fmt), channels, val, mmap_mode == 1 ? ", mmap" : "");
+    if (seconds > 0) printf("开始录音 %d 秒...\n", seconds);
+    else printf("开始录音，按 Ctrl+C 结束...\n");
+
+    // 循环录音：这里只读声卡、塞进环，绝不碰磁盘
+    while (keep_running && (limit == 0 || total_frames < limit)) {
+        // mmap 模式下读的同时就进了环，所以要先定好存多少、放不放得下
+        capture_cursor cur;
+        cur.keep = limit && total_frames + frames > limit ? limit - total_frames : frames;
+        cur.drop = ringbuf_write_space(&ring) < cur.keep * frame_bytes;
+
+        unsigned long long t0 = pcm_stats_io_begin();
+        if (mmap_mode == 1) rc = pcm_mmap_xfer(handle, frames, copy_from_area, &cur);
+        else rc = snd_pcm_readi(handle, buffer, frames);
+        pcm_stats_io_end(cap_stats, t0, rc);
+        if (rc == -EPIPE || rc == -ESTRPIPE) {
+            pcm_stats_xrun(cap_stats, rc);
             fprintf(stderr, "Overrun!\n");
             snd_pcm_prepare(handle);
+            continue;
+        } else if (rc == -EINTR) {
+            continue;
         } else if (rc < 0) {
             fprintf(stderr, "Error: %s\n", snd_strerror(rc));
-        } else {
-            fwrite(buffer, 1, size, fp);
+            continue;
         }
+
+        // 阻塞读返回就是被唤醒处理了一个周期
+        pcm_stats_wakeup(cap_stats);
+        pcm_stats_sample(cap_stats, handle);
+
+        // 时间到了就只要剩下的那一截
+        if (limit && total_frames + rc > limit) rc = limit - total_frames;
+
+        size_t bytes = rc * frame_bytes;
+        if (mmap_mode == 1 ? cur.drop : ringbuf_write_space(&ring) < bytes) {
+            // 写盘线程跟不上，宁可丢这一段，也不能让声卡溢出
+            dropped_frames += rc;
+            continue;
+        }
+        if (mmap_mode != 1) ringbuf_write(&ring, buffer, bytes);
+        total_frames += rc;
+
+        size_t used = ringbuf_read_avail(&ring);
+        if (used > ring_high_water) ring_high_water = used;
+        if (used >= WRITE_BATCH) sem_post(&data_ready);
     }
 
-    printf("录音完成！文件已保存为 output.wav\n");
+    // 通知写盘线程把剩下的全部写完
+    atomic_store(&capture_done, 1);
+    sem_post(&data_ready);
+    pthread_join(writer, NULL);
 
-    fclose(fp);
-    snd_pcm_drain(handle);
+    snd_pcm_drop(handle);
     snd_pcm_close(handle);
+
+    if ((out.compressed ? lac_writer_close(&out.lac) : wav_writer_close(&out.wav)) == 0)
+        printf("录音完成！文件已保存为 %s\n", path);
+    printf("共 %lu 帧 (%.1f 秒), 写入 %llu 字节\n", total_frames, (double)total_frames / val,
+           (unsigned long long)(out.compressed ? out.lac.out_bytes : out.wav.data_bytes));
+    if (out.compressed) lac_writer_report(&out.lac, stdout);
+    printf("环形缓冲最高水位 %zu / %zu 字节 (%.1f%%), 丢弃 %lu 帧\n",
+           ring_high_water, ring.size, 100.0 * ring_high_water / ring.size, dropped_frames);
+    rt_report(&rt, stdout);
+    pcm_stats_stop(stdout);
+
+    ringbuf_free(&ring);
+    sem_destroy(&data_ready);
     free(buffer);
     return 0;
 }
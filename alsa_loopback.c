@@ -1,14 +1,77 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
 #include <alsa/asoundlib.h>
+#include "latency_probe.h"
+#include "pcm_stats.h"
+#include "resampler.h"
+#include "pcm_mmap.h"
+#include "rt.h"
+#include "dsp.h"
 
-#define FRAMES 1024
+// --- 全双工引擎的全部状态 ---
+typedef struct {
+    snd_pcm_t *capture;
+    snd_pcm_t *playback;
+    unsigned int rate;          // 播放端的采样率
+    unsigned int cap_rate;      // 录音端实际拿到的 (开了重采样时可以和播放端不一样)
+    snd_pcm_uframes_t period;   // 实际协商到的周期大小 (两边取一样的)
+    snd_pcm_uframes_t buffer;   // 播放端实际协商到的缓冲区大小
+    int linked;                 // 两个流是不是 snd_pcm_link 在一起了
 
-int set_params(snd_pcm_t *handle, int rate) {
+    // 两边各自协商的格式，尽量一样；不一样时录到的先转成播放端的格式
+    int channels;
+    sf_format cap_fmt, play_fmt;
+    size_t cap_frame_bytes, play_frame_bytes;
+    sf_dither dither;
+
+    // 录到了但还没写出去的数据 (播放端的格式)
+    char *fifo;
+    snd_pcm_uframes_t fifo_size;
+    snd_pcm_uframes_t pending;
+
+    // 一个 poll() 同时盯录音和播放
+    struct pollfd *pfds;
+    int cap_nfds;
+    int play_nfds;
+
+    unsigned long xruns;        // 一共重启了几次
+    pcm_stream_stats *cap_stats;
+    pcm_stream_stats *play_stats;
+
+    // 测量模式：不为 NULL 时播放端放扫频而不是回放录音
+    latency_probe *probe;
+
+    // 重采样或者格式转换时，录到的先读进 cap_buf (录音端的格式)，
+    // 换算到播放端的时钟/格式再进 fifo
+    resampler *rs;
+    char *cap_buf;
+    snd_pcm_uframes_t cap_buf_frames;
+
+    // 效果链：不为 NULL 时录到的先换成 float (要重采样就顺便) 放进 dsp_buf，
+    // 原地处理完再换成播放端的格式进 fifo
+    dsp_chain *dsp;
+    float *dsp_buf;
+} duplex_t;
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void on_signal(int sig) {
+    (void)sig;
+    keep_running = 0;
+}
+
+// 按照目标格式/周期/周期数协商参数，把真实拿到的值写回去
+int set_params(snd_pcm_t *handle, sf_format *fmt, int channels, unsigned int *rate,
+               snd_pcm_uframes_t *period, snd_pcm_uframes_t *buffer) {
     snd_pcm_hw_params_t *params;
+    snd_pcm_sw_params_t *swparams;
     int rc;
-    int dir;
-    unsigned int val = rate;
+    int dir = 0;
 
     // 1. 分配参数对象
     snd_pcm_hw_params_alloca(&params);
@@ -16,80 +79,466 @@ int set_params(snd_pcm_t *handle, int rate) {
     snd_pcm_hw_params_any(handle, params);
     // 3. 设置交错模式
     snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    // 4. 设置格式 (16位)
-    snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE);
-    // 5. 设置双声道
-    snd_pcm_hw_params_set_channels(handle, params, 2);
-    // 6. 设置采样率 
-    snd_pcm_hw_params_set_rate_near(handle, params, &val, &dir);
-    
-    // 7. 写入硬件
+    // 4. 设置格式 (优先要的那个，没有就用声卡支持的)
+    *fmt = pcm_set_format(handle, params, *fmt);
+    if (*fmt == SF_UNKNOWN) {
+        fprintf(stderr, "声卡不支持任何已知的采样格式\n");
+        return -1;
+    }
+    // 5. 设置声道数
+    snd_pcm_hw_params_set_channels(handle, params, channels);
+    // 6. 设置采样率
+    snd_pcm_hw_params_set_rate_near(handle, params, rate, &dir);
+    // 7. 周期和缓冲区越小延迟越低，但硬件不一定给，所以都是 "near"
+    snd_pcm_hw_params_set_period_size_near(handle, params, period, &dir);
+    snd_pcm_hw_params_set_buffer_size_near(handle, params, buffer);
+
+    // 8. 写入硬件
     rc = snd_pcm_hw_params(handle, params);
     if (rc < 0) {
         fprintf(stderr, "无法设置硬件参数: %s\n", snd_strerror(rc));
         return -1;
     }
+    snd_pcm_hw_params_get_period_size(params, period, &dir);
+    snd_pcm_hw_params_get_buffer_size(params, buffer);
+
+    // 9. 软件参数：攒够一个周期就唤醒 poll
+    // 两边都不许自动开始 (阈值设得比缓冲区还大)，由我们预填静音后一起启动
+    snd_pcm_sw_params_alloca(&swparams);
+    snd_pcm_sw_params_current(handle, swparams);
+    snd_pcm_sw_params_set_avail_min(handle, swparams, *period);
+    snd_pcm_sw_params_set_start_threshold(handle, swparams, *buffer * 2);
+    // 硬件指针每次更新都打个单调时钟的时间戳，重采样算水位时要用
+    snd_pcm_sw_params_set_tstamp_mode(handle, swparams, SND_PCM_TSTAMP_ENABLE);
+    snd_pcm_sw_params_set_tstamp_type(handle, swparams, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+    rc = snd_pcm_sw_params(handle, swparams);
+    if (rc < 0) {
+        fprintf(stderr, "无法设置软件参数: %s\n", snd_strerror(rc));
+        return -1;
+    }
+    return 0;
+}
+
+// 播放端塞满静音：这就是整条链路固定的延迟垫
+// 返回实际垫进去的帧数
+static int prefill_silence(duplex_t *d) {
+    memset(d->fifo, 0, d->buffer * d->play_frame_bytes); // 全 0 在哪种格式下都是静音
+    snd_pcm_uframes_t left = d->buffer;
+    while (left > 0) {
+        snd_pcm_sframes_t rc = snd_pcm_writei(d->playback, d->fifo, left);
+        if (rc == -EAGAIN) break; // 还没启动，写不进去说明已经满了
+        if (rc < 0) return rc;
+        left -= rc;
+    }
+    return d->buffer - left;
+}
+
+// 启动 (或者 xrun 后重启)：两边都停掉、重新准备、重新垫静音、一起开始
+// 每次都回到同样的起点，所以延迟不会因为 xrun 慢慢漂走
+static int start_duplex(duplex_t *d) {
+    int rc;
+
+    snd_pcm_drop(d->capture);
+    snd_pcm_drop(d->playback);
+    d->pending = 0;
+    if (d->rs) resampler_reset(d->rs);
+    if (d->dsp) dsp_chain_reset(d->dsp);
+
+    if ((rc = snd_pcm_prepare(d->capture)) < 0) return rc;
+    if ((rc = snd_pcm_prepare(d->playback)) < 0) return rc;
+    if ((rc = prefill_silence(d)) < 0) return rc;
+    // 测量从头来过，播放流的编号从垫的静音之后开始
+    if (d->probe) probe_reset(d->probe, rc);
+
+    // 连在一起时启动一个另一个也跟着走，两个时钟从同一时刻开始
+    if ((rc = snd_pcm_start(d->capture)) < 0) return rc;
+    if (!d->linked && (rc = snd_pcm_start(d->playback)) < 0) return rc;
+    return 0;
+}
+
+// s/err 说明是哪个流出的什么错，超时之类不算某一个流的就传 NULL
+static int xrun_recover(duplex_t *d, pcm_stream_stats *s, int err, const char *what) {
+    if (s) pcm_stats_xrun(s, err);
+    d->xruns++;
+    fprintf(stderr, "%s! (第 %lu 次)\n", what, d->xruns);
+    int rc = start_duplex(d);
+    if (rc < 0) fprintf(stderr, "重启失败: %s\n", snd_strerror(rc));
+    return rc;
+}
+
+// 重采样的水位 = 播放端缓冲区里还没放完的 + 手里还没写出去的
+// 硬件指针一般一个周期才更新一次，直接用的话水位会带着一个周期大小的锯齿，
+// 两边时钟差得越少这个锯齿转得越慢，低通滤不掉。所以用指针更新时的时间戳
+// 把 "上次更新以来又放出去的" 那部分扣掉。htimestamp 只读共享的状态页，不进内核
+static void track_fill(duplex_t *d, snd_pcm_sframes_t captured) {
+    snd_pcm_uframes_t avail;
+    snd_htimestamp_t ts;
+    struct timespec now;
+
+    if (snd_pcm_htimestamp(d->playback, &avail, &ts) < 0 || avail > d->buffer) return;
+    double fill = (double)(d->buffer - avail) + d->pending;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double since = (now.tv_sec - ts.tv_sec) + (now.tv_nsec - ts.tv_nsec) / 1e9;
+    if (ts.tv_sec != 0 && since > 0 && since * d->rate < d->buffer) fill -= since * d->rate;
+
+    resampler_track(d->rs, fill, (double)captured / d->cap_rate);
+}
+
+// 录音端有数据：能读多少读多少，攒到 fifo 里
+static int do_capture(duplex_t *d) {
+    snd_pcm_uframes_t space = d->fifo_size - d->pending;
+    char *fifo_end = d->fifo + d->pending * d->play_frame_bytes;
+    char *dst = d->cap_buf ? d->cap_buf : fifo_end;
+    snd_pcm_uframes_t want = space;
+
+    if (d->rs) {
+        // 读多少按 fifo 剩下的空间倒推，留出比例修正和滤波器的余量：
+        // 修正到最低 (step = nominal * (1 - 修正)) 时每帧输入出的帧最多
+        want = space * d->rs->nominal * (1 - RS_MAX_CORRECTION);
+        want = want > RS_TAPS ? want - RS_TAPS : 0;
+    }
+    if (d->cap_buf && want > d->cap_buf_frames) want = d->cap_buf_frames;
+    if (want == 0) return 0;
+
+    unsigned long long t0 = pcm_stats_io_begin();
+    snd_pcm_sframes_t rc = snd_pcm_readi(d->capture, dst, want);
+    pcm_stats_io_end(d->cap_stats, t0, rc);
+    if (rc == -EAGAIN) return 0;
+    if (rc == -EPIPE || rc == -ESTRPIPE) return xrun_recover(d, d->cap_stats, rc, "Overrun");
+    if (rc < 0) {
+        fprintf(stderr, "Read Error: %s\n", snd_strerror(rc));
+        return rc;
+    }
+    if (d->probe) probe_capture(d->probe, (short *)dst, rc); // 录到的存起来做分析
+
+    snd_pcm_sframes_t out = rc;
+    if (d->dsp) {
+        if (d->rs) out = resampler_process(d->rs, dst, d->cap_fmt, rc, d->dsp_buf, SF_F32, space);
+        else sf_to_f32(d->dsp_buf, dst, d->cap_fmt, rc * d->channels);
+        if (out < 0) out = 0; // 放不下的输入重采样器会记下来，退出时报告
+        dsp_process(d->dsp, d->dsp_buf, out);
+        sf_from_f32(fifo_end, d->play_fmt, d->dsp_buf, out * d->channels, &d->dither);
+    } else if (d->rs) {
+        out = resampler_process(d->rs, dst, d->cap_fmt, rc, fifo_end, d->play_fmt, space);
+        if (out < 0) out = 0; // 同上
+    } else if (d->cap_buf) {
+        sf_convert(fifo_end, d->play_fmt, dst, d->cap_fmt, rc * d->channels, &d->dither);
+    }
+    // 要播的换成测试信号 (按播放端的帧数，对齐不变)
+    if (d->probe) probe_fill_playback(d->probe, (short *)fifo_end, out);
+    d->pending += out;
+
+    if (d->rs) track_fill(d, rc);
+    pcm_stats_sample(d->cap_stats, d->capture);
+    return 0;
+}
+
+// 播放端有空位：把攒着的数据尽量写出去
+static int do_playback(duplex_t *d) {
+    if (d->pending == 0) return 0;
+
+    unsigned long long t0 = pcm_stats_io_begin();
+    snd_pcm_sframes_t rc = snd_pcm_writei(d->playback, d->fifo, d->pending);
+    pcm_stats_io_end(d->play_stats, t0, rc);
+    if (rc == -EAGAIN) return 0;
+    if (rc == -EPIPE || rc == -ESTRPIPE) return xrun_recover(d, d->play_stats, rc, "Underrun");
+    if (rc < 0) {
+        fprintf(stderr, "Write Error: %s\n", snd_strerror(rc));
+        return rc;
+    }
+    d->pending -= rc;
+    if (d->pending > 0)
+        memmove(d->fifo, d->fifo + rc * d->play_frame_bytes, d->pending * d->play_frame_bytes);
+    pcm_stats_sample(d->play_stats, d->playback);
     return 0;
 }
 
-int main() {
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "用法: %s [-D 设备] [-C 录音设备] [-P 播放设备] [-r 采样率] [-p 周期帧数] [-n 周期数] "
+            "[-f 格式] [-c 声道数] [-m 次数] [-J 文件] [-R] [-F 优先级[:CPU]] [-e 效果链]\n"
+            "默认: -D default -r 48000 -p 64 -n 2 -f s16 -c 2\n"
+            "  -f 格式  s16 / s24_3 / s32 / f32 / auto (声卡最好的那个)，两边尽量用同一个，\n"
+            "         一样就原样搬运，不一样才在中间转换\n"
+            "  -R     录音和播放不是同一块声卡时用：两边各用各的采样率/时钟，\n"
+            "         中间重采样并跟踪时钟漂移 (两边采样率协商得不一样时自动打开)\n"
+            "  -e 效果链  录到的声音放出去之前过一遍效果，逗号隔开按顺序处理，比如\n"
+            "         -e gain:-3,eq:peak:1000:1:6,eq:hp:80,echo:250:0.4:0.3,limit:-1\n"
+            "         gain:dB  eq:lp|hp|peak|ls|hs:频率[:Q[:dB]]  echo:毫秒[:反馈[:混合]]  limit[:上限dB[:释放毫秒]]\n"
+            "         退出时报告每一级占了每个周期多少时间\n"
+            "  -J 文件  每秒往文件里追加一行 JSON 统计 (kill -USR1 随时打印统计)\n"
+            "  -F 优先级[:CPU]  实时模式：搬运循环 SCHED_FIFO (rr:优先级 用 SCHED_RR)，\n"
+            "         可以绑到一个 CPU，锁内存；开和不开各跑一次对比唤醒抖动\n"
+            "  -m N  测量模式：插入 N 次扫频，报告往返延迟和唤醒抖动 (只支持 s16，不能和 -R、-e 一起用)\n"
+            "        没有声卡时先 modprobe snd-aloop，再用 -P hw:Loopback,0 -C hw:Loopback,1\n", prog);
+}
+
+int main(int argc, char *argv[]) {
     int rc;
-    char *buffer;
-    int size;
-    snd_pcm_t *capture_handle;
-    snd_pcm_t *playback_handle;
+    duplex_t d;
+    const char *cap_dev = "default";
+    const char *play_dev = "default";
+    snd_pcm_uframes_t want_period = 64;
+    unsigned int want_periods = 2;
+    int probes = 0;
+    latency_probe probe;
+    const char *json_path = NULL;
+    int resample = 0;
+    resampler rs;
+    sf_format want_fmt = SF_S16;
+    rt_opts rt;
+    const char *dsp_spec = NULL;
+    dsp_chain dsp;
+    int opt;
 
-    printf("一定要插耳机！否则会啸叫！\n");
+    memset(&d, 0, sizeof(d));
+    d.rate = 48000;
+    d.channels = 2;
+    pcm_stats_init("alsa_loop");
+    rt_default(&rt);
 
-    // --- 1. 打开录音设备 ---
-    rc = snd_pcm_open(&capture_handle, "default", SND_PCM_STREAM_CAPTURE, 0);
+    while ((opt = getopt(argc, argv, "D:C:P:r:p:n:f:c:m:J:RF:e:h")) != -1) {
+        switch (opt) {
+        case 'D': cap_dev = play_dev = optarg; break;
+        case 'C': cap_dev = optarg; break;
+        case 'P': play_dev = optarg; break;
+        case 'r': d.rate = atoi(optarg); break;
+        case 'p': want_period = atoi(optarg); break;
+        case 'n': want_periods = atoi(optarg); break;
+        case 'f':
+            want_fmt = strcmp(optarg, "auto") == 0 ? SF_UNKNOWN : sf_parse(optarg);
+            if (want_fmt == SF_UNKNOWN && strcmp(optarg, "auto") != 0) {
+                fprintf(stderr, "不认识的格式: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'c': d.channels = atoi(optarg); break;
+        case 'm': probes = atoi(optarg); break;
+        case 'J': json_path = optarg; break;
+        case 'R': resample = 1; break;
+        case 'F':
+            if (rt_parse(&rt, optarg) < 0) return 1;
+            break;
+        case 'e': dsp_spec = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (want_periods < 2) want_periods = 2;
+
+    if (probes > PROBE_MAX) {
+        fprintf(stderr, "-m 最多 %d 次\n", PROBE_MAX);
+        return 1;
+    }
+    if (probes <= 0) printf("一定要插耳机！否则会啸叫！\n");
+
+    // --- 1. 打开录音设备 (非阻塞，交给 poll 来等) ---
+    rc = snd_pcm_open(&d.capture, cap_dev, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
     if (rc < 0) {
         fprintf(stderr, "无法打开录音设备: %s\n", snd_strerror(rc));
         return 1;
     }
 
     // --- 2. 打开播放设备 ---
-    rc = snd_pcm_open(&playback_handle, "default", SND_PCM_STREAM_PLAYBACK, 0);
+    rc = snd_pcm_open(&d.playback, play_dev, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
     if (rc < 0) {
         fprintf(stderr, "无法打开播放设备: %s\n", snd_strerror(rc));
         return 1;
     }
 
     // --- 3. 配置参数 (重点看这里) ---
-    // 咱们先设置成一模一样的 44100
-    set_params(capture_handle, 44100);
-    set_params(playback_handle, 44100);
-
-    // --- 5. 准备缓冲区 ---
-    size = FRAMES * 4; // 2声道 * 16位(2字节) = 4字节/帧
-    buffer = (char *) malloc(size);
-
-    printf("开始回声测试 (按 Ctrl+C 停止)...\n");
-
-    // --- 5. 搬运循环 ---
-    while (1) {
-        // 从麦克风读
-        rc = snd_pcm_readi(capture_handle, buffer, FRAMES);
-        if (rc == -EPIPE) {
-            fprintf(stderr, "Overrun!\n");
-            snd_pcm_prepare(capture_handle);
-        } else if (rc < 0) {
-            fprintf(stderr, "Read Error\n");
+    // 先配录音端，播放端用录音端实际拿到的值，保证两边节奏一致
+    // (开了重采样时播放端自己按 -r 协商，拿到什么都行)
+    unsigned int cap_rate = d.rate;
+    snd_pcm_uframes_t cap_period = want_period;
+    snd_pcm_uframes_t cap_buffer = want_period * want_periods;
+    d.cap_fmt = want_fmt;
+    if (set_params(d.capture, &d.cap_fmt, d.channels, &cap_rate, &cap_period, &cap_buffer) < 0) return 1;
+
+    if (!resample) d.rate = cap_rate;
+    d.cap_rate = cap_rate;
+    d.period = cap_period;
+    d.buffer = cap_period * want_periods;
+    d.play_fmt = d.cap_fmt;
+    if (set_params(d.playback, &d.play_fmt, d.channels, &d.rate, &d.period, &d.buffer) < 0) return 1;
+    d.cap_frame_bytes = d.channels * sf_bytes(d.cap_fmt);
+    d.play_frame_bytes = d.channels * sf_bytes(d.play_fmt);
+    sf_dither_init(&d.dither, 1);
+
+    if (d.rate != cap_rate && !resample) {
+        fprintf(stderr, "录音 %u Hz, 播放 %u Hz, 打开重采样\n", cap_rate, d.rate);
+        resample = 1;
+    }
+    if (d.period != cap_period) {
+        fprintf(stderr, "警告: 录音周期 %lu 帧, 播放周期 %lu 帧, 两边不一致\n", cap_period, d.period);
+    }
+    if (probes > 0 && dsp_spec) {
+        fprintf(stderr, "测量模式放的是扫频，不能加效果链\n");
+        return 1;
+    }
+    if (probes > 0 && resample) {
+        // 录到的是录音端采样率的帧，扫频和换算延迟用的是播放端的，对不上
+        fprintf(stderr, "测量模式不能重采样 (录音 %u Hz, 播放 %u Hz)\n", cap_rate, d.rate);
+        return 1;
+    }
+    if (probes > 0 && (d.cap_fmt != SF_S16 || d.play_fmt != SF_S16)) {
+        fprintf(stderr, "测量模式只支持 s16 (录音 %s, 播放 %s)\n", sf_name(d.cap_fmt), sf_name(d.play_fmt));
+        return 1;
+    }
+
+    // --- 4. 把两个流连在一起，同时开始、同时停止 ---
+    d.linked = (snd_pcm_link(d.capture, d.playback) == 0);
+    if (!d.linked) fprintf(stderr, "snd_pcm_link 不支持，分别启动两个流\n");
+
+    // --- 5. 准备缓冲区和 poll 描述符 ---
+    // fifo 按两边缓冲区较大的一个分配，录音端一次最多读这么多
+    d.fifo_size = cap_buffer > d.buffer ? cap_buffer : d.buffer;
+    if (resample || d.cap_fmt != d.play_fmt || dsp_spec) {
+        d.cap_buf_frames = cap_buffer;
+        d.cap_buf = (char *) malloc(cap_buffer * d.cap_frame_bytes);
+        if (!d.cap_buf) {
+            fprintf(stderr, "内存不足\n");
+            return 1;
+        }
+    }
+    if (resample) {
+        // 录音端一次最多读一个缓冲区，换算到播放端的帧数再留点余量
+        snd_pcm_uframes_t out_max = (double)cap_buffer * d.rate / cap_rate / (1 - RS_MAX_CORRECTION) + RS_TAPS + 1;
+        if (out_max > d.fifo_size) d.fifo_size = out_max;
+        if (resampler_init(&rs, d.channels, cap_rate, d.rate, cap_buffer) < 0) {
+            fprintf(stderr, "重采样初始化失败 (%d 声道)\n", d.channels);
+            return 1;
+        }
+        d.rs = &rs;
+    }
+    d.fifo = (char *) malloc(d.fifo_size * d.play_frame_bytes);
+    if (dsp_spec) {
+        // 按播放端的采样率建 (重采样在效果链前面)，最多一次处理 fifo 那么多帧
+        if (dsp_chain_init(&dsp, dsp_spec, d.channels, d.rate) < 0) return 1;
+        d.dsp_buf = (float *) malloc(sizeof(float) * d.fifo_size * d.channels);
+        if (!d.dsp_buf) {
+            fprintf(stderr, "内存不足\n");
+            return 1;
         }
+        d.dsp = &dsp;
+    }
+
+    d.cap_nfds = snd_pcm_poll_descriptors_count(d.capture);
+    d.play_nfds = snd_pcm_poll_descriptors_count(d.playback);
+    d.pfds = (struct pollfd *) calloc(d.cap_nfds + d.play_nfds, sizeof(struct pollfd));
+    snd_pcm_poll_descriptors(d.capture, d.pfds, d.cap_nfds);
+    snd_pcm_poll_descriptors(d.playback, d.pfds + d.cap_nfds, d.play_nfds);
 
-        // 往耳机写
-        // 注意：这里我们直接把读到的 buffer 原封不动写出去
-        rc = snd_pcm_writei(playback_handle, buffer, FRAMES);
-        if (rc == -EPIPE) {
-            fprintf(stderr, "Underrun!\n");
-            snd_pcm_prepare(playback_handle);
-        } else if (rc < 0) {
-            fprintf(stderr, "Write Error\n");
+    printf("采样率 %u Hz, 周期 %lu 帧, 缓冲 %lu 帧, 预计往返延迟 %.2f ms\n",
+           d.rate, d.period, d.buffer,
+           (d.period + d.buffer) * 1000.0 / d.rate);
+    if (d.cap_fmt == d.play_fmt) printf("格式 %s, %d 声道\n", sf_name(d.cap_fmt), d.channels);
+    else printf("格式 %s -> %s (软件转换), %d 声道\n", sf_name(d.cap_fmt), sf_name(d.play_fmt), d.channels);
+    if (d.rs) printf("重采样 %u -> %u Hz, 滤波器另加 %.2f ms 延迟\n",
+                     cap_rate, d.rate, RS_TAPS / 2 * 1000.0 / cap_rate);
+    if (d.dsp) dsp_chain_describe(d.dsp, stdout);
+
+    if (probes > 0) {
+        if (probe_init(&probe, d.rate, d.channels, probes) < 0) {
+            fprintf(stderr, "内存不足\n");
+            return 1;
         }
+        d.probe = &probe;
+    }
+
+    d.cap_stats = pcm_stats_stream("capture", cap_rate);
+    d.play_stats = pcm_stats_stream("playback", d.rate);
+    if (pcm_stats_start(json_path, 1000) < 0) return 1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    // 搬运循环用到的缓冲区先摸一遍，再切实时 (报告线程已经开好了，不会继承)
+    rt_prefault(d.fifo, d.fifo_size * d.play_frame_bytes);
+    rt_prefault(d.cap_buf, d.cap_buf_frames * d.cap_frame_bytes);
+    rt_prefault(d.dsp_buf, d.dsp ? sizeof(float) * d.fifo_size * d.channels : 0);
+    if (d.rs) {
+        for (int c = 0; c < d.channels; c++) rt_prefault(d.rs->hist[c], sizeof(float) * d.rs->cap);
+        rt_prefault(d.rs->scratch, sizeof(float) * d.rs->cap * d.channels);
+    }
+    if (d.probe) {
+        rt_prefault(probe.rec, sizeof(short) * probe.rec_len);
+        rt_prefault(probe.wake_us, sizeof(double) * probe.wake_cap);
+    }
+    rt_enter(&rt, "alsa_loop");
+
+    if ((rc = start_duplex(&d)) < 0) {
+        fprintf(stderr, "启动失败: %s\n", snd_strerror(rc));
+        return 1;
+    }
+
+    if (d.probe) printf("开始测量，大约需要 %.1f 秒...\n", (double)probe.rec_len / d.rate);
+    else printf("开始回声测试 (按 Ctrl+C 停止)...\n");
+
+    // --- 6. 搬运循环：一个 poll 等两个流 ---
+    while (keep_running) {
+        // 手里没有待写的数据时不关心播放端，否则它一直可写会让 poll 空转
+        int nfds = d.cap_nfds + (d.pending > 0 ? d.play_nfds : 0);
+        rc = poll(d.pfds, nfds, 1000);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (rc == 0) {
+            if (xrun_recover(&d, NULL, 0, "Timeout") < 0) break;
+            continue;
+        }
+
+        unsigned short revents;
+        snd_pcm_poll_descriptors_revents(d.capture, d.pfds, d.cap_nfds, &revents);
+        if (revents & POLLERR) {
+            if (xrun_recover(&d, d.cap_stats, -EPIPE, "Overrun") < 0) break;
+            continue;
+        }
+        if (revents & POLLIN) {
+            pcm_stats_wakeup(d.cap_stats);
+            if (d.probe) probe_wakeup(d.probe);
+            if (do_capture(&d) < 0) break;
+            if (d.probe && probe_done(d.probe)) break;
+        }
+
+        if (nfds > d.cap_nfds) {
+            snd_pcm_poll_descriptors_revents(d.playback, d.pfds + d.cap_nfds, d.play_nfds, &revents);
+            if (revents & POLLERR) {
+                if (xrun_recover(&d, d.play_stats, -EPIPE, "Underrun") < 0) break;
+                continue;
+            }
+            if (revents & POLLOUT) pcm_stats_wakeup(d.play_stats);
+        }
+        // 刚读到的数据立刻尝试写出去，不用等下一轮 poll
+        if (do_playback(&d) < 0) break;
+    }
+
+    printf("\n结束，共 %lu 次 xrun\n", d.xruns);
+    rt_report(&rt, stdout);
+    pcm_stats_stop(stdout);
+    if (d.rs) {
+        resampler_report(d.rs);
+        resampler_free(d.rs);
+    }
+    free(d.cap_buf);
+    if (d.dsp) {
+        dsp_chain_report(d.dsp, d.period, stdout);
+        dsp_chain_free(d.dsp);
+        free(d.dsp_buf);
+    }
+    if (d.probe) {
+        probe_report(d.probe, d.period);
+        probe_free(d.probe);
     }
 
-    snd_pcm_close(capture_handle);
-    snd_pcm_close(playback_handle);
-    free(buffer);
+    snd_pcm_drop(d.capture);
+    snd_pcm_drop(d.playback);
+    if (d.linked) snd_pcm_unlink(d.capture);
+    snd_pcm_close(d.capture);
+    snd_pcm_close(d.playback);
+    free(d.pfds);
+    free(d.fifo);
     return 0;
 }
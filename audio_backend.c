@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <string.h>
+#include "audio_backend.h"
+#include "pcm_mmap.h"
+#include "pcm_ctl.h"
+
+static const char *names[] = { "alsa", "null", "file" };
+
+const char *audio_backend_name(const audio_backend *b) {
+    return names[b->kind];
+}
+
+static int alsa_open(audio_backend *b, const char *dev) {
+    snd_pcm_hw_params_t *params;
+    int dir = 0;
+    int rc;
+
+    rc = snd_pcm_open(&b->pcm, dev, SND_PCM_STREAM_PLAYBACK, 0);
+    if (rc < 0) {
+        fprintf(stderr, "无法打开播放设备 %s: %s\n", dev, snd_strerror(rc));
+        return -1;
+    }
+
+    snd_pcm_hw_params_alloca(&params);
+    snd_pcm_hw_params_any(b->pcm, params);
+    snd_pcm_hw_params_set_access(b->pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED);
+    // 尽量让声卡直接吃要的格式，不行调用方自己转换
+    b->fmt = pcm_set_format(b->pcm, params, b->fmt);
+    snd_pcm_hw_params_set_channels(b->pcm, params, b->channels);
+    snd_pcm_hw_params_set_rate_near(b->pcm, params, &b->rate, &dir);
+    snd_pcm_hw_params_set_period_size_near(b->pcm, params, &b->period, &dir);
+    if (b->fmt == SF_UNKNOWN || (rc = snd_pcm_hw_params(b->pcm, params)) < 0) {
+        fprintf(stderr, "无法设置声卡参数 (%d 声道)\n", b->channels);
+        snd_pcm_close(b->pcm);
+        return -1;
+    }
+    snd_pcm_hw_params_get_period_size(params, &b->period, &dir);
+    b->realtime = 1;
+    return 0;
+}
+
+int audio_backend_open(audio_backend *b, const char *spec, sf_format fmt, int channels,
+                       unsigned int rate, snd_pcm_uframes_t period) {
+    memset(b, 0, sizeof(*b));
+    b->fmt = fmt;
+    b->channels = channels;
+    b->rate = rate;
+    b->period = period;
+
+    if (strcmp(spec, "alsa") == 0 || strncmp(spec, "alsa:", 5) == 0) {
+        b->kind = AUDIO_BACKEND_ALSA;
+        if (alsa_open(b, spec[4] ? spec + 5 : "default") < 0) return -1;
+    } else if (strcmp(spec, "null") == 0) {
+        b->kind = AUDIO_BACKEND_NULL;
+    } else if (strncmp(spec, "file:", 5) == 0 && spec[5]) {
+        b->kind = AUDIO_BACKEND_FILE;
+        if (wav_writer_open(&b->wav, spec + 5, rate, channels, fmt) < 0) return -1;
+    } else {
+        fprintf(stderr, "不认识的后端: %s (alsa[:设备] / null / file:路径)\n", spec);
+        return -1;
+    }
+    b->stats = pcm_stats_stream("playback", b->rate);
+    return 0;
+}
+
+long audio_backend_write(audio_backend *b, const void *data, size_t frames) {
+    unsigned long long t0 = pcm_stats_io_begin();
+    long rc = frames;
+
+    switch (b->kind) {
+    case AUDIO_BACKEND_ALSA:
+        rc = snd_pcm_writei(b->pcm, data, frames);
+        pcm_stats_io_end(b->stats, t0, rc);
+        // 阻塞写返回就是被唤醒处理下一个周期
+        pcm_stats_wakeup(b->stats);
+        if (rc == -EPIPE || rc == -ESTRPIPE) {
+            pcm_stats_xrun(b->stats, rc);
+            snd_pcm_prepare(b->pcm);
+            return 0;
+        }
+        if (rc < 0) {
+            fprintf(stderr, "Write Error: %s\n", snd_strerror(rc));
+            return -1;
+        }
+        pcm_stats_sample(b->stats, b->pcm);
+        break;
+    case AUDIO_BACKEND_NULL:
+        pcm_stats_io_end(b->stats, t0, rc);
+        break;
+    case AUDIO_BACKEND_FILE:
+        if (wav_writer_write(&b->wav, data, frames * b->channels * sf_bytes(b->fmt)) < 0) return -1;
+        pcm_stats_io_end(b->stats, t0, rc);
+        break;
+    }
+    b->frames += rc;
+    return rc;
+}
+
+int audio_backend_pause(audio_backend *b, int pause) {
+    int rc;
+    if (b->kind != AUDIO_BACKEND_ALSA) return 0;
+    if ((rc = pcm_pause(b->pcm, pause)) < 0) {
+        fprintf(stderr, "%s失败: %s\n", pause ? "暂停" : "继续播放", snd_strerror(rc));
+        return -1;
+    }
+    return 0;
+}
+
+void audio_backend_close(audio_backend *b) {
+    switch (b->kind) {
+    case AUDIO_BACKEND_ALSA:
+        snd_pcm_close(b->pcm);
+        break;
+    case AUDIO_BACKEND_NULL:
+        break;
+    case AUDIO_BACKEND_FILE:
+        wav_writer_close(&b->wav);
+        break;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef AUDIO_BACKEND_H
+#define AUDIO_BACKEND_H
+
+#include <alsa/asoundlib.h>
+#include "sample_fmt.h"
+#include "wav_writer.h"
+#include "pcm_stats.h"
+
+// --- 播放后端：音频最后送到哪 ---
+// 可视化的节奏本来是由 snd_pcm_writei 阻塞出来的，没有声卡就跑不了。
+// 把 "写出去" 这一步抽出来，换个后端同一条分析流水线就能脱离声卡跑：
+//   alsa[:设备]   真的放出来，write 按播放速度阻塞 (默认 default 设备)
+//   null          直接扔掉，write 立刻返回，CPU 多快就跑多快
+//   file:路径     写成 WAV (和输入同格式)，同样不限速，可以拿来核对送出去的数据
+// 不限速的后端 realtime = 0，调用方据此切到离线模式 (不丢数据、不要界面)
+typedef enum {
+    AUDIO_BACKEND_ALSA,
+    AUDIO_BACKEND_NULL,
+    AUDIO_BACKEND_FILE
+} audio_backend_kind;
+
+typedef struct {
+    audio_backend_kind kind;
+    int realtime;               // write 会不会按播放速度阻塞
+    sf_format fmt;              // 实际用的格式 (ALSA 是协商出来的，其余就是要的那个)
+    int channels;
+    unsigned int rate;
+    snd_pcm_uframes_t period;   // 一次写多少帧合适
+    unsigned long long frames;  // 一共写出去多少帧
+
+    snd_pcm_t *pcm;             // alsa
+    wav_writer wav;             // file
+    pcm_stream_stats *stats;    // "playback"，open 的时候登记
+} audio_backend;
+
+// spec 见上面；fmt/rate/period 是想要的，实际拿到的看 b 里的字段
+// 要在 pcm_stats_start() 之前调用 (要登记统计)。失败打印原因并返回 -1
+int audio_backend_open(audio_backend *b, const char *spec, sf_format fmt, int channels,
+                       unsigned int rate, snd_pcm_uframes_t period);
+// 写 frames 帧交错的 b->fmt。ALSA 欠载自己恢复 (这次算写了 0 帧)
+// 返回写了多少帧，出错返回 -1
+long audio_backend_write(audio_backend *b, const void *data, size_t frames);
+// 暂停/继续：ALSA 让声卡真的停下 (见 pcm_pause)，不限速的后端什么都不用做
+int audio_backend_pause(audio_backend *b, int pause);
+// file 会补好 WAV 头
+void audio_backend_close(audio_backend *b);
+
+// "alsa" / "null" / "file"
+const char *audio_backend_name(const audio_backend *b);
+
+#endif
@@ -0,0 +1,649 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "synth.h"
+#include "spectrum.h"
+#include "wav_writer.h"
+#include "wav_source.h"
+#include "sample_fmt.h"
+#include "dsp.h"
+#include "lac.h"
+
+// --- 热路径微基准 ---
+// 全部离线跑，不碰声卡。每个用例先把要用的东西准备好，只给热循环计时，
+// 重复几轮取最快的一轮 (最不受干扰的那次)，同时数热循环里 malloc 了几次。
+// 输出一行一个用例，空格分隔，# 开头的是注释，方便脚本直接读；
+// -o 存成基线，以后用 -c 对比，慢了超过阈值就返回 1。
+
+#define BENCH_RATE 44100
+#define BENCH_BARS 64
+#define BENCH_MAX_CASES 32
+
+// --- 分配计数 ---
+// 直接在可执行文件里定义 malloc 这一族，盖掉 libc 的 (FFTW 里面的分配也算得到)，
+// 真正干活的还是 glibc 导出的 __libc_xxx
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void *__libc_memalign(size_t, size_t);
+extern void __libc_free(void *);
+
+static atomic_ulong alloc_count;
+static atomic_ulong alloc_bytes;
+
+static void count_alloc(size_t bytes) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, bytes, memory_order_relaxed);
+}
+
+void *malloc(size_t n) {
+    count_alloc(n);
+    return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size) {
+    count_alloc(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n) {
+    count_alloc(n);
+    return __libc_realloc(p, n);
+}
+
+void *memalign(size_t align, size_t n) {
+    count_alloc(n);
+    return __libc_memalign(align, n);
+}
+
+void *aligned_alloc(size_t align, size_t n) {
+    return memalign(align, n);
+}
+
+int posix_memalign(void **p, size_t align, size_t n) {
+    *p = memalign(align, n);
+    return *p ? 0 : 12; // ENOMEM
+}
+
+void free(void *p) {
+    __libc_free(p);
+}
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 防止编译器把算出来没人用的结果整个优化掉
+static volatile double sink;
+
+// --- 用例 ---
+// setup 在计时之外准备数据，run 跑 iters 次热循环，返回一共处理了多少个单位
+typedef struct {
+    const char *name;
+    const char *unit;       // sample (一帧，立体声算一个) / header
+    int arg;
+    void *(*setup)(int arg);
+    long (*run)(void *st, long iters);
+    void (*teardown)(void *st);
+} bench_case;
+
+static char tmp_wav[64];
+static char tmp_raw[64];
+static char tmp_lac[64];
+
+// 生成器：每次迭代写 4096 帧
+#define GEN_FRAMES 4096
+
+static void *setup_pcm(int arg) {
+    (void)arg;
+    return calloc(GEN_FRAMES * 2 * 2, sizeof(short)); // poly_tone 可能多写半个块，留足余量
+}
+
+static long run_tone(void *st, long iters) {
+    short *buf = st;
+    for (long i = 0; i < iters; i++)
+        generate_tone(buf, 440.0, BENCH_RATE, i * GEN_FRAMES, GEN_FRAMES);
+    sink = buf[GEN_FRAMES];
+    return iters * GEN_FRAMES;
+}
+
+// 0.1 秒一个音符 (4410 帧)，和声/包络/饱和转换全都包括在内
+static long run_poly_tone(void *st, long iters) {
+    short *buf = st;
+    int frames = 0;
+    for (long i = 0; i < iters; i++)
+        frames = generate_poly_tone(buf, 440.0, 220.0, 0.1, BENCH_RATE, 0) / 2;
+    sink = buf[frames];
+    return iters * frames;
+}
+
+static long run_poly_tone_fast(void *st, long iters) {
+    short *buf = st;
+    int frames = 0;
+    for (long i = 0; i < iters; i++)
+        frames = generate_poly_tone_fast(buf, 440.0, 220.0, 0.1, BENCH_RATE, 0) / 2;
+    sink = buf[frames];
+    return iters * frames;
+}
+
+// 把一个 0.5 秒音符的每个采样都算一遍包络，四个阶段都会走到
+static long run_adsr(void *st, long iters) {
+    (void)st;
+    ADSR env = {0.05, 0.1, 0.7, 0.15};
+    double duration = 0.5;
+    int n = duration * BENCH_RATE;
+    double acc = 0;
+    for (long i = 0; i < iters; i++)
+        for (int k = 0; k < n; k++)
+            acc += get_adsr_volume((double)k / BENCH_RATE, duration, env);
+    sink = acc;
+    return iters * n;
+}
+
+// --- FFT：每次迭代分析一帧 (n 个样本)，和可视化里一样从立体声里跳着取左声道 ---
+typedef struct {
+    spectrum_ctx ctx;
+    short *pcm;
+    double heights[BENCH_BARS];
+} fft_state;
+
+static void *setup_fft(int n) {
+    fft_state *f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+    f->pcm = malloc(sizeof(short) * n * 2);
+    if (!f->pcm || spectrum_init(&f->ctx, n, FFTW_MEASURE, SPECTRUM_WISDOM_FILE) < 0) {
+        free(f->pcm);
+        free(f);
+        return NULL;
+    }
+    generate_tone(f->pcm, 1000.0, BENCH_RATE, 0, n);
+    return f;
+}
+
+static long run_fft(void *st, long iters) {
+    fft_state *f = st;
+    for (long i = 0; i < iters; i++)
+        compute_spectrum(&f->ctx, f->pcm, 2, f->ctx.n, f->heights, BENCH_BARS);
+    sink = f->heights[1];
+    return iters * f->ctx.n;
+}
+
+static void teardown_fft(void *st) {
+    fft_state *f = st;
+    spectrum_destroy(&f->ctx);
+    free(f->pcm);
+    free(f);
+}
+
+// --- WAV 头：写 = 打开 + 补头 + 关闭一个空文件；读 = 打开映射 + 走 RIFF 块 + 关闭 ---
+static void *setup_none(int arg) {
+    (void)arg;
+    return (void *)1;
+}
+
+static long run_wav_write(void *st, long iters) {
+    (void)st;
+    wav_writer w;
+    for (long i = 0; i < iters; i++) {
+        if (wav_writer_open(&w, tmp_wav, BENCH_RATE, 2, SF_S16) < 0) return -1;
+        if (wav_writer_close(&w) < 0) return -1;
+    }
+    return iters;
+}
+
+static void *setup_wav_parse(int arg) {
+    (void)arg;
+    short pcm[GEN_FRAMES * 2];
+    wav_writer w;
+
+    generate_tone(pcm, 440.0, BENCH_RATE, 0, GEN_FRAMES);
+    if (wav_writer_open(&w, tmp_wav, BENCH_RATE, 2, SF_S16) < 0) return NULL;
+    wav_writer_write(&w, pcm, sizeof(pcm));
+    if (wav_writer_close(&w) < 0) return NULL;
+    return (void *)1;
+}
+
+static long run_wav_parse(void *st, long iters) {
+    (void)st;
+    wav_source src;
+    for (long i = 0; i < iters; i++) {
+        if (wav_source_open(&src, tmp_wav) < 0) return -1;
+        sink = src.frames;
+        wav_source_close(&src);
+    }
+    return iters;
+}
+
+// --- 原始 PCM 文件读取：8 MB 的文件，按 4096 帧一块 fread，文件已经在页缓存里 ---
+#define RAW_FRAMES (2 * 1024 * 1024)
+
+typedef struct {
+    FILE *fp;
+    short buf[GEN_FRAMES * 2];
+} raw_state;
+
+static void *setup_raw(int arg) {
+    (void)arg;
+    raw_state *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+
+    FILE *fp = fopen(tmp_raw, "wb");
+    if (!fp) {
+        perror(tmp_raw);
+        free(r);
+        return NULL;
+    }
+    generate_tone(r->buf, 440.0, BENCH_RATE, 0, GEN_FRAMES);
+    for (int i = 0; i < RAW_FRAMES / GEN_FRAMES; i++)
+        fwrite(r->buf, sizeof(short) * 2, GEN_FRAMES, fp);
+    fclose(fp);
+
+    // 先打开好，热循环里只有 rewind + fread
+    r->fp = fopen(tmp_raw, "rb");
+    if (!r->fp) {
+        perror(tmp_raw);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static long run_raw(void *st, long iters) {
+    raw_state *r = st;
+    long frames = 0;
+    for (long i = 0; i < iters; i++) {
+        size_t got;
+        rewind(r->fp);
+        while ((got = fread(r->buf, sizeof(short) * 2, GEN_FRAMES, r->fp)) > 0)
+            frames += got;
+    }
+    sink = r->buf[0];
+    return frames;
+}
+
+static void teardown_raw(void *st) {
+    raw_state *r = st;
+    fclose(r->fp);
+    free(r);
+}
+
+// --- 采样格式转换：每次迭代转 GEN_FRAMES 帧立体声 (deint_8ch 是 8 声道帧) ---
+enum { CONV_S16_F32, CONV_F32_S16, CONV_S32_S16, CONV_DEINT_8CH };
+
+typedef struct {
+    int kind;
+    void *src;
+    void *dst;
+    float *planes[8];
+    sf_dither dither;
+} conv_state;
+
+static void teardown_conv(void *st);
+
+static void *setup_conv(int kind) {
+    conv_state *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->kind = kind;
+    // 最大的情况：8 声道 float
+    c->src = malloc(GEN_FRAMES * 8 * sizeof(float));
+    c->dst = malloc(GEN_FRAMES * 8 * sizeof(float));
+    int ok = c->src && c->dst;
+    for (int i = 0; i < 8; i++) {
+        c->planes[i] = malloc(GEN_FRAMES * sizeof(float));
+        if (!c->planes[i]) ok = 0;
+    }
+    if (!ok) {
+        teardown_conv(c);
+        return NULL;
+    }
+    sf_dither_init(&c->dither, 1);
+
+    // 源数据都从一段 16 位的正弦波来
+    short pcm[GEN_FRAMES * 2];
+    generate_tone(pcm, 440.0, BENCH_RATE, 0, GEN_FRAMES);
+    if (kind == CONV_S16_F32) memcpy(c->src, pcm, sizeof(pcm));
+    else if (kind == CONV_F32_S16) sf_to_f32(c->src, pcm, SF_S16, GEN_FRAMES * 2);
+    else if (kind == CONV_S32_S16) sf_convert(c->src, SF_S32, pcm, SF_S16, GEN_FRAMES * 2, NULL);
+    else for (int i = 0; i < 4; i++) sf_to_f32((float *)c->src + i * GEN_FRAMES * 2, pcm, SF_S16, GEN_FRAMES * 2);
+    return c;
+}
+
+static long run_conv(void *st, long iters) {
+    conv_state *c = st;
+    for (long i = 0; i < iters; i++) {
+        switch (c->kind) {
+        case CONV_S16_F32: sf_to_f32(c->dst, c->src, SF_S16, GEN_FRAMES * 2); break;
+        case CONV_F32_S16: sf_from_f32(c->dst, SF_S16, c->src, GEN_FRAMES * 2, &c->dither); break;
+        case CONV_S32_S16: sf_convert(c->dst, SF_S16, c->src, SF_S32, GEN_FRAMES * 2, &c->dither); break;
+        default: sf_deinterleave(c->planes, c->src, 8, GEN_FRAMES); break;
+        }
+    }
+    sink = c->kind == CONV_DEINT_8CH ? c->planes[7][1] : ((short *)c->dst)[1];
+    return iters * GEN_FRAMES;
+}
+
+static void teardown_conv(void *st) {
+    conv_state *c = st;
+    free(c->src);
+    free(c->dst);
+    for (int i = 0; i < 8; i++) free(c->planes[i]);
+    free(c);
+}
+
+// --- 回声机的效果链：立体声，一次一个 64 帧的周期，和 alsa_loop 的短周期一样 ---
+#define DSP_BENCH_PERIOD 64
+#define DSP_BENCH_SPEC "gain:-3,eq:peak:1000:1:6,eq:hp:80,echo:250:0.4:0.3,limit:-1"
+
+typedef struct {
+    dsp_chain chain;
+    float buf[DSP_BENCH_PERIOD * 2];
+} dsp_bench_state;
+
+static void *setup_dsp(int arg) {
+    (void)arg;
+    dsp_bench_state *d = calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    if (dsp_chain_init(&d->chain, DSP_BENCH_SPEC, 2, BENCH_RATE) < 0) {
+        free(d);
+        return NULL;
+    }
+    short pcm[DSP_BENCH_PERIOD * 2];
+    generate_tone(pcm, 440.0, BENCH_RATE, 0, DSP_BENCH_PERIOD);
+    sf_to_f32(d->buf, pcm, SF_S16, DSP_BENCH_PERIOD * 2);
+    return d;
+}
+
+static long run_dsp(void *st, long iters) {
+    dsp_bench_state *d = st;
+    for (long i = 0; i < iters; i++) dsp_process(&d->chain, d->buf, DSP_BENCH_PERIOD);
+    sink = d->buf[1];
+    return iters * DSP_BENCH_PERIOD;
+}
+
+static void teardown_dsp(void *st) {
+    dsp_bench_state *d = st;
+    dsp_chain_free(&d->chain);
+    free(d);
+}
+
+// --- 无损压缩：一个和弦音符 (8 块)，编码写到 /dev/null；解码是整个文件从头解到尾 ---
+#define LAC_BENCH_FRAMES (LAC_BLOCK_FRAMES * 8)
+
+typedef struct {
+    short pcm[LAC_BENCH_FRAMES * 2];
+    lac_writer w;
+    wav_source src;
+} lac_bench_state;
+
+static void *setup_lac(int decode) {
+    lac_bench_state *l = calloc(1, sizeof(*l));
+    if (!l) return NULL;
+    generate_poly_tone_fast(l->pcm, 440.0, 659.25, (double)LAC_BENCH_FRAMES / BENCH_RATE, BENCH_RATE, 0);
+
+    if (!decode) {
+        if (lac_writer_open(&l->w, "/dev/null", BENCH_RATE, 2, SF_S16) < 0) goto fail;
+        return l;
+    }
+    if (lac_writer_open(&l->w, tmp_lac, BENCH_RATE, 2, SF_S16) < 0) goto fail;
+    lac_writer_write(&l->w, l->pcm, sizeof(l->pcm));
+    if (lac_writer_close(&l->w) < 0 || wav_source_open(&l->src, tmp_lac) < 0) goto fail;
+    return l;
+fail:
+    free(l);
+    return NULL;
+}
+
+static long run_lac_encode(void *st, long iters) {
+    lac_bench_state *l = st;
+    for (long i = 0; i < iters; i++)
+        if (lac_writer_write(&l->w, l->pcm, sizeof(l->pcm)) < 0) return -1;
+    sink = l->w.out_bytes;
+    return iters * LAC_BENCH_FRAMES;
+}
+
+static long run_lac_decode(void *st, long iters) {
+    lac_bench_state *l = st;
+    long frames = 0;
+    for (long i = 0; i < iters; i++) {
+        size_t n = LAC_BLOCK_FRAMES;
+        wav_source_rewind(&l->src);
+        while (wav_source_next(&l->src, &n)) {
+            frames += n;
+            n = LAC_BLOCK_FRAMES;
+        }
+    }
+    sink = l->src.lac->out[0];
+    return frames;
+}
+
+static void teardown_lac(void *st) {
+    lac_bench_state *l = st;
+    if (l->src.map) wav_source_close(&l->src);
+    else lac_writer_close(&l->w);
+    free(l);
+}
+
+static void teardown_free(void *st) {
+    free(st);
+}
+
+static const bench_case cases[] = {
+    { "tone",           "sample", 0,     setup_pcm,       run_tone,           teardown_free },
+    { "poly_tone",      "sample", 0,     setup_pcm,       run_poly_tone,      teardown_free },
+    { "poly_tone_fast", "sample", 0,     setup_pcm,       run_poly_tone_fast, teardown_free },
+    { "adsr",           "sample", 0,     setup_none,      run_adsr,           NULL },
+    { "fft_1024",       "sample", 1024,  setup_fft,       run_fft,            teardown_fft },
+    { "fft_4096",       "sample", 4096,  setup_fft,       run_fft,            teardown_fft },
+    { "fft_16384",      "sample", 16384, setup_fft,       run_fft,            teardown_fft },
+    { "wav_hdr_write",  "header", 0,     setup_none,      run_wav_write,      NULL },
+    { "wav_hdr_parse",  "header", 0,     setup_wav_parse, run_wav_parse,      NULL },
+    { "raw_read",       "sample", 0,     setup_raw,       run_raw,            teardown_raw },
+    { "conv_s16_f32",   "sample", CONV_S16_F32,   setup_conv, run_conv,       teardown_conv },
+    { "conv_f32_s16",   "sample", CONV_F32_S16,   setup_conv, run_conv,       teardown_conv },
+    { "conv_s32_s16",   "sample", CONV_S32_S16,   setup_conv, run_conv,       teardown_conv },
+    { "deint_8ch",      "sample", CONV_DEINT_8CH, setup_conv, run_conv,       teardown_conv },
+    { "dsp_chain",      "frame",  0,     setup_dsp,       run_dsp,            teardown_dsp },
+    { "lac_encode",     "sample", 0,     setup_lac,       run_lac_encode,     teardown_lac },
+    { "lac_decode",     "sample", 1,     setup_lac,       run_lac_decode,     teardown_lac },
+};
+#define NCASES (int)(sizeof(cases) / sizeof(cases[0]))
+
+// --- 结果 ---
+typedef struct {
+    const char *name;
+    const char *unit;
+    double ns;              // 最快一轮的 ns/单位
+    double spread;          // 各轮之间最慢比最快慢了多少 (%)，看噪声大不大
+    double allocs;          // 每次迭代 malloc 几次
+    double alloc_bytes;
+    long iters;             // 每轮迭代次数
+} bench_result;
+
+static int measure(const bench_case *c, double target_ms, int rounds, bench_result *res) {
+    void *st = c->setup(c->arg);
+    if (!st) {
+        fprintf(stderr, "%s: 准备失败\n", c->name);
+        return -1;
+    }
+
+    // 先热身一次，再翻倍找一个能跑满 target_ms 的迭代次数
+    long iters = 1;
+    if (c->run(st, 1) < 0) goto fail;
+    for (;;) {
+        unsigned long long t0 = now_ns();
+        if (c->run(st, iters) < 0) goto fail;
+        double ms = (now_ns() - t0) / 1e6;
+        if (ms >= target_ms / 8 || iters >= (1L << 40)) {
+            if (ms > 0) iters = iters * (target_ms / ms) + 1;
+            break;
+        }
+        iters *= 2;
+    }
+
+    double best = 0, worst = 0;
+    unsigned long a0 = atomic_load(&alloc_count), b0 = atomic_load(&alloc_bytes);
+    for (int r = 0; r < rounds; r++) {
+        unsigned long long t0 = now_ns();
+        long units = c->run(st, iters);
+        unsigned long long ns = now_ns() - t0;
+        if (units <= 0) goto fail;
+        double per = (double)ns / units;
+        if (r == 0 || per < best) best = per;
+        if (r == 0 || per > worst) worst = per;
+    }
+    unsigned long a1 = atomic_load(&alloc_count), b1 = atomic_load(&alloc_bytes);
+
+    if (c->teardown) c->teardown(st);
+
+    res->name = c->name;
+    res->unit = c->unit;
+    res->ns = best;
+    res->spread = best > 0 ? 100.0 * (worst - best) / best : 0;
+    res->allocs = (double)(a1 - a0) / ((double)iters * rounds);
+    res->alloc_bytes = (double)(b1 - b0) / ((double)iters * rounds);
+    res->iters = iters;
+    return 0;
+
+fail:
+    fprintf(stderr, "%s: 运行失败\n", c->name);
+    if (c->teardown) c->teardown(st);
+    return -1;
+}
+
+// --- 基线 ---
+typedef struct {
+    char name[32];
+    double ns;
+} baseline_entry;
+
+static int load_baseline(const char *path, baseline_entry *out, int max) {
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    int n = 0;
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    while (n < max && fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line, "%31s %*s %lf", out[n].name, &out[n].ns) == 2) n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+static const baseline_entry *find_baseline(const baseline_entry *b, int n, const char *name) {
+    for (int i = 0; i < n; i++)
+        if (strcmp(b[i].name, name) == 0) return &b[i];
+    return NULL;
+}
+
+static void print_header(FILE *out) {
+    fprintf(out, "# microbench isa=%s rate=%d\n", synth_isa(), BENCH_RATE);
+    fprintf(out, "# %-14s %-6s %12s %14s %8s %10s %12s %10s\n", "name", "unit", "ns/unit",
+            "units/s", "spread%", "allocs/it", "bytes/it", "iters");
+}
+
+static void print_result(FILE *out, const bench_result *r) {
+    fprintf(out, "%-16s %-6s %12.4f %14.0f %8.1f %10.2f %12.0f %10ld", r->name, r->unit, r->ns,
+            r->ns > 0 ? 1e9 / r->ns : 0.0, r->spread, r->allocs, r->alloc_bytes, r->iters);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "用法: %s [-t 毫秒] [-r 轮数] [-f 名字] [-o 文件] [-c 基线] [-T 百分比] [-l]\n"
+                    "  -t  每轮跑多久 (默认 200 ms)\n"
+                    "  -r  跑几轮取最快 (默认 5)\n"
+                    "  -f  只跑名字里带这个字符串的用例\n"
+                    "  -o  结果另存一份，当以后的基线\n"
+                    "  -c  和基线对比，慢了超过阈值的标出来，返回 1\n"
+                    "  -T  对比的阈值 (默认 10%%)\n"
+                    "  -l  列出所有用例\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    double target_ms = 200;
+    int rounds = 5;
+    const char *filter = NULL;
+    const char *out_path = NULL;
+    const char *base_path = NULL;
+    double threshold = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:r:f:o:c:T:lh")) != -1) {
+        switch (opt) {
+        case 't': target_ms = atof(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 'c': base_path = optarg; break;
+        case 'T': threshold = atof(optarg); break;
+        case 'l':
+            for (int i = 0; i < NCASES; i++) printf("%s\n", cases[i].name);
+            return 0;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (target_ms <= 0) target_ms = 200;
+    if (rounds < 1) rounds = 1;
+
+    baseline_entry base[BENCH_MAX_CASES];
+    int nbase = 0;
+    if (base_path && (nbase = load_baseline(base_path, base, BENCH_MAX_CASES)) < 0) return 1;
+
+    FILE *out = NULL;
+    if (out_path && !(out = fopen(out_path, "w"))) {
+        perror(out_path);
+        return 1;
+    }
+
+    // 临时文件放 /tmp，跑完删掉
+    snprintf(tmp_wav, sizeof(tmp_wav), "/tmp/microbench-%d.wav", (int)getpid());
+    snprintf(tmp_raw, sizeof(tmp_raw), "/tmp/microbench-%d.raw", (int)getpid());
+    snprintf(tmp_lac, sizeof(tmp_lac), "/tmp/microbench-%d.lac", (int)getpid());
+
+    print_header(stdout);
+    if (out) print_header(out);
+    if (nbase > 0) printf("# 对比基线 %s，阈值 %.0f%%：最后两列是基线 ns/unit 和变化\n", base_path, threshold);
+
+    int failed = 0, slower = 0;
+    for (int i = 0; i < NCASES; i++) {
+        bench_result r;
+        if (filter && !strstr(cases[i].name, filter)) continue;
+        if (measure(&cases[i], target_ms, rounds, &r) < 0) {
+            failed++;
+            continue;
+        }
+        print_result(stdout, &r);
+        if (nbase > 0) {
+            const baseline_entry *b = find_baseline(base, nbase, r.name);
+            if (b && b->ns > 0) {
+                double delta = 100.0 * (r.ns - b->ns) / b->ns;
+                const char *verdict = delta > threshold ? "SLOWER" : delta < -threshold ? "faster" : "ok";
+                printf(" %12.4f %+7.1f%% %s", b->ns, delta, verdict);
+                if (delta > threshold) slower++;
+            } else {
+                printf(" %12s %8s new", "-", "-");
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+        if (out) {
+            print_result(out, &r);
+            fprintf(out, "\n");
+        }
+    }
+
+    unlink(tmp_wav);
+    unlink(tmp_raw);
+    unlink(tmp_lac);
+    if (out) fclose(out);
+    if (nbase > 0) printf("# %d 个用例比基线慢了超过 %.0f%%\n", slower, threshold);
+    return failed || slower ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// --- 回声机的效果链：录到的声音放出去之前按顺序过几级处理 ---
+// 启动时从一个字符串建好 (比如 -e "gain:-3,eq:peak:1000:1:6,echo:250:0.4:0.3,limit:-1")，
+// 延迟线之类全在这时分配好，搬运循环里只有 dsp_process，不分配内存。
+// 数据是交错的 float (满刻度 ±1)，原地处理。一帧的几个声道放在一个向量的几条通道里一起算
+// (biquad/限幅器在时间上是递归的，只能横着在声道之间并行)，增益和回声直接按整段连续样本算。
+//   gain:dB                          增益
+//   eq:类型:频率[:Q[:dB]]            一级 biquad，类型 lp / hp / peak / ls / hs，可以串好几级
+//   echo:毫秒[:反馈[:混合]]           反馈回声，延迟线是预先分配好的环
+//   limit[:上限dB[:释放毫秒]]         峰值限幅 (各声道联动，瞬时压下去，慢慢放开)
+// 每一级都记 CPU 时钟数，退出时报告各自吃掉了每个周期预算的百分之几
+#define DSP_MAX_STAGES 16
+#define DSP_MAX_CHANNELS 8
+
+typedef float dsp_v4f __attribute__((vector_size(16)));
+
+typedef enum { DSP_GAIN, DSP_BIQUAD, DSP_ECHO, DSP_LIMIT } dsp_kind;
+
+typedef struct {
+    dsp_kind kind;
+    char name[32];                  // 报告里显示的
+
+    float gain;                     // gain
+    dsp_v4f b0, b1, b2, a1, a2;     // biquad (已经除过 a0，每条通道放一样的值)
+    dsp_v4f z1[DSP_MAX_CHANNELS / 4], z2[DSP_MAX_CHANNELS / 4]; // 转置 II 型的状态，4 个声道一组
+    float *line;                    // echo：交错的延迟线，delay 帧
+    size_t line_len, pos;           // 样本数 (帧数 * 声道数)、读写到哪了
+    float feedback, mix;
+    float ceiling, release, env;    // limit：线性上限、每帧释放系数、当前增益
+
+    unsigned long long cycles;      // 一共花了多少时钟
+    unsigned long long max_cycles;  // 单次调用最多
+} dsp_stage;
+
+typedef struct {
+    int channels;
+    unsigned int rate;
+    int nstages;
+    dsp_stage stages[DSP_MAX_STAGES];
+
+    double clock_hz;                // 计时用的时钟一秒走多少 (启动时校准)
+    unsigned long calls;
+    unsigned long long frames;
+} dsp_chain;
+
+// 解析 spec，分配延迟线。失败打印哪一段不对并返回 -1
+int dsp_chain_init(dsp_chain *c, const char *spec, int channels, unsigned int rate);
+void dsp_chain_free(dsp_chain *c);
+// 清掉所有状态 (延迟线清零、滤波器归零)，xrun 重启时用
+void dsp_chain_reset(dsp_chain *c);
+
+// 原地处理 frames 帧交错 float
+void dsp_process(dsp_chain *c, float *x, size_t frames);
+
+// 一行一级：参数
+void dsp_chain_describe(const dsp_chain *c, FILE *fp);
+// 每一级平均每个周期花多少时钟，占周期时长的百分之几
+void dsp_chain_report(const dsp_chain *c, size_t period, FILE *fp);
+
+#endif
@@ -3,23 +3,13 @@
 #include <math.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "synth.h"
+#include "wav_writer.h"
 
-// --- WAV 文件头结构体 (和你之前的一样) ---
-struct WAV_HEADER {
-    char riff_id[4];      // "RIFF"
-    uint32_t riff_sz;
-    char riff_fmt[4];     // "WAVE"
-    char fmt_id[4];       // "fmt "
-    uint32_t fmt_sz;      // 16
-    uint16_t audio_fmt;   // 1 (PCM)
-    uint16_t num_chn;     // 2
-    uint32_t sample_rate; // 44100
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample; // 16
-    char data_id[4];      // "data"
-    uint32_t data_sz;
-};
+// 一次生成多少帧，写完就复用，内存占用和曲子多长无关
+#define BLOCK_FRAMES 4096
 
 // 频率表 (C4 ~ B4)
 #define C4 261.63
@@ -31,78 +21,71 @@ struct WAV_HEADER {
 #define B4 493.88
 #define C5 523.25
 
-// 生成一个音符的波形数据
-// buffer: 写入的目标
-// freq: 频率 (Hz)
-// duration: 持续时间 (秒)
-// rate: 采样率
-// offset: 当前写到缓冲区的哪里了 (返回新的 offset)
-int generate_tone(short *buffer, double freq, double duration, int rate, int offset) {
-    int total_samples = duration * rate;
-    
-    for (int i = 0; i < total_samples; i++) {
-        double t = (double)i / rate;
-        
-        // 核心：生成正弦波
-        // 振幅设为 10000 (最大32767)，防止太吵
-        short sample_value = (short)(10000 * sin(2.0 * M_PI * freq * t));
-        
-        // 写入立体声 (左声道 = 右声道)
-        buffer[offset + i*2]     = sample_value; // Left
-        buffer[offset + i*2 + 1] = sample_value; // Right
-    }
-    
-    return offset + total_samples * 2; // 返回写完后的新位置
-}
-
-int main() {
-    FILE *fp = fopen("music.wav", "wb");
-    if (!fp) { perror("打开文件失败"); return 1; }
-
+int main(int argc, char *argv[]) {
     int rate = 44100;
     int channels = 2;
-    int bits = 16;
+    sf_format fmt = SF_S16;
     double duration_per_note = 0.5; // 每个音符 0.5 秒
+    int repeat = 1;
+    int async_write = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:a")) != -1) {
+        switch (opt) {
+        case 'x': repeat = atoi(optarg); break;
+        case 'a': async_write = 1; break;
+        default:
+            fprintf(stderr, "用法: %s [-x 重复次数] [-a]\n"
+                            "  -a  用后台线程写盘\n", argv[0]);
+            return 1;
+        }
+    }
+    if (repeat < 1) repeat = 1;
     
     // 我们要生成的旋律：1 1 5 5 6 6 5 (Twinkle Twinkle Little Star)
     double melody[] = { C4, C4, G4, G4, A4, A4, G4, F4, F4, E4, E4, D4, D4, C4 };
     int note_count = sizeof(melody) / sizeof(double);
-    
-    // 计算总数据量
-    int total_samples = note_count * duration_per_note * rate;
-    int data_size = total_samples * channels * (bits / 8);
-
-    // --- 1. 填充 WAV 头 ---
-    struct WAV_HEADER header;
-    memcpy(header.riff_id, "RIFF", 4);
-    header.riff_sz = 36 + data_size;
-    memcpy(header.riff_fmt, "WAVE", 4);
-    memcpy(header.fmt_id, "fmt ", 4);
-    header.fmt_sz = 16;
-    header.audio_fmt = 1;
-    header.num_chn = channels;
-    header.sample_rate = rate;
-    header.byte_rate = rate * channels * (bits / 8);
-    header.block_align = channels * (bits / 8);
-    header.bits_per_sample = bits;
-    memcpy(header.data_id, "data", 4);
-    header.data_sz = data_size;
-
-    fwrite(&header, sizeof(header), 1, fp);
+    long note_samples = duration_per_note * rate;
 
-    // --- 2. 生成 PCM 数据 ---
-    short *pcm_data = (short *)malloc(data_size);
-    int offset = 0;
+    // --- 1. 先写一个占位的头，写完再补大小 (超过 4GB 自动变成 RF64) ---
+    wav_writer wav;
+    if (wav_writer_open(&wav, "music.wav", rate, channels, fmt) < 0) return 1;
+    if (async_write && wav_writer_start_async(&wav, 4 * 1024 * 1024) < 0) {
+        fprintf(stderr, "无法启动写盘线程\n");
+        return 1;
+    }
 
-    for (int i = 0; i < note_count; i++) {
-        offset = generate_tone(pcm_data, melody[i], duration_per_note, rate, offset);
+    // --- 2. 一块一块生成 PCM 数据，生成一块写一块 ---
+    short *pcm_data = (short *)malloc(BLOCK_FRAMES * channels * sizeof(short));
+    if (!pcm_data) {
+        fprintf(stderr, "内存不足\n");
+        wav_writer_close(&wav);
+        return 1;
     }
+    int ok = 1;
 
-    fwrite(pcm_data, 1, data_size, fp);
+    for (int r = 0; r < repeat && ok; r++) {
+        for (int i = 0; i < note_count && ok; i++) {
+            for (long pos = 0; pos < note_samples; pos += BLOCK_FRAMES) {
+                int n = note_samples - pos < BLOCK_FRAMES ? note_samples - pos : BLOCK_FRAMES;
+                generate_tone(pcm_data, melody[i], rate, pos, n);
+                if (wav_writer_write(&wav, pcm_data, n * channels * sf_bytes(fmt)) < 0) {
+                    ok = 0;
+                    break;
+                }
+            }
+        }
+    }
 
     // --- 3. 清理 ---
+    if (wav_writer_close(&wav) < 0) ok = 0;
     free(pcm_data);
-    fclose(fp);
+    if (!ok) return 1;
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
     printf("生成完毕！文件名为 music.wav\n");
+    printf("%.1f 秒音频, 峰值内存 %ld KB\n",
+           (double)repeat * note_count * note_samples / rate, ru.ru_maxrss);
     return 0;
 }
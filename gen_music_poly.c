@@ -3,23 +3,14 @@
 #include <math.h>
 #include <stdint.h>
 #include <string.h>
-
-// --- WAV 文件头结构体 ---
-struct WAV_HEADER {
-    char riff_id[4];      // "RIFF"
-    uint32_t riff_sz;
-    char riff_fmt[4];     // "WAVE"
-    char fmt_id[4];       // "fmt "
-    uint32_t fmt_sz;      // 16
-    uint16_t audio_fmt;   // 1 (PCM)
-    uint16_t num_chn;     // 2
-    uint32_t sample_rate; // 44100
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample; // 16
-    char data_id[4];      // "data"
-    uint32_t data_sz;
-};
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "synth.h"
+#include "score.h"
+#include "voice.h"
+#include "wav_writer.h"
 
 // 频率表 (基础音)
 #define C4 261.63
@@ -40,87 +31,279 @@ struct WAV_HEADER {
 #define A3 220.00
 #define B3 246.94
 
-// --- ADSR 参数 (单位：秒) ---
-// Attack(起音): 0.05s 瞬间达到最大音量
-// Decay(衰减): 0.1s  稍微回落
-// Sustain(延音): 0.8   保持在 80% 音量
-// Release(释音): 0.2s  松手后声音慢慢消失
+// 并行渲染时一个时间块多少帧 (SYNTH_BLOCK 的整数倍)
+#define RENDER_BLOCK 16384
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// --- 基准测试：老的标量版 vs 向量化内核 ---
+// 报告每秒能生成多少个采样 (立体声一帧算一个)，以及和老版本的最大误差
+static int run_bench(const double *melody, const double *harmony, int note_count) {
+    int rate = 44100;
+    double duration = 0.5;
+    int repeat = 40;
+    int per_note = duration * rate;
+    long samples = (long)per_note * note_count * repeat;
+    short *ref = (short *)malloc(samples * 2 * sizeof(short));
+    short *out = (short *)malloc(samples * 2 * sizeof(short));
+    if (!ref || !out) {
+        fprintf(stderr, "内存不足\n");
+        free(ref); free(out);
+        return -1;
+    }
+
+    double t0 = now_sec();
+    int offset = 0;
+    for (int r = 0; r < repeat; r++)
+        for (int i = 0; i < note_count; i++)
+            offset = generate_poly_tone(ref, melody[i], harmony[i], duration, rate, offset);
+    double ref_sec = now_sec() - t0;
+    printf("%-10s %12.0f samples/s\n", "reference", samples / ref_sec);
+
+    const char *paths[] = { "scalar", "sse2", "avx2" };
+    for (int pass = 0; pass < 3; pass++) {
+        if (synth_set_isa(paths[pass]) < 0) continue; // CPU 不支持就跳过
+        t0 = now_sec();
+        offset = 0;
+        for (int r = 0; r < repeat; r++)
+            for (int i = 0; i < note_count; i++)
+                offset = generate_poly_tone_fast(out, melody[i], harmony[i], duration, rate, offset);
+        double sec = now_sec() - t0;
+
+        int max_err = 0;
+        long diff = 0;
+        for (long i = 0; i < samples * 2; i++) {
+            int e = abs(out[i] - ref[i]);
+            if (e > max_err) max_err = e;
+            if (e) diff++;
+        }
+        printf("%-10s %12.0f samples/s  %5.1fx  最大误差 %d LSB, %.3f%% 的采样不同\n",
+               synth_isa(), samples / sec, ref_sec / sec, max_err, 100.0 * diff / (samples * 2));
+    }
+    synth_set_isa(NULL);
+
+    free(ref);
+    free(out);
+    return 0;
+}
+
+// --- 旋律游标：按需往乐谱里添音符 ---
+// 流式渲染时只把快要用到的音符加进去，乐谱里始终只有正在响的那几个
 typedef struct {
-    double attack;
-    double decay;
-    double sustain_level;
-    double release;
-} ADSR;
-
-// ADSR 计算函数：根据当前时间 t 返回一个 0.0 ~ 1.0 的音量系数
-double get_adsr_volume(double t, double total_duration, ADSR env) {
-    double volume = 0.0;
-    double sustain_time = total_duration - env.attack - env.decay - env.release;
-    
-    // 防止音符太短导致时间计算出错
-    if (sustain_time < 0) sustain_time = 0;
-
-    if (t < env.attack) {
-        // Attack 阶段: 0 -> 1
-        volume = t / env.attack;
-    } else if (t < env.attack + env.decay) {
-        // Decay 阶段: 1 -> Sustain
-        double progress = (t - env.attack) / env.decay;
-        volume = 1.0 - progress * (1.0 - env.sustain_level);
-    } else if (t < total_duration - env.release) {
-        // Sustain 阶段: 保持 Sustain Level
-        volume = env.sustain_level;
-    } else {
-        // Release 阶段: Sustain -> 0
-        double release_start_time = total_duration - env.release;
-        double progress = (t - release_start_time) / env.release;
-        volume = env.sustain_level * (1.0 - progress);
+    const double *melody;
+    const double *harmony;
+    int note_count;
+    int repeat;         // 整段旋律重复几遍
+    double duration;
+    int r, i;           // 下一个音符是第 r 遍的第 i 个
+    long next_start;
+} melody_cursor;
+
+// 把开始时间早于 until 的音符都加进乐谱
+static void feed_notes(score *sc, melody_cursor *mc, long until) {
+    ADSR env = {0.05, 0.1, 0.7, 0.15}; // 和 generate_poly_tone 用的一样
+    long per_note = mc->duration * sc->rate;
+    while (mc->r < mc->repeat && mc->next_start < until) {
+        score_add(sc, mc->next_start, mc->duration,
+                  mc->melody[mc->i], 8000.0, mc->harmony[mc->i], 6000.0, env);
+        mc->next_start += per_note;
+        if (++mc->i == mc->note_count) {
+            mc->i = 0;
+            mc->r++;
+        }
     }
-    
-    return (volume > 0) ? volume : 0;
 }
 
-// 生成并混合音符
-// buffer: 写入目标
-// freq1: 主旋律频率
-// freq2: 和声频率
-// duration: 持续时间
-// rate: 采样率
-// offset: 写入位置
-int generate_poly_tone(short *buffer, double freq1, double freq2, double duration, int rate, int offset) {
-    int total_samples = duration * rate;
-    ADSR env = {0.05, 0.1, 0.7, 0.15}; // 定义一个舒服的包络
-
-    for (int i = 0; i < total_samples; i++) {
-        double t = (double)i / rate;
-        
-        // 1. 计算 ADSR 音量 (让声音有动态)
-        double vol_factor = get_adsr_volume(t, duration, env);
-
-        // 2. 生成两个波形 (主旋律 + 和声)
-        // 振幅设为 8000，两个加起来 16000，不会爆音 (最大32767)
-        double wave1 = 8000.0 * sin(2.0 * M_PI * freq1 * t); // 主旋律
-        double wave2 = 6000.0 * sin(2.0 * M_PI * freq2 * t); // 和声 (稍微小声点)
-
-        // 3. 混音 (直接相加) 并应用 ADSR
-        short mixed_sample = (short)((wave1 + wave2) * vol_factor);
-        
-        // 写入立体声
-        buffer[offset + i*2]     = mixed_sample; 
-        buffer[offset + i*2 + 1] = mixed_sample; 
+// --- 并行扩展性测试：1, 2, 4 ... 个线程各渲染一遍，比较耗时，并确认输出一字不差 ---
+static void run_scaling(const score *sc, int max_threads) {
+    size_t bytes = (size_t)sc->total_samples * 2 * sizeof(short);
+    short *ref = (short *)malloc(bytes);
+    short *out = (short *)malloc(bytes);
+    // 先把页都摸一遍，别让第一轮白白吃缺页的时间
+    memset(ref, 0, bytes);
+    memset(out, 0, bytes);
+
+    double t1 = score_render_parallel(sc, ref, 0, sc->total_samples, 1, RENDER_BLOCK);
+    printf("%2d 线程: %7.3f s  %12.0f samples/s\n", 1, t1, sc->total_samples / t1);
+
+    for (int t = 2; t <= max_threads; t *= 2) {
+        double tt = score_render_parallel(sc, out, 0, sc->total_samples, t, RENDER_BLOCK);
+        printf("%2d 线程: %7.3f s  %12.0f samples/s  加速 %.2fx  %s\n", t, tt,
+               sc->total_samples / tt, t1 / tt,
+               memcmp(ref, out, bytes) == 0 ? "输出一致" : "输出不一致!");
     }
-    
-    return offset + total_samples * 2;
+    free(ref);
+    free(out);
+}
+
+// --- 复音引擎渲染：每个音符发 note_on / note_off，释音尾巴可以拖进下一个音 ---
+// 主旋律和和声各是一个独立的音符，声部池满了会自动偷声部
+static int render_voices(wav_writer *wav, const melody_cursor *mc, int rate, int max_voices) {
+    ADSR env = {0.05, 0.1, 0.7, 0.15};
+    long per_note = mc->duration * rate;
+    long notes = (long)mc->repeat * mc->note_count;
+    long total_samples = notes * per_note;
+    int chunk = RENDER_BLOCK;
+    // 一块最多碰到 chunk/per_note + 2 个音符，每个音符两个声部、一开一关
+    int max_ev = 4 * (chunk / per_note + 2);
+    voice_event *ev = (voice_event *)malloc(sizeof(voice_event) * max_ev);
+    float *mono = (float *)malloc(sizeof(float) * chunk);
+    short *pcm = (short *)malloc(sizeof(short) * 2 * chunk);
+    voice_pool vp;
+    int rc = 0;
+
+    if (!ev || !mono || !pcm || voice_pool_init(&vp, max_voices, rate) < 0) {
+        fprintf(stderr, "内存不足\n");
+        free(ev); free(mono); free(pcm);
+        return -1;
+    }
+
+    double t0 = now_sec();
+    for (long pos = 0; pos < total_samples; pos += chunk) {
+        int n = total_samples - pos < chunk ? total_samples - pos : chunk;
+        int nev = 0;
+
+        // 这一块里开始或结束的音符 (音符 k 占 [k*per_note, (k+1)*per_note))
+        // 关在前、开在后，同一个采样上先松开上一个音再按下一个
+        long k_lo = pos / per_note - 1;
+        long k_hi = (pos + n) / per_note;
+        if (k_lo < 0) k_lo = 0;
+        for (long k = k_lo; k <= k_hi && k < notes; k++) {
+            long end = (k + 1) * per_note;
+            if (end >= pos && end < pos + n) {
+                for (int v = 0; v < 2; v++)
+                    ev[nev++] = (voice_event){ end - pos, 0, k * 2 + v, 0, 0, env };
+            }
+        }
+        for (long k = k_lo; k <= k_hi && k < notes; k++) {
+            long start = k * per_note;
+            int i = k % mc->note_count;
+            if (start >= pos && start < pos + n) {
+                ev[nev++] = (voice_event){ start - pos, 1, k * 2, mc->melody[i], 8000.0f, env };
+                ev[nev++] = (voice_event){ start - pos, 1, k * 2 + 1, mc->harmony[i], 6000.0f, env };
+            }
+        }
+        // 按 at 排一下 (事件很少，插入排序就够了；稳定排序保证同一时刻关在开前面)
+        for (int a = 1; a < nev; a++) {
+            voice_event e = ev[a];
+            int b = a - 1;
+            for (; b >= 0 && ev[b].at > e.at; b--) ev[b + 1] = ev[b];
+            ev[b + 1] = e;
+        }
+
+        voice_pool_run(&vp, mono, n, ev, nev);
+        synth_store_stereo_s16(pcm, mono, n);
+        if (wav_writer_write(wav, pcm, n * 2 * sizeof(short)) < 0) {
+            rc = -1;
+            break;
+        }
+    }
+    printf("复音引擎: %d 个声部, 最多同时 %d 个, 偷了 %ld 次, 渲染 %.3f 秒 (%s)\n",
+           max_voices, vp.peak_active, vp.stolen, now_sec() - t0, synth_isa());
+
+    voice_pool_free(&vp);
+    free(ev);
+    free(mono);
+    free(pcm);
+    return rc;
+}
+
+// 让 n 个声部一直按着，渲染 seconds 秒音频，返回实际耗时 (秒)
+static double time_voices(int n, int rate, double seconds) {
+    ADSR env = {0.01, 0.05, 0.8, 0.1}; // 很快进入 sustain，之后一直保持
+    voice_pool vp;
+    float block[SYNTH_BLOCK];
+    long total = seconds * rate;
+
+    if (voice_pool_init(&vp, n, rate) < 0) return -1;
+    for (int v = 0; v < n; v++)
+        voice_note_on(&vp, v, 110.0 * pow(2.0, (v % 48) / 12.0), 100.0f, env);
+
+    double t0 = now_sec();
+    for (long pos = 0; pos < total; pos += SYNTH_BLOCK)
+        voice_pool_run(&vp, block, SYNTH_BLOCK, NULL, 0);
+    double sec = now_sec() - t0;
+
+    voice_pool_free(&vp);
+    return sec;
 }
 
-int main() {
-    FILE *fp = fopen("music_poly.wav", "wb");
-    if (!fp) { perror("打开文件失败"); return 1; }
+// --- 最大复音数测试：单核实时 (渲染 1 秒音频用时不超过 1 秒) 最多能同时响多少个声部 ---
+// 先翻倍找到上限，再按 VOICE_LANES 为步长二分
+static void run_voice_bench(void) {
+    const int rates[] = { 44100, 48000 };
+    const double seconds = 0.5;
 
+    printf("路径: %s, 每组 %d 个声部\n", synth_isa(), VOICE_LANES);
+    for (int r = 0; r < 2; r++) {
+        int rate = rates[r];
+        int lo = 0, hi = 0;
+
+        for (int n = VOICE_LANES; n <= (1 << 17); n *= 2) {
+            double sec = time_voices(n, rate, seconds);
+            printf("  %5d Hz %6d 声部: 负载 %6.1f%%  %.3f ns/声部/采样\n",
+                   rate, n, 100.0 * sec / seconds, sec * 1e9 / (n * seconds * rate));
+            if (sec < seconds) lo = n;
+            else {
+                hi = n;
+                break;
+            }
+        }
+        if (hi == 0) {
+            printf("%d Hz: 单核实时至少 %d 个声部 (测试上限)\n", rate, lo);
+            continue;
+        }
+        while (hi - lo > VOICE_LANES) {
+            int mid = (lo + hi) / 2 / VOICE_LANES * VOICE_LANES;
+            if (time_voices(mid, rate, seconds) < seconds) lo = mid;
+            else hi = mid;
+        }
+        printf("%d Hz: 单核实时最多 %d 个声部\n", rate, lo);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "用法: %s [-j 线程数] [-x 重复次数] [-v 声部数] [-a] [-b] [-P] [-V]\n"
+                    "  -v  用复音引擎渲染 (声部池大小)\n"
+                    "  -a  用后台线程写盘\n"
+                    "  -b  振荡器/包络内核基准测试\n"
+                    "  -P  多线程扩展性测试\n"
+                    "  -V  单核最大复音数测试\n", prog);
+}
+
+int main(int argc, char *argv[]) {
     int rate = 44100;
     int channels = 2;
-    int bits = 16;
+    sf_format fmt = SF_S16;
     double duration = 0.5; 
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int repeat = 1;
+    int mode = 0;
+    int async_write = 0;
+    int max_voices = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:x:v:abPVh")) != -1) {
+        switch (opt) {
+        case 'j': threads = atoi(optarg); break;
+        case 'x': repeat = atoi(optarg); break;
+        case 'v': max_voices = atoi(optarg); break;
+        case 'a': async_write = 1; break;
+        case 'b':
+        case 'P':
+        case 'V': mode = opt; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    // 线程比核多太多没用，只会白开一堆栈
+    long max_threads = sysconf(_SC_NPROCESSORS_ONLN) * 4;
+    if (threads < 1) threads = 1;
+    if (max_threads > 0 && threads > max_threads) threads = max_threads;
+    if (repeat < 1) repeat = 1;
     
     // 主旋律: 1 1 5 5 6 6 5
     double melody[] = { C4, C4, G4, G4, A4, A4, G4, F4, F4, E4, E4, D4, D4, C4 };
@@ -128,39 +311,72 @@ int main() {
     double harmony[] = { C3, E3, E3, G3, F3, A3, E3, D3, A3, G3, G3, F3, F3, E3 };
 
     int note_count = sizeof(melody) / sizeof(double);
-    int total_samples = note_count * duration * rate;
-    int data_size = total_samples * channels * (bits / 8);
-
-    // --- 填充 WAV 头 (还是老样子) ---
-    struct WAV_HEADER header;
-    memcpy(header.riff_id, "RIFF", 4);
-    header.riff_sz = 36 + data_size;
-    memcpy(header.riff_fmt, "WAVE", 4);
-    memcpy(header.fmt_id, "fmt ", 4);
-    header.fmt_sz = 16;
-    header.audio_fmt = 1;
-    header.num_chn = channels;
-    header.sample_rate = rate;
-    header.byte_rate = rate * channels * (bits / 8);
-    header.block_align = channels * (bits / 8);
-    header.bits_per_sample = bits;
-    memcpy(header.data_id, "data", 4);
-    header.data_sz = data_size;
-
-    fwrite(&header, sizeof(header), 1, fp);
-
-    // --- 生成 PCM 数据 ---
-    short *pcm_data = (short *)malloc(data_size);
-    int offset = 0;
 
-    for (int i = 0; i < note_count; i++) {
-        // 同时把主旋律和和声传进去
-        offset = generate_poly_tone(pcm_data, melody[i], harmony[i], duration, rate, offset);
+    if (mode == 'b') {
+        return run_bench(melody, harmony, note_count) < 0;
     }
+    if (mode == 'V') {
+        run_voice_bench();
+        return 0;
+    }
+
+    score sc;
+    melody_cursor mc = { melody, harmony, note_count, repeat, duration, 0, 0, 0 };
+    score_init(&sc, rate);
+
+    if (mode == 'P') {
+        feed_notes(&sc, &mc, LONG_MAX);
+        run_scaling(&sc, threads);
+        score_free(&sc);
+        return 0;
+    }
+
+    // 文件头先占位，写完再补大小 (超过 4GB 自动变成 RF64)
+    wav_writer wav;
+    if (wav_writer_open(&wav, "music_poly.wav", rate, channels, fmt) < 0) return 1;
+    if (async_write && wav_writer_start_async(&wav, 4 * 1024 * 1024) < 0) {
+        fprintf(stderr, "无法启动写盘线程\n");
+        return 1;
+    }
+
+    if (max_voices > 0) {
+        int rc = render_voices(&wav, &mc, rate, max_voices);
+        if (wav_writer_close(&wav) < 0 || rc < 0) return 1;
+        printf("生成完毕！文件名为 music_poly.wav\n");
+        return 0;
+    }
+
+    // --- 流式生成：渲染一大块、写一大块，内存占用和曲子长短无关 ---
+    // 一块的大小是 RENDER_BLOCK 的整数倍，所以切块方式和线程数无关，输出一致
+    long total_samples = (long)repeat * note_count * (long)(duration * rate);
+    long chunk = (long)threads * 2 * RENDER_BLOCK;
+    short *pcm_data = (short *)malloc(chunk * channels * sizeof(short));
+    double render_sec = 0;
+    if (!pcm_data) {
+        fprintf(stderr, "内存不足\n");
+        wav_writer_close(&wav);
+        score_free(&sc);
+        return 1;
+    }
+
+    for (long pos = 0; pos < total_samples; pos += chunk) {
+        long n = total_samples - pos < chunk ? total_samples - pos : chunk;
 
-    fwrite(pcm_data, 1, data_size, fp);
+        feed_notes(&sc, &mc, pos + n);
+        render_sec += score_render_parallel(&sc, pcm_data, pos, n, threads, RENDER_BLOCK);
+        if (wav_writer_write(&wav, pcm_data, n * channels * sf_bytes(fmt)) < 0) break;
+        score_drop_before(&sc, pos + n);
+    }
+
+    int rc = wav_writer_close(&wav);
     free(pcm_data);
-    fclose(fp);
+    score_free(&sc);
+    if (rc < 0) return 1;
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
     printf("生成完毕！文件名为 music_poly.wav\n");
+    printf("%.1f 秒音频, %d 线程, 渲染 %.3f 秒, 峰值内存 %ld KB\n",
+           (double)total_samples / rate, threads, render_sec, ru.ru_maxrss);
     return 0;
 }
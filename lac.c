@@ -0,0 +1,782 @@
+#define _GNU_SOURCE // memmem
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lac.h"
+
+#define LAC_VERSION 2            // 2：CRC 也覆盖块头里的长度/帧数/立体声方式
+#define LAC_QBITS 15            // 量化后的 LPC 系数 (带符号) 多少位
+#define LAC_MAX_PORDER 8        // 残差最多分 2^8 段
+#define LAC_MIN_PARTITION 32    // 每段至少这么多个残差，不然每段 5 位的参数不划算
+#define LAC_ESCAPE 31           // Rice 参数是这个值：这一段不用 Rice，按固定位宽原样存
+
+enum { SUB_CONSTANT = 0, SUB_VERBATIM = 1, SUB_LPC = 2 };
+enum { STEREO_LR = 0, STEREO_LS = 1, STEREO_SR = 2, STEREO_MS = 3 };
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// --- 小端读写 ---
+static void wr16(unsigned char *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void wr32(unsigned char *p, uint32_t v) { wr16(p, v); wr16(p + 2, v >> 16); }
+static void wr64(unsigned char *p, uint64_t v) { wr32(p, v); wr32(p + 4, v >> 32); }
+static uint16_t rd16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+static uint32_t rd32(const unsigned char *p) { return rd16(p) | ((uint32_t)rd16(p + 2) << 16); }
+static uint64_t rd64(const unsigned char *p) { return rd32(p) | ((uint64_t)rd32(p + 4) << 32); }
+
+// --- CRC32 (和 zlib 一样的多项式)，表第一次用的时候建 ---
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t c, const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) c = crc_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c;
+}
+
+// 一块的 CRC：块头里 "LACB" 和 CRC 本身之间的字段 (数据字节数、帧数、立体声方式)，再加上数据
+static uint32_t block_crc(const unsigned char *hdr, size_t bytes) {
+    uint32_t c = crc32_update(0xFFFFFFFFu, hdr + 4, 8);
+    c = crc32_update(c, hdr + LAC_BLOCK_HEADER_BYTES, bytes);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// --- 按位写：高位在前，攒够一个字节就吐出去 ---
+typedef struct {
+    unsigned char *p;
+    size_t pos;
+    uint64_t acc;
+    int n;                  // acc 低 n 位还没吐
+} bitw;
+
+static void bw_put(bitw *b, uint32_t v, int bits) {
+    if (bits == 0) return;
+    b->acc = (b->acc << bits) | (v & ((1ull << bits) - 1));
+    b->n += bits;
+    while (b->n >= 8) {
+        b->n -= 8;
+        b->p[b->pos++] = b->acc >> b->n;
+    }
+}
+
+// q 个 0 再一个 1
+static void bw_unary(bitw *b, uint32_t q) {
+    while (q >= 32) {
+        bw_put(b, 0, 32);
+        q -= 32;
+    }
+    bw_put(b, 1, q + 1);
+}
+
+static void bw_flush(bitw *b) {
+    if (b->n > 0) bw_put(b, 0, 8 - b->n);
+}
+
+static size_t bw_bits(const bitw *b) {
+    return b->pos * 8 + b->n;
+}
+
+// --- 按位读 ---
+typedef struct {
+    const unsigned char *p, *end;
+    uint64_t acc;
+    int n;
+    int err;                // 读过头了
+} bitr;
+
+static void br_refill(bitr *b) {
+    while (b->n <= 48 && b->p < b->end) {
+        b->acc = (b->acc << 8) | *b->p++;
+        b->n += 8;
+    }
+}
+
+static uint32_t br_get(bitr *b, int bits) {
+    if (bits == 0) return 0;
+    if (b->n < bits) {
+        br_refill(b);
+        if (b->n < bits) {
+            b->err = 1;
+            return 0;
+        }
+    }
+    b->n -= bits;
+    return (b->acc >> b->n) & ((1ull << bits) - 1);
+}
+
+static int32_t br_sget(bitr *b, int bits) {
+    uint32_t v = br_get(b, bits);
+    if (bits == 0 || bits >= 32) return (int32_t)v;
+    return (int32_t)(v << (32 - bits)) >> (32 - bits);
+}
+
+// 数前面有几个 0，连同后面那个 1 一起吃掉
+static uint32_t br_unary(bitr *b) {
+    uint32_t q = 0;
+    for (;;) {
+        if (b->n == 0) {
+            br_refill(b);
+            if (b->n == 0) {
+                b->err = 1;
+                return 0;
+            }
+        }
+        uint64_t left = b->acc & ((1ull << b->n) - 1);
+        if (left == 0) {
+            q += b->n;
+            b->n = 0;
+            continue;
+        }
+        int top = 63 - __builtin_clzll(left);
+        q += b->n - 1 - top;
+        b->n = top;
+        return q;
+    }
+}
+
+// 有符号 <-> 非负：0 -1 1 -2 2 ... -> 0 1 2 3 4 ...
+static inline uint32_t zigzag(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u) {
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+// --- 编码：残差的 Rice 码 ---
+// 每一段挑 k：2^k 差不多是平均值的时候最省。代价按 "count*(k+1) + sum>>k" 估，
+// 比逐个算 u>>k 快，差得很少
+static unsigned rice_cost(uint64_t sum, size_t count, int *k_out) {
+    int k = 0;
+    if (count && sum > count) {
+        uint64_t mean = sum / count;
+        k = 63 - __builtin_clzll(mean);
+    }
+    uint64_t best = UINT64_MAX;
+    for (int t = k > 0 ? k - 1 : 0; t <= k + 1 && t < LAC_ESCAPE; t++) {
+        uint64_t c = count * (uint64_t)(t + 1) + (sum >> t);
+        if (c < best) {
+            best = c;
+            *k_out = t;
+        }
+    }
+    return best > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned)best;
+}
+
+// 有符号数要多少位才放得下
+static int signed_width(int32_t lo, int32_t hi) {
+    int w = 0;
+    if (lo == 0 && hi == 0) return 0;
+    while (w < 32 && ((int64_t)hi >= (1ll << w) || (int64_t)lo < -(1ll << w))) w++;
+    return w + 1 > 32 ? 32 : w + 1;
+}
+
+// 第 i 段从哪开始、多长 (最后一段可能短)；编码和解码用同一套算法
+static void partition_range(size_t m, int porder, int i, size_t *start, size_t *count) {
+    size_t parts = (size_t)1 << porder;
+    size_t size = (m + parts - 1) / parts;
+    *start = i * size;
+    if (*start > m) *start = m;
+    size_t end = *start + size > m ? m : *start + size;
+    *count = end - *start;
+}
+
+static void encode_residual(bitw *b, const int32_t *res, size_t m) {
+    int porder = 0;
+    while (porder < LAC_MAX_PORDER && (m >> (porder + 1)) >= LAC_MIN_PARTITION) porder++;
+
+    // 每种分段都估一遍，挑最省的
+    int best_p = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for (int p = 0; p <= porder; p++) {
+        uint64_t cost = 4;
+        for (int i = 0; i < (1 << p); i++) {
+            size_t start, count;
+            uint64_t sum = 0;
+            int k;
+            partition_range(m, p, i, &start, &count);
+            for (size_t j = 0; j < count; j++) sum += zigzag(res[start + j]);
+            cost += 5 + rice_cost(sum, count, &k);
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_p = p;
+        }
+    }
+
+    bw_put(b, best_p, 4);
+    for (int i = 0; i < (1 << best_p); i++) {
+        size_t start, count;
+        uint64_t sum = 0;
+        int32_t lo = 0, hi = 0;
+        int k;
+        partition_range(m, best_p, i, &start, &count);
+        for (size_t j = 0; j < count; j++) {
+            int32_t r = res[start + j];
+            sum += zigzag(r);
+            if (r < lo) lo = r;
+            if (r > hi) hi = r;
+        }
+        unsigned cost = rice_cost(sum, count, &k);
+        int width = signed_width(lo, hi);
+        if ((uint64_t)count * width + 6 < cost) {
+            // 偶尔几个特别大的残差：固定位宽反而省
+            bw_put(b, LAC_ESCAPE, 5);
+            bw_put(b, width, 6);
+            for (size_t j = 0; j < count; j++) bw_put(b, (uint32_t)res[start + j], width);
+        } else {
+            bw_put(b, k, 5);
+            for (size_t j = 0; j < count; j++) {
+                uint32_t u = zigzag(res[start + j]);
+                bw_unary(b, u >> k);
+                bw_put(b, u, k);
+            }
+        }
+    }
+}
+
+// --- 编码：LPC ---
+// 加窗 (Welch) 算自相关，Levinson-Durbin 一次把 1..max_order 阶的系数和预测误差都算出来
+static int lpc_analyze(const int32_t *x, size_t n, int max_order, double coef[][LAC_MAX_ORDER], double *err) {
+    double w[LAC_BLOCK_FRAMES];
+    double r[LAC_MAX_ORDER + 1];
+    double half = (n - 1) / 2.0;
+
+    for (size_t i = 0; i < n; i++) {
+        double t = (i - half) / (half + 1);
+        w[i] = x[i] * (1 - t * t);
+    }
+    for (int k = 0; k <= max_order; k++) {
+        double s = 0;
+        for (size_t i = k; i < n; i++) s += w[i] * w[i - k];
+        r[k] = s;
+    }
+    if (r[0] <= 0) return 0;
+
+    double a[LAC_MAX_ORDER + 1] = {0}, tmp[LAC_MAX_ORDER + 1];
+    double e = r[0] * (1 + 1e-9); // 一点点白噪声，数值更稳
+    int order = 0;
+    for (int i = 1; i <= max_order; i++) {
+        double acc = r[i];
+        for (int j = 1; j < i; j++) acc -= a[j] * r[i - j];
+        double k = acc / e;
+        if (k >= 1 || k <= -1) break;
+        memcpy(tmp, a, sizeof(a));
+        a[i] = k;
+        for (int j = 1; j < i; j++) a[j] = tmp[j] - k * tmp[i - j];
+        e *= 1 - k * k;
+        for (int j = 0; j < i; j++) coef[i - 1][j] = a[j + 1];
+        err[i - 1] = e / r[0];      // 剩下的能量占原来的比例
+        order = i;
+        if (e <= 0) break;
+    }
+    return order;
+}
+
+// 系数量化成 LAC_QBITS 位整数，乘 2^shift；舍入误差往下一个系数上带
+static int lpc_quantize(const double *c, int order, int32_t *q, int *shift_out) {
+    double cmax = 0;
+    int e;
+    for (int j = 0; j < order; j++)
+        if (fabs(c[j]) > cmax) cmax = fabs(c[j]);
+    if (cmax <= 0) return -1;
+    frexp(cmax, &e);
+    int shift = LAC_QBITS - 1 - e;
+    if (shift > 31) shift = 31;
+    if (shift < 0) return -1;
+
+    const int32_t qmax = (1 << (LAC_QBITS - 1)) - 1, qmin = -(1 << (LAC_QBITS - 1));
+    double carry = 0;
+    for (int j = 0; j < order; j++) {
+        double v = c[j] * (double)(1u << shift) + carry;
+        long r = lround(v);
+        if (r > qmax) r = qmax;
+        if (r < qmin) r = qmin;
+        q[j] = r;
+        carry = v - r;
+    }
+    *shift_out = shift;
+    return 0;
+}
+
+// 残差超出 32 位 (32 位的极端信号) 返回 -1
+static int lpc_residual(const int32_t *x, size_t n, const int32_t *q, int order, int shift, int32_t *res) {
+    for (size_t t = order; t < n; t++) {
+        int64_t pred = 0;
+        for (int j = 0; j < order; j++) pred += (int64_t)q[j] * x[t - 1 - j];
+        int64_t r = x[t] - (pred >> shift);
+        if (r > INT32_MAX || r < INT32_MIN) return -1;
+        res[t - order] = r;
+    }
+    return 0;
+}
+
+// 一个声道的子帧：常数 / LPC / 原样，挑最短的
+static int encode_subframe(bitw *b, const int32_t *x, size_t n, int sbits, int max_order, int32_t *res) {
+    size_t i;
+    for (i = 1; i < n && x[i] == x[0]; i++) {}
+    if (i == n) {
+        bw_put(b, SUB_CONSTANT, 2);
+        bw_put(b, (uint32_t)x[0], sbits);
+        return SUB_CONSTANT;
+    }
+
+    bitw start = *b;
+    size_t verbatim_bits = 2 + n * sbits;
+    if (max_order > (int)n / 4) max_order = n / 4;
+    if (max_order >= 1) {
+        double coef[LAC_MAX_ORDER][LAC_MAX_ORDER], err[LAC_MAX_ORDER];
+        int got = lpc_analyze(x, n, max_order, coef, err);
+
+        // 按估计的码长挑阶数：残差每个样本 ~ log2(标准差) + 1 位，每多一阶多存一个系数和一个原值
+        double energy = 0;
+        for (i = 0; i < n; i++) energy += (double)x[i] * x[i];
+        double var = energy / n;
+        int order = 0;
+        double best = verbatim_bits;
+        for (int o = 1; o <= got; o++) {
+            double v = var * err[o - 1];
+            double bps = v > 1 ? 0.5 * log2(v) + 1 : 1;
+            double bits = (n - o) * bps + o * (LAC_QBITS + sbits) + 20;
+            if (bits < best) {
+                best = bits;
+                order = o;
+            }
+        }
+
+        int32_t q[LAC_MAX_ORDER];
+        int shift;
+        if (order > 0 && lpc_quantize(coef[order - 1], order, q, &shift) == 0 &&
+            lpc_residual(x, n, q, order, shift, res) == 0) {
+            bw_put(b, SUB_LPC, 2);
+            bw_put(b, order - 1, 5);
+            bw_put(b, LAC_QBITS - 1, 4);
+            bw_put(b, shift, 5);
+            for (int j = 0; j < order; j++) bw_put(b, (uint32_t)q[j], LAC_QBITS);
+            for (int j = 0; j < order; j++) bw_put(b, (uint32_t)x[j], sbits);
+            encode_residual(b, res, n - order);
+            if (bw_bits(b) - bw_bits(&start) < verbatim_bits) return SUB_LPC;
+            *b = start; // 还不如原样存，退回去
+        }
+    }
+
+    bw_put(b, SUB_VERBATIM, 2);
+    for (i = 0; i < n; i++) bw_put(b, (uint32_t)x[i], sbits);
+    return SUB_VERBATIM;
+}
+
+// 二阶差分的绝对值和，粗估一个声道好不好压
+static uint64_t roughness(const int32_t *x, size_t n) {
+    uint64_t s = 0;
+    for (size_t i = 2; i < n; i++) {
+        int64_t d = (int64_t)x[i] - 2 * (int64_t)x[i - 1] + x[i - 2];
+        s += d < 0 ? -d : d;
+    }
+    return s;
+}
+
+// --- 编码：一块 ---
+static int write_all(int fd, const void *p, size_t n) {
+    const char *c = (const char *)p;
+    while (n > 0) {
+        ssize_t r = write(fd, c, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            perror("lac write");
+            return -1;
+        }
+        c += r;
+        n -= r;
+    }
+    return 0;
+}
+
+static int encode_block(lac_writer *w) {
+    size_t n = w->have;
+    int bits = sf_bits(w->fmt);
+    int32_t *ch[LAC_MAX_CHANNELS];
+    int sbits[LAC_MAX_CHANNELS];
+    int32_t *mid = w->pcm + (size_t)w->channels * LAC_BLOCK_FRAMES;
+    int32_t *side = mid + LAC_BLOCK_FRAMES;
+    int32_t *res = side + LAC_BLOCK_FRAMES;
+    int mode = STEREO_LR;
+    unsigned long long t0 = now_ns();
+
+    for (int c = 0; c < w->channels; c++) {
+        ch[c] = w->pcm + (size_t)c * LAC_BLOCK_FRAMES;
+        sbits[c] = bits;
+    }
+
+    // 立体声：差值多一位，32 位的就不做了
+    if (w->channels == 2 && bits <= 24) {
+        int32_t *l = ch[0], *r = ch[1];
+        for (size_t i = 0; i < n; i++) {
+            mid[i] = (l[i] + r[i]) >> 1;
+            side[i] = l[i] - r[i];
+        }
+        uint64_t el = roughness(l, n), er = roughness(r, n);
+        uint64_t em = roughness(mid, n), es = roughness(side, n);
+        uint64_t cost[4] = { el + er, el + es, es + er, em + es };
+        for (int m = 1; m < 4; m++)
+            if (cost[m] < cost[mode]) mode = m;
+        if (mode == STEREO_LS) { ch[1] = side; sbits[1] = bits + 1; }
+        if (mode == STEREO_SR) { ch[0] = side; sbits[0] = bits + 1; }
+        if (mode == STEREO_MS) { ch[0] = mid; ch[1] = side; sbits[1] = bits + 1; }
+    }
+
+    unsigned char *hdr = w->out;
+    bitw b = { w->out + LAC_BLOCK_HEADER_BYTES, 0, 0, 0 };
+    for (int c = 0; c < w->channels; c++)
+        if (encode_subframe(&b, ch[c], n, sbits[c], w->max_order, res) == SUB_VERBATIM) w->verbatim++;
+    bw_flush(&b);
+
+    memcpy(hdr, "LACB", 4);
+    wr32(hdr + 4, b.pos);
+    wr16(hdr + 8, n);
+    hdr[10] = mode;
+    hdr[11] = 0;
+    wr32(hdr + 12, block_crc(hdr, b.pos));
+    w->encode_ns += now_ns() - t0;
+
+    size_t total = LAC_BLOCK_HEADER_BYTES + b.pos;
+    if (write_all(w->fd, w->out, total) < 0) return -1;
+    w->out_bytes += total;
+    w->frames += n;
+    w->blocks++;
+    w->have = 0;
+    return 0;
+}
+
+// 交错的一帧拆到每个声道的那一条上
+static void load_frame(lac_writer *w, const unsigned char *p) {
+    for (int c = 0; c < w->channels; c++) {
+        int32_t v;
+        switch (w->fmt) {
+        case SF_S16: v = (int16_t)rd16(p); p += 2; break;
+        case SF_S24_3: v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8; p += 3; break;
+        default: v = (int32_t)rd32(p); p += 4; break;
+        }
+        w->pcm[(size_t)c * LAC_BLOCK_FRAMES + w->have] = v;
+    }
+}
+
+int lac_writer_open(lac_writer *w, const char *path, unsigned int rate, int channels, sf_format fmt) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    if (fmt != SF_S16 && fmt != SF_S24_3 && fmt != SF_S32) {
+        fprintf(stderr, "压缩格式只支持整数采样 (s16 / s24_3 / s32)，%s 不行\n", sf_name(fmt));
+        return -1;
+    }
+    if (channels < 1 || channels > LAC_MAX_CHANNELS) {
+        fprintf(stderr, "压缩格式最多 %d 声道\n", LAC_MAX_CHANNELS);
+        return -1;
+    }
+    pthread_once(&crc_once, crc_init);
+    w->rate = rate;
+    w->channels = channels;
+    w->fmt = fmt;
+    w->max_order = LAC_DEFAULT_ORDER;
+
+    // 每个声道一条，再加 中/差/残差 三条
+    w->pcm = malloc((size_t)(channels + 3) * LAC_BLOCK_FRAMES * sizeof(int32_t));
+    // 最坏情况每个样本 5 字节左右 (32 位 + 差值位 + Rice 的一元码)，给足
+    w->out = malloc(LAC_BLOCK_HEADER_BYTES + (size_t)channels * LAC_BLOCK_FRAMES * 8 + 1024);
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!w->pcm || !w->out || w->fd < 0) {
+        if (w->fd < 0) perror(path);
+        else fprintf(stderr, "内存不足\n");
+        lac_writer_close(w);
+        return -1;
+    }
+
+    unsigned char hdr[LAC_HEADER_BYTES] = { 'L', 'A', 'C', '1' };
+    wr16(hdr + 4, LAC_VERSION);
+    wr16(hdr + 6, channels);
+    wr32(hdr + 8, rate);
+    hdr[12] = fmt;
+    hdr[13] = sf_bits(fmt);
+    wr16(hdr + 14, LAC_BLOCK_FRAMES);
+    wr64(hdr + 16, 0); // 总帧数，关闭时补
+    if (write_all(w->fd, hdr, sizeof(hdr)) < 0) {
+        lac_writer_close(w);
+        return -1;
+    }
+    w->out_bytes = sizeof(hdr);
+    return 0;
+}
+
+int lac_writer_write(lac_writer *w, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    size_t fb = (size_t)w->channels * sf_bytes(w->fmt);
+
+    w->in_bytes += len;
+    // 上次剩下的半帧先补齐
+    if (w->partial_len) {
+        size_t need = fb - w->partial_len;
+        if (need > len) need = len;
+        memcpy(w->partial + w->partial_len, p, need);
+        w->partial_len += need;
+        p += need;
+        len -= need;
+        if (w->partial_len < fb) return 0;
+        load_frame(w, w->partial);
+        w->partial_len = 0;
+        if (++w->have == LAC_BLOCK_FRAMES && encode_block(w) < 0) return -1;
+    }
+    for (; len >= fb; p += fb, len -= fb) {
+        load_frame(w, p);
+        if (++w->have == LAC_BLOCK_FRAMES && encode_block(w) < 0) return -1;
+    }
+    memcpy(w->partial, p, len);
+    w->partial_len = len;
+    return 0;
+}
+
+int lac_writer_close(lac_writer *w) {
+    int rc = 0;
+    if (w->fd >= 0) {
+        if (w->have && encode_block(w) < 0) rc = -1;
+        unsigned char n[8];
+        wr64(n, w->frames);
+        if (pwrite(w->fd, n, sizeof(n), 16) != sizeof(n)) rc = -1;
+        if (close(w->fd) < 0) rc = -1;
+        w->fd = -1;
+    }
+    free(w->pcm);
+    free(w->out);
+    w->pcm = NULL;
+    w->out = NULL;
+    return rc;
+}
+
+void lac_writer_report(const lac_writer *w, FILE *fp) {
+    double seconds = w->rate ? (double)w->frames / w->rate : 0;
+    fprintf(fp, "压缩: 原始 %llu 字节 -> %llu 字节 (%.1f%%), %lu 块 (%lu 个子帧原样存), 编码 %.0f 倍实时\n",
+            (unsigned long long)w->in_bytes, (unsigned long long)w->out_bytes,
+            w->in_bytes ? 100.0 * w->out_bytes / w->in_bytes : 0.0, w->blocks, w->verbatim,
+            w->encode_ns ? seconds / (w->encode_ns / 1e9) : 0.0);
+}
+
+// --- 解码 ---
+int lac_probe(const unsigned char *map, size_t len) {
+    return len >= LAC_HEADER_BYTES && memcmp(map, "LAC1", 4) == 0;
+}
+
+// p 这里是不是一个完好的块：同步字、长度没超出文件、帧数合理、CRC 对得上
+static int block_ok(const lac_decoder *d, const unsigned char *p) {
+    size_t left = d->map + d->len - p;
+    if (left < LAC_BLOCK_HEADER_BYTES || memcmp(p, "LACB", 4) != 0) return 0;
+    size_t frames = rd16(p + 8), bytes = rd32(p + 4);
+    if (frames == 0 || frames > d->block_frames || bytes > left - LAC_BLOCK_HEADER_BYTES) return 0;
+    return block_crc(p, bytes) == rd32(p + 12);
+}
+
+// 从 p 开始找下一个完好的块；p 本身就是的话直接返回，
+// 否则往后找下一个 "LACB" (*skipped 置 1)，一直找不到返回 NULL
+static const unsigned char *find_block(const lac_decoder *d, const unsigned char *p, int *skipped) {
+    const unsigned char *end = d->map + d->len;
+
+    *skipped = 0;
+    if (p >= end) return NULL;
+    if (block_ok(d, p)) return p;
+    *skipped = 1;
+    for (p++; p + LAC_BLOCK_HEADER_BYTES <= end; p++) {
+        p = memmem(p, end - p, "LACB", 4);
+        if (!p) return NULL;
+        if (block_ok(d, p)) return p;
+    }
+    return NULL;
+}
+
+int lac_decoder_init(lac_decoder *d, const unsigned char *map, size_t len) {
+    memset(d, 0, sizeof(*d));
+    if (!lac_probe(map, len) || rd16(map + 4) != LAC_VERSION) {
+        fprintf(stderr, "不是认识的 LAC 文件\n");
+        return -1;
+    }
+    pthread_once(&crc_once, crc_init);
+    d->map = map;
+    d->len = len;
+    d->channels = rd16(map + 6);
+    d->rate = rd32(map + 8);
+    d->fmt = (sf_format)map[12];
+    d->bits = map[13];
+    d->block_frames = rd16(map + 14);
+    d->frames = rd64(map + 16);
+    if (d->channels < 1 || d->channels > LAC_MAX_CHANNELS || d->block_frames == 0 ||
+        (d->fmt != SF_S16 && d->fmt != SF_S24_3 && d->fmt != SF_S32) || d->bits != sf_bits(d->fmt)) {
+        fprintf(stderr, "LAC 文件头损坏\n");
+        return -1;
+    }
+    d->next = map + LAC_HEADER_BYTES;
+
+    // 录音被打断，没来得及补总帧数：顺着块头数一遍 (坏块跳过，和解码时一样)
+    if (d->frames == 0) {
+        int skipped;
+        for (const unsigned char *p = find_block(d, d->next, &skipped); p;
+             p = find_block(d, p + LAC_BLOCK_HEADER_BYTES + rd32(p + 4), &skipped))
+            d->frames += rd16(p + 8);
+    }
+
+    d->pcm = malloc((size_t)d->channels * d->block_frames * sizeof(int32_t));
+    d->out = malloc((size_t)d->channels * d->block_frames * sf_bytes(d->fmt));
+    if (!d->pcm || !d->out) {
+        fprintf(stderr, "内存不足\n");
+        lac_decoder_free(d);
+        return -1;
+    }
+    return 0;
+}
+
+void lac_decoder_free(lac_decoder *d) {
+    free(d->pcm);
+    free(d->out);
+    d->pcm = NULL;
+    d->out = NULL;
+}
+
+void lac_decoder_rewind(lac_decoder *d) {
+    d->next = d->map + LAC_HEADER_BYTES;
+    d->out_frames = d->out_pos = 0;
+}
+
+static int decode_residual(bitr *b, int32_t *res, size_t m) {
+    int porder = br_get(b, 4);
+    for (int i = 0; i < (1 << porder); i++) {
+        size_t start, count;
+        partition_range(m, porder, i, &start, &count);
+        int k = br_get(b, 5);
+        if (k == LAC_ESCAPE) {
+            int width = br_get(b, 6);
+            if (width > 32) return -1;
+            for (size_t j = 0; j < count; j++) res[start + j] = br_sget(b, width);
+        } else {
+            for (size_t j = 0; j < count; j++) {
+                uint32_t q = br_unary(b);
+                res[start + j] = unzigzag((q << k) | br_get(b, k));
+            }
+        }
+        if (b->err) return -1;
+    }
+    return 0;
+}
+
+static int decode_subframe(bitr *b, int32_t *x, size_t n, int sbits) {
+    int type = br_get(b, 2);
+    if (type == SUB_CONSTANT) {
+        int32_t v = br_sget(b, sbits);
+        for (size_t i = 0; i < n; i++) x[i] = v;
+    } else if (type == SUB_VERBATIM) {
+        for (size_t i = 0; i < n; i++) x[i] = br_sget(b, sbits);
+    } else if (type == SUB_LPC) {
+        int order = br_get(b, 5) + 1;
+        int qbits = br_get(b, 4) + 1;
+        int shift = br_get(b, 5);
+        int32_t q[LAC_MAX_ORDER];
+        if ((size_t)order > n) return -1;
+        for (int j = 0; j < order; j++) q[j] = br_sget(b, qbits);
+        for (int j = 0; j < order; j++) x[j] = br_sget(b, sbits);
+        // 残差先放在 x 的后面，再原地加上预测值
+        if (decode_residual(b, x + order, n - order) < 0) return -1;
+        for (size_t t = order; t < n; t++) {
+            int64_t pred = 0;
+            for (int j = 0; j < order; j++) pred += (int64_t)q[j] * x[t - 1 - j];
+            x[t] += (int32_t)(pred >> shift);
+        }
+    } else {
+        return -1;
+    }
+    return b->err ? -1 : 0;
+}
+
+// 一块解到 d->pcm，再交错打包成原来的格式
+static int decode_payload(lac_decoder *d, const unsigned char *hdr, size_t n) {
+    size_t bf = d->block_frames;
+    int mode = hdr[10];
+    bitr b = { hdr + LAC_BLOCK_HEADER_BYTES, hdr + LAC_BLOCK_HEADER_BYTES + rd32(hdr + 4), 0, 0, 0 };
+
+    if (mode != STEREO_LR && d->channels != 2) return -1;
+    for (int c = 0; c < d->channels; c++) {
+        int side = (mode == STEREO_LS || mode == STEREO_MS) ? c == 1 : mode == STEREO_SR ? c == 0 : 0;
+        if (decode_subframe(&b, d->pcm + c * bf, n, d->bits + side) < 0) return -1;
+    }
+
+    int32_t *l = d->pcm, *r = d->pcm + bf;
+    for (size_t i = 0; mode != STEREO_LR && i < n; i++) {
+        int32_t a = l[i], s = r[i];
+        switch (mode) {
+        case STEREO_LS: r[i] = a - s; break;              // 左, 差
+        case STEREO_SR: l[i] = a + s; break;              // 差, 右 (a 是差)
+        default: {                                        // 中, 差：中值丢掉的最低位就是差的最低位
+            int32_t m2 = (int32_t)((uint32_t)a << 1) | (s & 1);
+            l[i] = (m2 + s) >> 1;
+            r[i] = (m2 - s) >> 1;
+            break;
+        }
+        }
+    }
+
+    unsigned char *o = d->out;
+    for (size_t i = 0; i < n; i++) {
+        for (int c = 0; c < d->channels; c++) {
+            int32_t v = d->pcm[c * bf + i];
+            switch (d->fmt) {
+            case SF_S16: wr16(o, v); o += 2; break;
+            case SF_S24_3: o[0] = v; o[1] = v >> 8; o[2] = v >> 16; o += 3; break;
+            default: wr32(o, v); o += 4; break;
+            }
+        }
+    }
+    return 0;
+}
+
+size_t lac_decode_block(lac_decoder *d) {
+    unsigned long long t0 = now_ns();
+
+    const unsigned char *hdr;
+    int skipped;
+    while ((hdr = find_block(d, d->next, &skipped)) != NULL) {
+        // 坏了的块跳过，靠同步字找到下一块，后面的照样能解
+        if (skipped) d->bad_blocks++;
+        size_t n = rd16(hdr + 8), bytes = rd32(hdr + 4);
+        d->next = hdr + LAC_BLOCK_HEADER_BYTES + bytes;
+        if (decode_payload(d, hdr, n) < 0) {
+            d->bad_blocks++;
+            continue;
+        }
+        d->out_frames = n;
+        d->out_pos = 0;
+        d->decoded += n;
+        d->decode_ns += now_ns() - t0;
+        return n;
+    }
+    // 最后一段找不到完好的块 (比如录音被打断截掉的半块)，也算一个坏块
+    if (skipped) d->bad_blocks++;
+    d->next = d->map + d->len;
+    d->out_frames = d->out_pos = 0;
+    return 0;
+}
+
+void lac_decoder_report(const lac_decoder *d, FILE *fp) {
+    size_t raw = d->frames * d->channels * sf_bytes(d->fmt);
+    double seconds = d->rate ? (double)d->decoded / d->rate : 0;
+    fprintf(fp, "解码: %s %d 声道, 压缩到 %.1f%%, 解了 %.1f 秒, %.0f 倍实时%s\n", sf_name(d->fmt), d->channels,
+            raw ? 100.0 * d->len / raw : 0.0, seconds, d->decode_ns ? seconds / (d->decode_ns / 1e9) : 0.0,
+            d->bad_blocks ? ", 有坏块" : "");
+    if (d->bad_blocks) fprintf(fp, "  跳过了 %lu 个坏块\n", d->bad_blocks);
+}
@@ -0,0 +1,98 @@
+#ifndef LAC_H
+#define LAC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_fmt.h"
+
+// --- 无损压缩格式 (.lac)：线性预测 + Rice 编码的残差，思路和 FLAC 一样 ---
+// 录音大部分时候是安静的、平滑的，直接存 16 位 PCM 很浪费盘和带宽。
+// 每一块 (默认 4096 帧) 单独编码，每个声道：
+//   * 全是同一个值 -> 只存一个数
+//   * 否则用 Levinson-Durbin 算 LPC 系数 (按估计的码长挑阶数)，系数量化成整数，
+//     存前 order 个样本原值，后面只存 "实际值 - 预测值" 的残差
+//   * 残差按 Rice 码存：之字形映射成非负数，高位一元码、低 k 位原样；
+//     残差分成 2^p 段，每段自己挑 k
+//   * 怎么都压不下去 (白噪声) 就原样存
+// 立体声先试 左/右、左/差、差/右、中/差 哪种组合最省 (24 位以内才做，差值要多一位)。
+// 只支持整数格式 (s16 / s24_3 / s32)，float 不行。
+//
+// 文件布局 (小端)：
+//   文件头 32 字节   "LAC1" 版本(2) 声道(2) 采样率(4) 格式(1) 位深(1) 块帧数(2) 总帧数(8) 保留(8)
+//   块头 16 字节     "LACB" 数据字节数(4) 帧数(2) 立体声方式(1) 保留(1) CRC32(4)
+//                    (CRC 算的是块头中间那 8 个字节加上块数据)
+//   块数据           按位紧凑排的各声道子帧，结尾补齐到字节
+// 每一块都能单独解出来，边读边解就行，不用先看完整个文件；总帧数录完才补写，
+// 是 0 (录音被打断) 的话打开时顺着块头数一遍。块坏了 (CRC 不对) 就往后找下一个 "LACB" 接着解。
+#define LAC_BLOCK_FRAMES 4096
+#define LAC_MAX_CHANNELS 8
+#define LAC_MAX_ORDER 32
+#define LAC_DEFAULT_ORDER 12
+#define LAC_HEADER_BYTES 32
+#define LAC_BLOCK_HEADER_BYTES 16
+
+// --- 编码 (写文件) ---
+typedef struct {
+    int fd;
+    unsigned int rate;
+    int channels;
+    sf_format fmt;
+    int max_order;
+
+    int32_t *pcm;               // 攒一块：每个声道一条，各 LAC_BLOCK_FRAMES 个
+    size_t have;                // 攒了多少帧
+    unsigned char partial[LAC_MAX_CHANNELS * 4]; // 写进来的数据不一定是整帧，余下的字节先放这
+    size_t partial_len;
+    unsigned char *out;         // 一块编码结果
+
+    uint64_t frames;            // 一共写了多少帧
+    uint64_t in_bytes;          // 原始 PCM 多少字节
+    uint64_t out_bytes;         // 文件多大
+    unsigned long long encode_ns;
+    unsigned long blocks;
+    unsigned long verbatim;     // 压不下去原样存的子帧
+} lac_writer;
+
+// 只支持 s16 / s24_3 / s32，失败打印原因并返回 -1
+int lac_writer_open(lac_writer *w, const char *path, unsigned int rate, int channels, sf_format fmt);
+// 交错的 fmt 数据，len 是字节数，可以不是整帧
+int lac_writer_write(lac_writer *w, const void *data, size_t len);
+// 编完最后不满的一块，补写总帧数，关闭
+int lac_writer_close(lac_writer *w);
+// "压缩: 原始 X -> Y (Z%), 编码 N 倍实时"
+void lac_writer_report(const lac_writer *w, FILE *fp);
+
+// --- 解码 (从映射好的文件里一块块解) ---
+typedef struct {
+    const unsigned char *map;
+    size_t len;
+    const unsigned char *next;  // 下一块的块头
+    int channels;
+    unsigned int rate;
+    sf_format fmt;
+    int bits;
+    unsigned int block_frames;
+    uint64_t frames;            // 总帧数
+
+    int32_t *pcm;               // 每个声道一条
+    unsigned char *out;         // 解好的一块，交错的 fmt
+    size_t out_frames, out_pos;
+
+    unsigned long long decode_ns;
+    uint64_t decoded;           // 一共解了多少帧 (循环播放会重复算)
+    unsigned long bad_blocks;   // CRC 不对或者解不下去的块
+} lac_decoder;
+
+// map 开头是不是 LAC 文件头
+int lac_probe(const unsigned char *map, size_t len);
+// 读文件头、分配一块的缓冲区。失败打印原因并返回 -1
+int lac_decoder_init(lac_decoder *d, const unsigned char *map, size_t len);
+void lac_decoder_free(lac_decoder *d);
+// 解下一块到 d->out，返回帧数，0 = 没有了。坏块会跳过 (计数)
+size_t lac_decode_block(lac_decoder *d);
+void lac_decoder_rewind(lac_decoder *d);
+// "解码: 压缩比 Z%, N 倍实时"
+void lac_decoder_report(const lac_decoder *d, FILE *fp);
+
+#endif
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "latency_probe.h"
+
+#define CHIRP_LEN 1024
+#define CHIRP_F0 100.0      // 扫频起点 (Hz)
+#define CHIRP_F1 8000.0     // 扫频终点 (Hz)
+#define DETECT_THRESHOLD 0.5 // 归一化互相关低于这个值就当没找到
+
+int probe_init(latency_probe *p, unsigned int rate, int channels, int probes) {
+    memset(p, 0, sizeof(*p));
+    p->rate = rate;
+    p->channels = channels;
+    p->probes = probes;
+    p->interval = rate / 2; // 每 0.5 秒一次，所以能测的最大延迟也就是将近 0.5 秒
+    p->chirp_len = CHIRP_LEN;
+
+    // 对数扫频 + 汉宁窗包络，自相关只有一个尖峰，很好找
+    p->chirp = (short *) malloc(sizeof(short) * p->chirp_len);
+    if (!p->chirp) return -1;
+    double k = log(CHIRP_F1 / CHIRP_F0);
+    double T = (double)p->chirp_len / rate;
+    for (int i = 0; i < p->chirp_len; i++) {
+        double t = (double)i / rate;
+        double phase = 2 * M_PI * CHIRP_F0 * T / k * (exp(t / T * k) - 1);
+        double env = 0.5 * (1 - cos(2 * M_PI * i / (p->chirp_len - 1)));
+        p->chirp[i] = (short)(12000 * env * sin(phase));
+    }
+
+    // 预填的静音再多也不会超过一秒，多留点余量
+    p->rec_len = rate + (unsigned long)(probes + 1) * p->interval;
+    p->rec = (short *) calloc(p->rec_len, sizeof(short));
+
+    // 周期最小按 16 帧估计
+    p->wake_cap = p->rec_len / 16 + 1;
+    p->wake_us = (double *) malloc(sizeof(double) * p->wake_cap);
+    p->lags = (unsigned long *) malloc(sizeof(unsigned long) * probes);
+
+    if (!p->rec || !p->wake_us || !p->lags) {
+        probe_free(p);
+        return -1;
+    }
+    return 0;
+}
+
+void probe_free(latency_probe *p) {
+    free(p->chirp);
+    free(p->rec);
+    free(p->wake_us);
+    free(p->lags);
+    p->chirp = NULL;
+    p->rec = NULL;
+    p->wake_us = NULL;
+    p->lags = NULL;
+}
+
+void probe_reset(latency_probe *p, unsigned long play_start) {
+    p->play_start = play_start;
+    p->play_pos = play_start;
+    p->cap_pos = 0;
+    p->wake_count = 0;
+    p->last_wake.tv_sec = 0;
+    p->last_wake.tv_nsec = 0;
+}
+
+// 第 k 次扫频在播放流里从第几帧开始
+static unsigned long inject_pos(const latency_probe *p, int k) {
+    return p->play_start + k * p->interval + p->interval / 4;
+}
+
+void probe_fill_playback(latency_probe *p, short *dst, unsigned long frames) {
+    for (unsigned long i = 0; i < frames; i++, p->play_pos++) {
+        short v = 0;
+        unsigned long rel = p->play_pos - p->play_start;
+        int k = rel / p->interval;
+        if (k < p->probes && p->play_pos >= inject_pos(p, k)) {
+            unsigned long off = p->play_pos - inject_pos(p, k);
+            if (off < (unsigned long)p->chirp_len) v = p->chirp[off];
+        }
+        for (int c = 0; c < p->channels; c++) dst[i * p->channels + c] = v;
+    }
+}
+
+void probe_capture(latency_probe *p, const short *src, unsigned long frames) {
+    for (unsigned long i = 0; i < frames && p->cap_pos < p->rec_len; i++) {
+        p->rec[p->cap_pos++] = src[i * p->channels]; // 只要左声道
+    }
+}
+
+void probe_wakeup(latency_probe *p) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (p->last_wake.tv_sec != 0 && p->wake_count < p->wake_cap) {
+        p->wake_us[p->wake_count++] = (now.tv_sec - p->last_wake.tv_sec) * 1e6 +
+                                      (now.tv_nsec - p->last_wake.tv_nsec) / 1e3;
+    }
+    p->last_wake = now;
+}
+
+int probe_done(const latency_probe *p) {
+    return p->cap_pos >= p->rec_len;
+}
+
+// 在 rec[start, start+max_lag] 里找和扫频最像的位置，返回归一化的相关系数
+static double find_chirp(const latency_probe *p, unsigned long start, unsigned long max_lag,
+                         unsigned long *best_lag) {
+    const short *c = p->chirp;
+    int n = p->chirp_len;
+    if (start + max_lag + n > p->rec_len) {
+        if (start + n > p->rec_len) return 0;
+        max_lag = p->rec_len - start - n;
+    }
+
+    double e_chirp = 0;
+    for (int j = 0; j < n; j++) e_chirp += (double)c[j] * c[j];
+
+    // 录音窗口的能量用滑动和，避免每个 lag 都重算
+    const short *r = p->rec + start;
+    double e_rec = 0;
+    for (int j = 0; j < n; j++) e_rec += (double)r[j] * r[j];
+
+    double best = 0;
+    *best_lag = 0;
+    for (unsigned long lag = 0; lag <= max_lag; lag++) {
+        int64_t acc = 0;
+        const short *w = r + lag;
+        for (int j = 0; j < n; j++) acc += (int32_t)c[j] * w[j];
+
+        if (e_rec > 0) {
+            double corr = acc / sqrt(e_chirp * e_rec);
+            if (corr > best) {
+                best = corr;
+                *best_lag = lag;
+            }
+        }
+        if (lag < max_lag) e_rec += (double)w[n] * w[n] - (double)w[0] * w[0];
+    }
+    return best;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_ulong(const void *a, const void *b) {
+    unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+    return (x > y) - (x < y);
+}
+
+void probe_report(latency_probe *p, unsigned long period) {
+    unsigned long *lags = p->lags;
+    int found = 0;
+
+    printf("\n=== 往返延迟 (%d 次扫频) ===\n", p->probes);
+    for (int k = 0; k < p->probes; k++) {
+        unsigned long lag;
+        double corr = find_chirp(p, inject_pos(p, k), p->interval - p->chirp_len, &lag);
+        if (corr < DETECT_THRESHOLD) {
+            printf("  #%-2d 没检测到 (相关系数 %.2f)\n", k, corr);
+            continue;
+        }
+        printf("  #%-2d %6lu 帧  %7.2f ms  (相关系数 %.2f)\n",
+               k, lag, lag * 1000.0 / p->rate, corr);
+        lags[found++] = lag;
+    }
+    if (found > 0) {
+        qsort(lags, found, sizeof(lags[0]), cmp_ulong);
+        unsigned long med = lags[found / 2];
+        printf("  中位数 %lu 帧 = %.2f ms, 最小 %lu, 最大 %lu\n",
+               med, med * 1000.0 / p->rate, lags[0], lags[found - 1]);
+    } else {
+        printf("  一次都没检测到：检查录音端是否真的能听到播放端 (回环线 / snd-aloop)\n");
+    }
+
+    printf("\n=== 录音端唤醒间隔 (理论 %.0f us) ===\n", period * 1e6 / p->rate);
+    if (p->wake_count == 0) {
+        printf("  没有数据\n");
+        return;
+    }
+    qsort(p->wake_us, p->wake_count, sizeof(double), cmp_double);
+    unsigned long n = p->wake_count;
+    unsigned long i99 = n * 99 / 100;
+    if (i99 >= n) i99 = n - 1;
+    printf("  样本 %lu  min %.0f  median %.0f  p99 %.0f  max %.0f (us)\n",
+           n, p->wake_us[0], p->wake_us[n / 2], p->wake_us[i99], p->wake_us[n - 1]);
+}
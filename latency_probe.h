@@ -0,0 +1,55 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <time.h>
+
+// --- 往返延迟 + 唤醒抖动测量 ---
+// 播放端每隔 interval 帧插一段扫频 (chirp)，录音端把收到的左声道全部存下来，
+// 结束后用互相关找每段扫频在录音里的位置，两者之差就是往返延迟。
+// 不需要真麦克风：snd-aloop 回环、或者 null/file 插件都能跑。
+#define PROBE_MAX 1200          // 最多插几次 (每 0.5 秒一次，10 分钟)
+
+typedef struct {
+    unsigned int rate;
+    int channels;
+
+    short *chirp;               // 扫频模板 (单声道)
+    int chirp_len;
+    int probes;                 // 一共插几次
+    unsigned long *lags;        // 报告时每次测到的延迟，probes 个
+    unsigned long interval;     // 相邻两次之间隔多少帧
+
+    // 播放端：下一帧在整个播放流里的编号 (预填的静音也算)
+    unsigned long play_start;
+    unsigned long play_pos;
+
+    // 录音端：存下来的左声道
+    short *rec;
+    unsigned long rec_len;
+    unsigned long cap_pos;
+
+    // 每次录音端唤醒的间隔 (微秒)
+    double *wake_us;
+    unsigned long wake_count;
+    unsigned long wake_cap;
+    struct timespec last_wake;
+} latency_probe;
+
+int probe_init(latency_probe *p, unsigned int rate, int channels, int probes);
+void probe_free(latency_probe *p);
+
+// 流 (重新) 启动时调用：play_start = 预填静音的帧数
+void probe_reset(latency_probe *p, unsigned long play_start);
+
+// 生成接下来 frames 帧的播放数据 (交错格式)
+void probe_fill_playback(latency_probe *p, short *dst, unsigned long frames);
+// 收下录音端读到的 frames 帧
+void probe_capture(latency_probe *p, const short *src, unsigned long frames);
+// 录音端每次被 poll 唤醒时调用
+void probe_wakeup(latency_probe *p);
+
+int probe_done(const latency_probe *p);
+// 算互相关并打印结果，period 只用来显示理论唤醒间隔
+void probe_report(latency_probe *p, unsigned long period);
+
+#endif
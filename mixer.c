@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "mixer.h"
+#include "synth.h"
+
+// 向量扩展：8 个采样一组，和 sample_fmt.c 一样编通用版和 avx2 版两份
+typedef float v8f __attribute__((vector_size(32)));
+typedef int32_t v8i __attribute__((vector_size(32)));
+
+// --- 混音内核 ---
+// 交错的采样不用管声道，acc[i] += gain * src[i] 一路加下去就行
+static inline __attribute__((always_inline))
+size_t mix_add_kernel(float *acc, const float *src, float gain, size_t n) {
+    v8f g = {gain, gain, gain, gain, gain, gain, gain, gain};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        v8f a, x;
+        memcpy(&a, acc + i, sizeof(a));
+        memcpy(&x, src + i, sizeof(x));
+        a += x * g;
+        memcpy(acc + i, &a, sizeof(a));
+    }
+    return i;
+}
+
+// 数一下有几个采样超过了满刻度 (|x| > 1，输出时会被夹住)
+// 比较结果是全 1 (= -1) 或者全 0，减一下就是计数
+static inline __attribute__((always_inline))
+size_t clip_count_kernel(const float *x, size_t n, unsigned long *count) {
+    const v8f one = {1, 1, 1, 1, 1, 1, 1, 1};
+    v8i cnt = {0};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        v8f v;
+        memcpy(&v, x + i, sizeof(v));
+        cnt -= (v > one) | (v < -one);
+    }
+    unsigned long c = 0;
+    for (int k = 0; k < 8; k++) c += cnt[k];
+    *count = c;
+    return i;
+}
+
+static size_t mix_add_generic(float *acc, const float *src, float gain, size_t n) {
+    return mix_add_kernel(acc, src, gain, n);
+}
+
+__attribute__((target("avx2")))
+static size_t mix_add_avx2(float *acc, const float *src, float gain, size_t n) {
+    return mix_add_kernel(acc, src, gain, n);
+}
+
+static size_t clip_count_generic(const float *x, size_t n, unsigned long *count) {
+    return clip_count_kernel(x, n, count);
+}
+
+__attribute__((target("avx2")))
+static size_t clip_count_avx2(const float *x, size_t n, unsigned long *count) {
+    return clip_count_kernel(x, n, count);
+}
+
+static int use_avx2(void) {
+    return strcmp(synth_isa(), "avx2") == 0;
+}
+
+static void mix_add(float *acc, const float *src, float gain, size_t n) {
+    size_t i = use_avx2() ? mix_add_avx2(acc, src, gain, n) : mix_add_generic(acc, src, gain, n);
+    for (; i < n; i++) acc[i] += src[i] * gain;
+}
+
+static unsigned long clip_count(const float *x, size_t n) {
+    unsigned long c;
+    size_t i = use_avx2() ? clip_count_avx2(x, n, &c) : clip_count_generic(x, n, &c);
+    for (; i < n; i++) c += x[i] > 1.0f || x[i] < -1.0f;
+    return c;
+}
+
+// --- 建立 ---
+void mixer_init(mixer *m) {
+    memset(m, 0, sizeof(*m));
+    m->src_fmt = SF_UNKNOWN;
+    sem_init(&m->need, 0, 0);
+}
+
+int mixer_add(mixer *m, const char *path, double gain_db, double start_sec, int loop) {
+    if (m->nstreams >= MIX_MAX_STREAMS) {
+        fprintf(stderr, "最多混 %d 路\n", MIX_MAX_STREAMS);
+        return -1;
+    }
+    mix_stream *s = &m->streams[m->nstreams];
+    memset(s, 0, sizeof(*s));
+    if (wav_source_open(&s->src, path) < 0) return -1;
+    wav_source *w = &s->src;
+
+    const char *why = NULL;
+    if (w->sample_fmt == SF_UNKNOWN) why = "不支持的 WAV 格式";
+    else if (w->frames == 0) why = "没有数据";
+    else if (m->nstreams > 0 && w->sample_rate != m->rate) why = "采样率和第一路不一样 (先转成一样的)";
+    else if (m->nstreams > 0 && w->channels != m->channels && w->channels != 1)
+        why = "声道数和第一路不一样 (只能是一样的或者单声道)";
+    if (why) {
+        fprintf(stderr, "%s: %s (%s, %d 声道, %u Hz)\n", path, why, sf_name(w->sample_fmt), w->channels,
+                w->sample_rate);
+        wav_source_close(w);
+        return -1;
+    }
+    if (m->nstreams == 0) {
+        m->rate = w->sample_rate;
+        m->channels = w->channels;
+        m->src_fmt = w->sample_fmt;
+    }
+
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    s->gain = powf(10.0f, gain_db / 20.0f);
+    s->start = start_sec > 0 ? (size_t)(start_sec * m->rate + 0.5) : 0;
+    s->loop = loop;
+    if (ringbuf_init(&s->ring, MIX_RING_FRAMES * m->channels * sizeof(float)) < 0) {
+        fprintf(stderr, "%s: 环分配失败\n", path);
+        wav_source_close(w);
+        return -1;
+    }
+    atomic_init(&s->eof, 0);
+    m->nstreams++;
+    return 0;
+}
+
+// 末尾的 ":数字" 从右往左剥，最多两个 (文件名里带冒号也没事，只要后面不是数字)
+int mixer_add_spec(mixer *m, const char *spec, int loop) {
+    char path[256];
+    double num[2];
+    int nnum = 0;
+
+    snprintf(path, sizeof(path), "%s", spec);
+    while (nnum < 2) {
+        char *colon = strrchr(path, ':');
+        char *end;
+        if (!colon || colon[1] == 0) break;
+        double v = strtod(colon + 1, &end);
+        if (*end) break;
+        num[nnum++] = v;
+        *colon = 0;
+    }
+    // 剥出来的顺序是反的
+    double gain_db = nnum == 2 ? num[1] : nnum == 1 ? num[0] : 0;
+    double start = nnum == 2 ? num[0] : 0;
+    return mixer_add(m, path, gain_db, start, loop);
+}
+
+// --- 读文件线程 ---
+size_t mixer_fill(mixer *m) {
+    size_t frame_bytes = m->channels * sizeof(float);
+    size_t moved = 0;
+
+    for (int i = 0; i < m->nstreams; i++) {
+        mix_stream *s = &m->streams[i];
+        if (atomic_load_explicit(&s->eof, memory_order_relaxed)) continue;
+
+        while (ringbuf_write_space(&s->ring) >= MIX_CHUNK_FRAMES * frame_bytes) {
+            size_t n = MIX_CHUNK_FRAMES;
+            const void *p = wav_source_next(&s->src, &n);
+            if (!p) {
+                // 倒回开头以后一帧都读不出来 (比如 .lac 的块全坏了)，再倒也没用，当放完了
+                if (s->loop && s->since_rewind > 0) {
+                    wav_source_rewind(&s->src);
+                    s->since_rewind = 0;
+                    continue;
+                }
+                s->unreadable = s->loop;
+                // 环里的数据先于这个标志可见，音频线程看到 eof 时环里就是全部了
+                atomic_store_explicit(&s->eof, 1, memory_order_release);
+                break;
+            }
+            sf_to_f32(m->tmp, p, s->src.sample_fmt, n * s->src.channels);
+            // 单声道：从后往前原地摊开到每个声道
+            if (s->src.channels == 1 && m->channels > 1) {
+                for (size_t f = n; f-- > 0;) {
+                    float v = m->tmp[f];
+                    for (int c = 0; c < m->channels; c++) m->tmp[f * m->channels + c] = v;
+                }
+            }
+            ringbuf_write(&s->ring, m->tmp, n * frame_bytes);
+            moved += n;
+            s->since_rewind += n;
+        }
+    }
+    return moved;
+}
+
+static void *reader_func(void *arg) {
+    mixer *m = (mixer *)arg;
+
+    while (!atomic_load(&m->quit)) {
+        atomic_store(&m->want, 0);
+        mixer_fill(m);
+
+        // 等音频线程叫，最多 100ms 醒一次看看
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 100 * 1000000;
+        if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+        sem_timedwait(&m->need, &ts);
+    }
+    return NULL;
+}
+
+int mixer_start(mixer *m, int reader_thread) {
+    if (m->nstreams == 0) return -1;
+    m->tmp = malloc(MIX_CHUNK_FRAMES * m->channels * sizeof(float));
+    if (!m->tmp) return -1;
+
+    // 开始放之前每一路都灌满，第一个周期就有数据
+    mixer_fill(m);
+    if (!reader_thread) return 0;
+    if (pthread_create(&m->reader, NULL, reader_func, m) != 0) {
+        fprintf(stderr, "读文件线程起不来\n");
+        return -1;
+    }
+    m->reader_started = 1;
+    return 0;
+}
+
+void mixer_stop(mixer *m) {
+    if (m->reader_started) {
+        atomic_store(&m->quit, 1);
+        sem_post(&m->need);
+        pthread_join(m->reader, NULL);
+        m->reader_started = 0;
+    }
+}
+
+void mixer_free(mixer *m) {
+    mixer_stop(m);
+    for (int i = 0; i < m->nstreams; i++) {
+        ringbuf_free(&m->streams[i].ring);
+        wav_source_close(&m->streams[i].src);
+    }
+    m->nstreams = 0;
+    free(m->tmp);
+    m->tmp = NULL;
+    sem_destroy(&m->need);
+}
+
+// --- 音频线程：混一个周期 ---
+int mixer_render(mixer *m, float *out, size_t frames) {
+    size_t frame_bytes = m->channels * sizeof(float);
+    int active = 0, low = 0;
+
+    memset(out, 0, frames * frame_bytes);
+    for (int i = 0; i < m->nstreams; i++) {
+        mix_stream *s = &m->streams[i];
+        if (s->done) continue;
+        active++;
+
+        // 还没到它出声的时候
+        size_t skip = 0;
+        if (s->start > m->pos) {
+            skip = s->start - m->pos;
+            if (skip >= frames) continue;
+        }
+
+        // eof 要在看环之前读：读到 1 的话，读文件线程写的数据这时都已经在环里了
+        int eof = atomic_load_explicit(&s->eof, memory_order_acquire);
+        float *dst = out + skip * m->channels;
+        size_t want = (frames - skip) * frame_bytes, got = 0;
+        while (got < want) {
+            const void *p;
+            size_t n = ringbuf_read_ptr(&s->ring, &p);  // 绕回开头时分两段
+            if (n == 0) break;
+            if (n > want - got) n = want - got;
+            mix_add(dst + got / sizeof(float), (const float *)p, s->gain, n / sizeof(float));
+            ringbuf_read_advance(&s->ring, n);
+            got += n;
+        }
+        if (got < want) {
+            if (eof) s->done = 1;
+            else atomic_fetch_add_explicit(&m->starved, (want - got) / frame_bytes, memory_order_relaxed);
+        }
+        if (!eof && ringbuf_read_avail(&s->ring) < s->ring.size / 2) low = 1;
+    }
+
+    unsigned long c = clip_count(out, frames * m->channels);
+    if (c) atomic_fetch_add_explicit(&m->clipped, c, memory_order_relaxed);
+    m->pos += frames;
+
+    // sem_post 只在读文件线程睡着时才进内核，而且一轮只叫一次
+    if (low && !atomic_exchange(&m->want, 1)) sem_post(&m->need);
+    return active;
+}
+
+void mixer_describe(const mixer *m, FILE *fp) {
+    fprintf(fp, "混音 %d 路, %u Hz, %d 声道\n", m->nstreams, m->rate, m->channels);
+    for (int i = 0; i < m->nstreams; i++) {
+        const mix_stream *s = &m->streams[i];
+        fprintf(fp, "  %2d. %s  %s %d 声道  %+.1f dB  从 %.2f 秒开始%s\n", i + 1, s->path,
+                sf_name(s->src.sample_fmt), s->src.channels, 20 * log10(s->gain),
+                (double)s->start / m->rate, s->loop ? "  循环" : "");
+    }
+}
+
+void mixer_report(const mixer *m, FILE *fp) {
+    fprintf(fp, "混音: %d 路, 削顶 %lu 个采样, 读文件没跟上补静音 %lu 帧\n", m->nstreams,
+            atomic_load(&m->clipped), atomic_load(&m->starved));
+    for (int i = 0; i < m->nstreams; i++) {
+        if (m->streams[i].unreadable) fprintf(fp, "  %s 读不出数据，没有循环下去\n", m->streams[i].path);
+        if (!m->streams[i].src.lac) continue;
+        fprintf(fp, "  %s ", m->streams[i].path);
+        wav_source_report(&m->streams[i].src, fp);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "wav_source.h"
+#include "ringbuf.h"
+
+// --- 多路混音：好几个 WAV 同时放 (比如背景音乐上面叠一段播报) ---
+// 每一路有自己的增益和起始时间。分两个线程：
+//   * 读文件线程：从映射的 WAV 里取数据，转成 float、声道摆成混音器的样子，
+//     塞进这一路自己的 SPSC 环 (读盘缺页、格式转换都在这边，不在音频线程上)
+//   * 音频线程：mixer_render 从各路的环里取一个周期，乘增益累加到一块 float 上
+// 累加用 float，中间结果超过满刻度也没关系，最后转成声卡格式时才饱和
+// (sf_from_f32 会夹到 [-32768, 32767] 这种范围里，不会像 (short) 强转那样回绕)，
+// 削了多少个采样单独计数。
+// 所有路的采样率必须一样；声道数要么和第一路一样，要么是单声道 (复制到每个声道)
+#define MIX_MAX_STREAMS 64
+#define MIX_RING_FRAMES 8192    // 每一路预读多少帧 (44.1kHz 下 180 多毫秒)
+#define MIX_CHUNK_FRAMES 1024   // 读文件线程一次搬多少帧
+
+typedef struct {
+    wav_source src;
+    char path[256];
+    float gain;                 // 线性增益
+    size_t start;               // 从混音器的第几帧开始出声
+    int loop;                   // 放完从头再来
+    size_t since_rewind;        // 读文件线程 (直通时是音频线程)：上次倒回开头以后读出了多少帧
+    int unreadable;             // 同上：循环的时候倒回开头也读不出数据，只好停了
+
+    ringbuf ring;               // 转好的交错 float，混音器的声道数
+    atomic_int eof;             // 读文件线程：文件读完了，环里剩的就是全部
+    int done;                   // 音频线程：这一路已经放完
+} mix_stream;
+
+typedef struct {
+    int channels;
+    unsigned int rate;
+    sf_format src_fmt;          // 第一路的格式 (声卡优先试这个)
+    int nstreams;
+    mix_stream streams[MIX_MAX_STREAMS];
+    size_t pos;                 // 已经混出去多少帧
+
+    // 读文件线程
+    pthread_t reader;
+    int reader_started;
+    sem_t need;                 // 音频线程发现哪一路的环不到一半了就叫醒它
+    atomic_int want;            // 已经叫过了还没处理，就不再 post
+    atomic_int quit;
+    float *tmp;                 // 转换用的中间区 (一块，读文件线程独占)
+
+    // 统计 (音频线程写，界面读)
+    atomic_ulong clipped;       // 累加结果超过满刻度、输出时被夹住的采样数
+    atomic_ulong starved;       // 环里数据不够 (读文件线程没跟上)，补了静音的帧数
+} mixer;
+
+void mixer_init(mixer *m);
+// 加一路。第一路决定采样率和声道数。失败打印原因并返回 -1
+int mixer_add(mixer *m, const char *path, double gain_db, double start_sec, int loop);
+// 解析 "文件[:增益dB[:起始秒]]" 并加进来
+int mixer_add_spec(mixer *m, const char *spec, int loop);
+// 把每一路的环先灌满，再开读文件线程
+// (reader_thread = 0 不开线程，调用方自己调 mixer_fill，基准测试用)
+int mixer_start(mixer *m, int reader_thread);
+// 停掉读文件线程 (之后统计就不会再变了)
+void mixer_stop(mixer *m);
+// 停线程，关文件，放掉内存
+void mixer_free(mixer *m);
+
+// 读文件线程的一轮：每一路都灌到环满 (或者文件读完)，返回搬了多少帧。
+// 基准测试时直接在同一个线程里调它
+size_t mixer_fill(mixer *m);
+
+// 混 frames 帧交错 float 到 out (覆盖)。返回还在放的路数，0 = 全部放完了
+int mixer_render(mixer *m, float *out, size_t frames);
+
+// 一行一路：文件、增益、起点；最后一行是削顶和欠数据的统计
+void mixer_describe(const mixer *m, FILE *fp);
+void mixer_report(const mixer *m, FILE *fp);
+
+#endif
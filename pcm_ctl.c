@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "pcm_ctl.h"
+#include "pcm_stats.h"
+
+#define PCM_CTL_MAX_FDS 8 // eventfd + 声卡的描述符 (一般就一个，插件链可能多几个)
+
+int pcm_ctl_init(pcm_ctl *c) {
+    memset(c, 0, sizeof(*c));
+    c->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (c->fd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    atomic_init(&c->pending, 0);
+    atomic_init(&c->sent_ns, 0);
+    return 0;
+}
+
+void pcm_ctl_destroy(pcm_ctl *c) {
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+}
+
+void pcm_ctl_send(pcm_ctl *c, unsigned cmd) {
+    uint64_t one = 1;
+    // 暂停和继续只算最后按的那个
+    if (cmd & PCM_CTL_PAUSE) atomic_fetch_and(&c->pending, ~(unsigned)PCM_CTL_RESUME);
+    if (cmd & PCM_CTL_RESUME) atomic_fetch_and(&c->pending, ~(unsigned)PCM_CTL_PAUSE);
+    atomic_store(&c->sent_ns, pcm_stats_now());
+    atomic_fetch_or(&c->pending, cmd);
+    if (write(c->fd, &one, sizeof(one)) < 0 && errno != EAGAIN) perror("eventfd write");
+}
+
+int pcm_ctl_wait(pcm_ctl *c, snd_pcm_t *pcm, int *ready) {
+    struct pollfd pfd[PCM_CTL_MAX_FDS];
+    int n = 0;
+
+    *ready = 0;
+    pfd[0].fd = c->fd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    if (pcm) {
+        // 播放流 prepare 了、缓冲区也垫满了却还没开始 (mmap 下没人替我们 start)，
+        // 这样 poll 永远等不到可写，先 start
+        if (snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED && snd_pcm_avail_update(pcm) == 0)
+            snd_pcm_start(pcm);
+        n = snd_pcm_poll_descriptors(pcm, pfd + 1, PCM_CTL_MAX_FDS - 1);
+        if (n < 0) {
+            fprintf(stderr, "取不到声卡的 poll 描述符: %s\n", snd_strerror(n));
+            return -1;
+        }
+    }
+
+    // 没有超时：暂停时 (pcm == NULL) 除了命令没有任何东西能叫醒这里
+    while (poll(pfd, 1 + n, -1) < 0) {
+        if (errno != EINTR) {
+            perror("poll");
+            return -1;
+        }
+        if (!pcm) c->paused_wakeups++;
+    }
+
+    unsigned cmd = 0;
+    if (pfd[0].revents & POLLIN) {
+        uint64_t v;
+        if (read(c->fd, &v, sizeof(v)) < 0 && errno != EAGAIN) perror("eventfd read");
+        cmd = atomic_exchange(&c->pending, 0);
+    }
+    if (n > 0) {
+        unsigned short revents = 0;
+        snd_pcm_poll_descriptors_revents(pcm, pfd + 1, n, &revents);
+        // 出错 (欠载之类) 也算 "可以去写了"，writei 会返回 -EPIPE，照原来的路子恢复
+        if (revents & (POLLOUT | POLLERR)) *ready = 1;
+    }
+    if (!pcm && !cmd) c->paused_wakeups++;
+    return cmd;
+}
+
+void pcm_ctl_ack(pcm_ctl *c) {
+    unsigned long long ns = pcm_stats_now() - atomic_load(&c->sent_ns);
+    c->commands++;
+    c->lat_sum_ns += ns;
+    if (ns > c->lat_max_ns) c->lat_max_ns = ns;
+}
+
+void pcm_ctl_report(const pcm_ctl *c, FILE *fp) {
+    if (c->commands == 0) return;
+    fprintf(fp, "控制命令 %lu 条: 生效延迟 平均 %.3f ms, 最大 %.3f ms; 暂停期间空醒 %lu 次\n",
+            c->commands, c->lat_sum_ns / 1e6 / c->commands, c->lat_max_ns / 1e6, c->paused_wakeups);
+}
+
+int pcm_pause(snd_pcm_t *pcm, int pause) {
+    snd_pcm_state_t state = snd_pcm_state(pcm);
+    int err = 0;
+
+    if (pause) {
+        if (state != SND_PCM_STATE_RUNNING) return 0; // 还没开始放，没什么可停的
+        if (snd_pcm_pause(pcm, 1) < 0) err = snd_pcm_drop(pcm);
+    } else if (state == SND_PCM_STATE_PAUSED) {
+        err = snd_pcm_pause(pcm, 0);
+    } else if (state == SND_PCM_STATE_SETUP || state == SND_PCM_STATE_XRUN) {
+        // 暂停时走的是 drop (或者停着的时候出了事)，重新 prepare，下一次写会自动开始
+        err = snd_pcm_prepare(pcm);
+    }
+    return err < 0 ? err : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef PCM_CTL_H
+#define PCM_CTL_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <alsa/asoundlib.h>
+
+// --- 音频线程的控制通道 ---
+// 以前暂停是音频线程每 100 ms 看一眼 is_paused：最慢 100 ms 才反应，暂停时还一直醒。
+// 现在音频线程只在一个 poll() 上睡：声卡的描述符 + 一个 eventfd。
+//   * 界面线程 pcm_ctl_send()：把命令位或进 pending，eventfd +1，音频线程马上醒
+//   * 播放中：poll 等 "声卡能写一个周期了" 或者 "有命令"，谁先来处理谁
+//   * 暂停中：声卡真的停下 (snd_pcm_pause，不支持就 drop)，poll 里只剩 eventfd，
+//     没有超时，来命令之前一次都不会醒
+//   * 退出：不用等当前写完/放完，直接 drop
+// 从发命令到音频线程处理完的延迟记下来，退出时报告
+#define PCM_CTL_QUIT   1
+#define PCM_CTL_PAUSE  2
+#define PCM_CTL_RESUME 4
+
+typedef struct {
+    int fd;                         // eventfd
+    atomic_uint pending;            // 还没被取走的命令
+    atomic_ullong sent_ns;          // 最近一条命令什么时候发的
+
+    // 下面只有音频线程写
+    unsigned long commands;
+    unsigned long long lat_sum_ns, lat_max_ns;
+    unsigned long paused_wakeups;   // 暂停时没有命令却醒了的次数 (应该是 0)
+} pcm_ctl;
+
+// 失败打印原因并返回 -1
+int pcm_ctl_init(pcm_ctl *c);
+void pcm_ctl_destroy(pcm_ctl *c);
+
+// 任何线程都能调。PAUSE 和 RESUME 互相覆盖 (只留最后一个)，QUIT 一直有效
+void pcm_ctl_send(pcm_ctl *c, unsigned cmd);
+
+// 音频线程：睡到有命令或者 pcm 能写一个周期 (pcm 为 NULL 就只等命令)
+// 返回取到的命令位，*ready 表示 pcm 可写 (或者出了错要去 writei 里恢复)
+// 出错返回 -1
+int pcm_ctl_wait(pcm_ctl *c, snd_pcm_t *pcm, int *ready);
+// 命令处理完了，记一下从发出到现在用了多久
+void pcm_ctl_ack(pcm_ctl *c);
+void pcm_ctl_report(const pcm_ctl *c, FILE *fp);
+
+// 暂停/继续播放。声卡支持就 snd_pcm_pause (缓冲区里的数据留着，接着放)，
+// 不支持就 drop，继续时重新 prepare (丢掉缓冲区里那一点)。
+// 看的是 pcm 当前的状态，调用方不用记走的是哪条路。失败返回负的 ALSA 错误码
+int pcm_pause(snd_pcm_t *pcm, int pause);
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include "pcm_mmap.h"
+
+// 等不到数据就当设备卡住了 (正常一个周期也就几到几十毫秒)
+#define PCM_MMAP_TIMEOUT_MS 1000
+
+int pcm_set_access(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, int want_mmap) {
+    if (want_mmap) {
+        if (snd_pcm_hw_params_test_access(pcm, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0 &&
+            snd_pcm_hw_params_set_access(pcm, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0)
+            return 1;
+        fprintf(stderr, "设备不支持 mmap 访问，改用 readi/writei\n");
+    }
+    if (snd_pcm_hw_params_set_access(pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) return -1;
+    return 0;
+}
+
+snd_pcm_format_t pcm_alsa_format(sf_format f) {
+    switch (f) {
+    case SF_S16: return SND_PCM_FORMAT_S16_LE;
+    case SF_S24_3: return SND_PCM_FORMAT_S24_3LE;
+    case SF_S32: return SND_PCM_FORMAT_S32_LE;
+    case SF_F32: return SND_PCM_FORMAT_FLOAT_LE;
+    default: return SND_PCM_FORMAT_UNKNOWN;
+    }
+}
+
+sf_format pcm_set_format(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, sf_format want) {
+    static const sf_format prefer[] = { SF_S32, SF_S24_3, SF_F32, SF_S16 };
+
+    if (want != SF_UNKNOWN && snd_pcm_hw_params_test_format(pcm, params, pcm_alsa_format(want)) == 0 &&
+        snd_pcm_hw_params_set_format(pcm, params, pcm_alsa_format(want)) == 0)
+        return want;
+    for (size_t i = 0; i < sizeof(prefer) / sizeof(prefer[0]); i++) {
+        snd_pcm_format_t f = pcm_alsa_format(prefer[i]);
+        if (snd_pcm_hw_params_test_format(pcm, params, f) == 0 &&
+            snd_pcm_hw_params_set_format(pcm, params, f) == 0) {
+            if (want != SF_UNKNOWN)
+                fprintf(stderr, "设备不支持 %s，改用 %s\n", sf_name(want), sf_name(prefer[i]));
+            return prefer[i];
+        }
+    }
+    return SF_UNKNOWN;
+}
+
+snd_pcm_sframes_t pcm_mmap_xfer(snd_pcm_t *pcm, snd_pcm_uframes_t want, pcm_area_fn fn, void *user) {
+    int capture = snd_pcm_stream(pcm) == SND_PCM_STREAM_CAPTURE;
+    snd_pcm_uframes_t done = 0;
+    int err;
+
+    while (done < want) {
+        snd_pcm_state_t state = snd_pcm_state(pcm);
+        if (state == SND_PCM_STATE_XRUN) return -EPIPE;
+        if (state == SND_PCM_STATE_SUSPENDED) return -ESTRPIPE;
+        // mmap 模式下没人替我们自动 start：录音一上来就开始
+        if (capture && state == SND_PCM_STATE_PREPARED && (err = snd_pcm_start(pcm)) < 0) return err;
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) return avail;
+        if (avail == 0) {
+            // 播放：缓冲区已经垫满了还没开始，现在开始
+            if (!capture && state == SND_PCM_STATE_PREPARED) {
+                if ((err = snd_pcm_start(pcm)) < 0) return err;
+                continue;
+            }
+            err = snd_pcm_wait(pcm, PCM_MMAP_TIMEOUT_MS);
+            if (err < 0) return err;
+            if (err == 0) return -EIO;
+            continue;
+        }
+
+        // 有多少先传多少，mmap_begin 只给到缓冲区末尾，回绕的那部分下一圈再拿
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = want - done;
+        if (frames > (snd_pcm_uframes_t)avail) frames = avail;
+        if ((err = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames)) < 0) return err;
+
+        // 交错格式所有声道共用一块区域，step 是一帧的位数
+        char *ptr = (char *)areas[0].addr + areas[0].first / 8 + offset * (areas[0].step / 8);
+        fn(user, ptr, frames);
+
+        snd_pcm_sframes_t rc = snd_pcm_mmap_commit(pcm, offset, frames);
+        if (rc < 0) return rc;
+        if ((snd_pcm_uframes_t)rc != frames) return -EPIPE;
+        done += frames;
+    }
+    return done;
+}
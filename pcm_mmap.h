@@ -0,0 +1,35 @@
+#ifndef PCM_MMAP_H
+#define PCM_MMAP_H
+
+#include <alsa/asoundlib.h>
+#include "sample_fmt.h"
+
+// --- MMAP_INTERLEAVED 访问：直接读写驱动的 DMA 缓冲区 ---
+// readi/writei 要把数据从我们的缓冲区再拷一遍到驱动的缓冲区。
+// mmap 模式下 snd_pcm_mmap_begin 直接把那块内存交给我们：
+// 播放时从音源直接拷进去，录音时从里面直接拷到下一站 (比如写盘的环)，
+// 中间不再需要自己的周期缓冲区。
+// 不是所有设备/插件都支持 mmap，所以设置访问方式时先试，不行就退回 RW。
+
+// 在 snd_pcm_hw_params() 之前调用。want_mmap 时先试 MMAP_INTERLEAVED，
+// 不支持就用 RW_INTERLEAVED。返回 1 = mmap，0 = RW，-1 = 两个都不行
+int pcm_set_access(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, int want_mmap);
+
+// --- 采样格式协商 ---
+// 也在 snd_pcm_hw_params() 之前调用。先试 want (一般是文件的格式，一样就不用转换)，
+// 设备不支持就按 s32 > s24_3 > f32 > s16 挑一个它支持的，返回最后定下的格式，
+// 一个都不支持返回 SF_UNKNOWN
+sf_format pcm_set_format(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, sf_format want);
+// sf_format -> ALSA 的格式 (都是小端)
+snd_pcm_format_t pcm_alsa_format(sf_format f);
+
+// DMA 区域里连续的一段：ptr 指向第一帧，frames 帧，调用方自己记住读/写到哪了
+typedef void (*pcm_area_fn)(void *user, void *ptr, snd_pcm_uframes_t frames);
+
+// 等到至少 want 帧可读/可写，然后一段段交给 fn (缓冲区回绕时会分两次)，提交
+// 返回传了多少帧 (正常就是 want)，出错返回负的 ALSA 错误码，
+// -EPIPE / -ESTRPIPE 和 readi/writei 一样由调用方恢复
+// 设备已经 prepare 但还没开始时：录音直接 start，播放等缓冲区填满再 start
+snd_pcm_sframes_t pcm_mmap_xfer(snd_pcm_t *pcm, snd_pcm_uframes_t want, pcm_area_fn fn, void *user);
+
+#endif
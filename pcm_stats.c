@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <pthread.h>
+#include "pcm_stats.h"
+
+static const char *tool_name = "pcm";
+static pcm_stream_stats streams[PCM_STATS_MAX_STREAMS];
+static atomic_int nstreams;
+static unsigned long long start_ns;
+
+static pthread_t reporter;
+static int reporter_running;
+static atomic_int stopping;
+static FILE *json_fp;
+static int json_interval_ms;
+
+void pcm_stats_init(const char *tool) {
+    sigset_t set;
+
+    tool_name = tool;
+    start_ns = pcm_stats_now();
+
+    // 所有线程都屏蔽 SIGUSR1 (新线程继承这个掩码)，只有报告线程用 sigtimedwait 收，
+    // 不需要信号处理函数，也就不用操心在处理函数里能不能 printf
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+pcm_stream_stats *pcm_stats_stream(const char *name, unsigned int rate) {
+    int i = atomic_load(&nstreams);
+    if (i >= PCM_STATS_MAX_STREAMS) return NULL;
+
+    pcm_stream_stats *s = &streams[i];
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->rate = rate;
+    atomic_init(&s->delay_min, LONG_MAX);
+    atomic_init(&s->delay_max, LONG_MIN);
+    atomic_store(&nstreams, i + 1);
+    return s;
+}
+
+void pcm_stats_sample(pcm_stream_stats *s, snd_pcm_t *pcm) {
+    snd_pcm_sframes_t avail, delay;
+
+    if (s->wakes % PCM_STATS_DELAY_EVERY != 0) return;
+    if (snd_pcm_avail_delay(pcm, &avail, &delay) < 0) return;
+
+    PCM_STATS_ADD(s->delay_samples, 1);
+    PCM_STATS_ADD(s->delay_sum, delay);
+    PCM_STATS_ADD(s->avail_sum, avail);
+    if (delay < atomic_load_explicit(&s->delay_min, memory_order_relaxed))
+        atomic_store_explicit(&s->delay_min, delay, memory_order_relaxed);
+    if (delay > atomic_load_explicit(&s->delay_max, memory_order_relaxed))
+        atomic_store_explicit(&s->delay_max, delay, memory_order_relaxed);
+}
+
+#define LOAD(field) atomic_load_explicit(&(field), memory_order_relaxed)
+
+void pcm_stats_dump(FILE *out) {
+    int n = atomic_load(&nstreams);
+
+    fprintf(out, "[%s] 运行 %.1f 秒\n", tool_name, (pcm_stats_now() - start_ns) / 1e9);
+    for (int i = 0; i < n; i++) {
+        pcm_stream_stats *s = &streams[i];
+        unsigned long calls = LOAD(s->calls);
+        unsigned long samples = LOAD(s->delay_samples);
+
+        fprintf(out, "  %-8s xrun %lu, suspend %lu, %lu 次调用 / %lu 帧, 调用平均 %.1f us 最长 %.1f us\n",
+                s->name, LOAD(s->xruns), LOAD(s->suspends), calls, LOAD(s->frames),
+                calls ? LOAD(s->io_ns) / 1e3 / calls : 0.0, LOAD(s->io_max_ns) / 1e3);
+        if (samples) {
+            double avg = (double)LOAD(s->delay_sum) / samples;
+            fprintf(out, "           delay 平均 %.0f 帧 (%.2f ms), 范围 %ld ~ %ld, avail 平均 %.0f 帧\n",
+                    avg, s->rate ? avg * 1000 / s->rate : 0.0, LOAD(s->delay_min), LOAD(s->delay_max),
+                    (double)LOAD(s->avail_sum) / samples);
+        }
+
+        // 只打印有数的那一段桶
+        int lo = -1, hi = -1;
+        for (int b = 0; b < PCM_STATS_BUCKETS; b++) {
+            if (LOAD(s->wake_hist[b]) == 0) continue;
+            if (lo < 0) lo = b;
+            hi = b;
+        }
+        if (lo < 0) continue;
+        unsigned long wakes = 0;
+        for (int b = lo; b <= hi; b++) wakes += LOAD(s->wake_hist[b]);
+        double mean = (double)LOAD(s->wake_sum_us) / wakes;
+        double var = (double)LOAD(s->wake_sq_us) / wakes - mean * mean;
+        fprintf(out, "           唤醒间隔 平均 %.1f us, 抖动 (标准差) %.1f us, 最长 %llu us\n",
+                mean, var > 0 ? sqrt(var) : 0.0, LOAD(s->wake_max_us));
+        fprintf(out, "           唤醒间隔:");
+        for (int b = lo; b <= hi; b++) {
+            if (b == PCM_STATS_BUCKETS - 1) fprintf(out, " >=%luus:%lu", 1UL << b, LOAD(s->wake_hist[b]));
+            else fprintf(out, " <%luus:%lu", 2UL << b, LOAD(s->wake_hist[b]));
+        }
+        fprintf(out, "\n");
+    }
+}
+
+// 一行一个 JSON 对象，方便 jq / 脚本直接读
+static void write_json(FILE *fp) {
+    int n = atomic_load(&nstreams);
+
+    fprintf(fp, "{\"tool\":\"%s\",\"t\":%.3f,\"streams\":[", tool_name,
+            (pcm_stats_now() - start_ns) / 1e9);
+    for (int i = 0; i < n; i++) {
+        pcm_stream_stats *s = &streams[i];
+        unsigned long samples = LOAD(s->delay_samples);
+
+        fprintf(fp, "%s{\"name\":\"%s\",\"rate\":%u,\"xruns\":%lu,\"suspends\":%lu,"
+                    "\"calls\":%lu,\"frames\":%lu,\"io_ns\":%llu,\"io_max_ns\":%llu,",
+                i ? "," : "", s->name, s->rate, LOAD(s->xruns), LOAD(s->suspends),
+                LOAD(s->calls), LOAD(s->frames), LOAD(s->io_ns), LOAD(s->io_max_ns));
+        if (samples) {
+            fprintf(fp, "\"delay_avg\":%.1f,\"delay_min\":%ld,\"delay_max\":%ld,\"avail_avg\":%.1f,",
+                    (double)LOAD(s->delay_sum) / samples, LOAD(s->delay_min), LOAD(s->delay_max),
+                    (double)LOAD(s->avail_sum) / samples);
+        }
+        fprintf(fp, "\"wake_sum_us\":%llu,\"wake_sq_us\":%llu,\"wake_max_us\":%llu,",
+                LOAD(s->wake_sum_us), LOAD(s->wake_sq_us), LOAD(s->wake_max_us));
+        fprintf(fp, "\"wake_hist_us_log2\":[");
+        for (int b = 0; b < PCM_STATS_BUCKETS; b++)
+            fprintf(fp, "%s%lu", b ? "," : "", LOAD(s->wake_hist[b]));
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "]}\n");
+    fflush(fp);
+}
+
+// --- 报告线程：等 SIGUSR1，或者到点写一行 JSON ---
+static void *reporter_func(void *arg) {
+    (void)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    int wait_ms = json_fp ? json_interval_ms : 1000;
+    struct timespec ts = { wait_ms / 1000, (wait_ms % 1000) * 1000000L };
+
+    while (!atomic_load(&stopping)) {
+        int sig = sigtimedwait(&set, NULL, &ts);
+        if (atomic_load(&stopping)) break;
+        if (sig == SIGUSR1) pcm_stats_dump(stderr);
+        // 收到信号时也顺手写一行，间隔会稍微不均匀，但不丢数据
+        if (json_fp) write_json(json_fp);
+    }
+    return NULL;
+}
+
+int pcm_stats_start(const char *json_path, int interval_ms) {
+    if (json_path) {
+        json_fp = fopen(json_path, "a");
+        if (!json_fp) {
+            perror(json_path);
+            return -1;
+        }
+        json_interval_ms = interval_ms > 0 ? interval_ms : 1000;
+    }
+    atomic_store(&stopping, 0);
+    if (pthread_create(&reporter, NULL, reporter_func, NULL) != 0) {
+        fprintf(stderr, "无法创建统计线程\n");
+        return -1;
+    }
+    reporter_running = 1;
+    return 0;
+}
+
+void pcm_stats_stop(FILE *out) {
+    if (reporter_running) {
+        atomic_store(&stopping, 1);
+        pthread_kill(reporter, SIGUSR1); // 叫醒 sigtimedwait
+        pthread_join(reporter, NULL);
+        reporter_running = 0;
+    }
+    if (json_fp) {
+        write_json(json_fp);
+        fclose(json_fp);
+        json_fp = NULL;
+    }
+    if (out) pcm_stats_dump(out);
+}
@@ -0,0 +1,110 @@
+#ifndef PCM_STATS_H
+#define PCM_STATS_H
+
+#include <stdatomic.h>
+#include <time.h>
+#include <alsa/asoundlib.h>
+
+// --- 所有 ALSA 小工具共用的 xrun / 计时统计 ---
+// 每个流 (录音/播放) 一份计数器。热路径上只有几次 relaxed 原子加法和一次
+// clock_gettime，可以一直开着。打印、写 JSON 都在后台的报告线程里做：
+//   * 收到 SIGUSR1 时把当前统计打到 stderr
+//   * 指定了 JSON 文件时每隔一段时间追加一行
+//   * pcm_stats_stop() 时打印最终结果
+#define PCM_STATS_MAX_STREAMS 4
+// 唤醒间隔直方图：第 b 个桶是 [2^b, 2^(b+1)) 微秒，最后一个桶装所有更长的
+#define PCM_STATS_BUCKETS 20
+// 每隔多少次唤醒采一次 snd_pcm_avail_delay (它要进内核，不能每个周期都调)
+#define PCM_STATS_DELAY_EVERY 16
+
+typedef struct {
+    const char *name;
+    unsigned int rate;
+
+    atomic_ulong xruns;         // 录音 overrun / 播放 underrun (EPIPE)
+    atomic_ulong suspends;      // ESTRPIPE
+    atomic_ulong calls;         // readi/writei 调用次数
+    atomic_ulong frames;        // 实际读写的帧数
+    atomic_ullong io_ns;        // 花在 readi/writei 里的总时间
+    atomic_ullong io_max_ns;
+
+    atomic_ulong wake_hist[PCM_STATS_BUCKETS];
+    atomic_ullong wake_sum_us;  // 唤醒间隔的和、平方和、最大值：算平均和抖动 (标准差)
+    atomic_ullong wake_sq_us;
+    atomic_ullong wake_max_us;
+    atomic_ulong delay_samples;
+    atomic_llong delay_sum;     // 帧
+    atomic_long delay_min;
+    atomic_long delay_max;
+    atomic_llong avail_sum;
+
+    // 以下只有热路径那个线程自己碰
+    unsigned long long last_wake_ns;
+    unsigned long wakes;
+} pcm_stream_stats;
+
+static inline unsigned long long pcm_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define PCM_STATS_ADD(field, v) atomic_fetch_add_explicit(&(field), (v), memory_order_relaxed)
+
+// 线程被唤醒处理一个周期时调用，记下和上一次唤醒的间隔
+static inline void pcm_stats_wakeup(pcm_stream_stats *s) {
+    unsigned long long now = pcm_stats_now();
+    if (s->last_wake_ns) {
+        unsigned long long us = (now - s->last_wake_ns) / 1000;
+        int b = 63 - __builtin_clzll(us | 1);
+        if (b >= PCM_STATS_BUCKETS) b = PCM_STATS_BUCKETS - 1;
+        PCM_STATS_ADD(s->wake_hist[b], 1);
+        PCM_STATS_ADD(s->wake_sum_us, us);
+        PCM_STATS_ADD(s->wake_sq_us, us * us);
+        if (us > atomic_load_explicit(&s->wake_max_us, memory_order_relaxed))
+            atomic_store_explicit(&s->wake_max_us, us, memory_order_relaxed);
+    }
+    s->last_wake_ns = now;
+    s->wakes++;
+}
+
+// 故意停下来 (暂停) 之后调用：下一次唤醒不和停之前的那次比
+static inline void pcm_stats_wake_reset(pcm_stream_stats *s) {
+    s->last_wake_ns = 0;
+}
+
+// readi/writei 前后各调一次；rc 是它们的返回值
+static inline unsigned long long pcm_stats_io_begin(void) {
+    return pcm_stats_now();
+}
+
+static inline void pcm_stats_io_end(pcm_stream_stats *s, unsigned long long t0, long rc) {
+    unsigned long long ns = pcm_stats_now() - t0;
+    PCM_STATS_ADD(s->calls, 1);
+    PCM_STATS_ADD(s->io_ns, ns);
+    if (rc > 0) PCM_STATS_ADD(s->frames, rc);
+    // 每个流只有一个线程写，最大值不用 CAS
+    if (ns > atomic_load_explicit(&s->io_max_ns, memory_order_relaxed))
+        atomic_store_explicit(&s->io_max_ns, ns, memory_order_relaxed);
+}
+
+// 遇到 xrun 时调用 (err 是 -EPIPE 或 -ESTRPIPE)
+static inline void pcm_stats_xrun(pcm_stream_stats *s, int err) {
+    if (err == -ESTRPIPE) PCM_STATS_ADD(s->suspends, 1);
+    else PCM_STATS_ADD(s->xruns, 1);
+}
+
+// 隔几个周期采一次延迟/可用帧数 (内部自己数，每个周期都调就行)
+void pcm_stats_sample(pcm_stream_stats *s, snd_pcm_t *pcm);
+
+// 在创建任何线程之前调用：屏蔽 SIGUSR1，交给报告线程用 sigtimedwait 等
+void pcm_stats_init(const char *tool);
+// 登记一个流，返回它的计数器
+pcm_stream_stats *pcm_stats_stream(const char *name, unsigned int rate);
+// 启动报告线程。json_path 可以为 NULL (只响应 SIGUSR1)
+int pcm_stats_start(const char *json_path, int interval_ms);
+// 停掉报告线程，最后打印一次 (打到 out)
+void pcm_stats_stop(FILE *out);
+void pcm_stats_dump(FILE *out);
+
+#endif
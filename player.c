@@ -2,27 +2,78 @@
 #include <stdlib.h>
 #include <alsa/asoundlib.h>
 #include <ncurses.h>
+#include <string.h>
+#include <unistd.h>
 #include <pthread.h>  // 引入多线程库
+#include <time.h>
+#include "wav_source.h"
+#include "mixer.h"
+#include "synth.h"
+#include "tui.h"
+#include "pcm_stats.h"
+#include "pcm_mmap.h"
+#include "pcm_ctl.h"
+#include "rt.h"
 
 // --- 全局变量 (用于线程间通信) ---
-volatile int keep_running = 1; // 控制程序是否退出
-volatile int is_paused = 0;    // 控制暂停/播放
+volatile int keep_running = 1; // 界面循环还要不要转
+int is_paused = 0;             // 界面上显示的状态，真正的命令走 ctl
+pcm_ctl ctl;                   // 界面 -> 音频线程：暂停/继续/退出，音频线程睡在它和声卡上
+pcm_stream_stats *play_stats;  // 欠载次数、写声卡耗时 (界面上也显示)
+int use_mmap = 0;              // -m：试着直接往 DMA 缓冲区里写
+const char *access_name = "";  // 实际用上的访问方式
+char format_name[32];          // 文件格式 (和声卡不一样时是 "文件->声卡")
+rt_opts rt;                    // -F：音频线程用实时优先级、绑核、锁内存
+mixer mix;                     // 要放的几路文件 (命令行给，默认只有 output.wav)
+
+// --- 从映射的文件拷到声卡要的地方 (mmap 时是 DMA 区域，否则是周期缓冲区) ---
+// 格式一样就是一次 memcpy，不一样顺手转换 (变窄时加抖动)
+typedef struct {
+    const char *src;
+    size_t frame_bytes;        // 文件里一帧的字节数
+    int channels;
+    sf_format src_fmt, dev_fmt;
+    sf_dither *dither;
+} play_cursor;
+
+static void copy_to_area(void *user, void *ptr, snd_pcm_uframes_t frames) {
+    play_cursor *c = (play_cursor *)user;
+    if (c->src_fmt == c->dev_fmt)
+        memcpy(ptr, c->src, frames * c->frame_bytes);
+    else
+        sf_convert(ptr, c->dev_fmt, c->src, c->src_fmt, frames * c->channels, c->dither);
+    c->src += frames * c->frame_bytes;
+}
+
+// 混音结果 (float) 转成声卡格式时要不要抖动：16/24 位整数 float 能原样表示，
+// 声卡不比文件窄的话转回去一点不差；s32 (float 只有 24 位尾数)、f32 文件，
+// 或者声卡比文件窄，都要抖动
+static int mix_needs_dither(const mixer *m, sf_format dev_fmt) {
+    if (dev_fmt == SF_F32) return 0;
+    for (int i = 0; i < m->nstreams; i++) {
+        sf_format f = m->streams[i].src.sample_fmt;
+        if ((f != SF_S16 && f != SF_S24_3) || sf_bits(dev_fmt) < sf_bits(f)) return 1;
+    }
+    return 0;
+}
 
 // --- 音频线程工人：专门负责干脏活累活 ---
+// 文件由读文件线程预先转好放在各路的环里，这里每个周期只做混音和写声卡。
+// 只有一路、不调音量、从头放的时候不经过混音器，和以前一样直接从映射的文件拷到声卡
+// (格式一样就是原样 memcpy，s32 文件也一位不差；要变窄时 sf_convert 加抖动)
 void *audio_thread_func(void *arg) {
+    mixer *mix = (mixer *)arg;
     int rc;
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *params;
-    unsigned int val = 44100;
+    unsigned int val = mix->rate;
     int dir;
     snd_pcm_uframes_t frames = 32;
-    char *buffer;
-    int size;
-
-    // 打开刚才录好的 output.wav (确保你有这个文件，或者改名)
-    FILE *fp = fopen("output.wav", "rb");
-    if (!fp) return NULL;
-    fseek(fp, 44, SEEK_SET); // 跳过 WAV 头
+    sf_dither dither;
+    float *acc = NULL;
+    char *conv = NULL;
+    mix_stream *solo = mix->nstreams == 1 && mix->streams[0].gain == 1.0f && mix->streams[0].start == 0
+                       ? &mix->streams[0] : NULL;
 
     // 打开 ALSA 设备
     rc = snd_pcm_open(&handle, "default", SND_PCM_STREAM_PLAYBACK, 0);
@@ -31,99 +82,297 @@ void *audio_thread_func(void *arg) {
     // 设置参数 (快速简写版)
     snd_pcm_hw_params_alloca(&params);
     snd_pcm_hw_params_any(handle, params);
-    snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE);
-    snd_pcm_hw_params_set_channels(handle, params, 2);
+    int mmap_mode = pcm_set_access(handle, params, use_mmap);
+    access_name = mmap_mode == 1 ? "mmap" : "rw";
+    // 尽量让声卡直接吃 (第一路) 文件的格式，不行再用它支持的
+    sf_format dev_fmt = pcm_set_format(handle, params, mix->src_fmt);
+    snd_pcm_hw_params_set_channels(handle, params, mix->channels);
     snd_pcm_hw_params_set_rate_near(handle, params, &val, &dir);
-    snd_pcm_hw_params(handle, params);
+    if (dev_fmt == SF_UNKNOWN || (rc = snd_pcm_hw_params(handle, params)) < 0) {
+        fprintf(stderr, "无法设置声卡参数 (%s, %d 声道)\n", sf_name(mix->src_fmt), mix->channels);
+        snd_pcm_close(handle);
+        return NULL;
+    }
+    if (dev_fmt == mix->src_fmt)
+        snprintf(format_name, sizeof(format_name), "%s", sf_name(dev_fmt));
+    else
+        snprintf(format_name, sizeof(format_name), "%s->%s", sf_name(mix->src_fmt), sf_name(dev_fmt));
 
-    // 准备缓冲区
+    // 一个周期的混音结果 (float，直通时不要)；不是 mmap、格式又和声卡不一样的话，还要一个转换后的中转
     snd_pcm_hw_params_get_period_size(params, &frames, &dir);
-    size = frames * 4;
-    buffer = (char *) malloc(size);
+    sf_dither_init(&dither, 1);
+    sf_format feed_fmt = solo ? mix->src_fmt : SF_F32; // 往声卡送之前手里的数据是什么格式
+    size_t acc_bytes = solo ? 0 : frames * mix->channels * sizeof(float);
+    size_t conv_bytes = frames * mix->channels * sf_bytes(dev_fmt);
+    int need_conv = dev_fmt != feed_fmt && mmap_mode != 1;
+    if (acc_bytes) acc = malloc(acc_bytes);
+    if (need_conv) conv = malloc(conv_bytes);
+    if ((acc_bytes && !acc) || (need_conv && !conv)) {
+        fprintf(stderr, "周期缓冲区分配失败\n");
+        snd_pcm_close(handle);
+        free(acc);
+        free(conv);
+        return NULL;
+    }
+    // 直通时 sf_convert 只在变窄时才用抖动，给它就行
+    sf_dither *dith = solo || mix_needs_dither(mix, dev_fmt) ? &dither : NULL;
+
+    // 读文件线程在切实时之前开，不继承实时优先级
+    if (!solo && mixer_start(mix, 1) < 0) {
+        snd_pcm_close(handle);
+        free(acc);
+        free(conv);
+        return NULL;
+    }
+
+    // 开始放之前：缓冲区先摸一遍，要实时就现在切过去 (整个 WAV 映射不锁，照常换页)
+    if (acc) rt_prefault(acc, acc_bytes);
+    if (conv) rt_prefault(conv, conv_bytes);
+    rt_enter(&rt, "player");
+    for (int i = 0; i < mix->nstreams; i++) rt_unlock(mix->streams[i].src.map, mix->streams[i].src.map_len);
 
     // --- 音频循环 ---
-    while (keep_running) {
-        if (is_paused) {
-            // 如果暂停了，就歇会儿 (睡100毫秒)，别占 CPU
-            usleep(100000);
-            continue;
+    // 只在一个地方睡：声卡能写一个周期了，或者界面发来了命令
+    // 暂停时声卡停住，这里只等命令，一次都不会空醒
+    int paused = 0;
+    while (1) {
+        int ready;
+        int cmd = pcm_ctl_wait(&ctl, paused ? NULL : handle, &ready);
+        if (cmd < 0 || (cmd & PCM_CTL_QUIT)) break;
+        if ((cmd & PCM_CTL_PAUSE) && !paused) {
+            if ((rc = pcm_pause(handle, 1)) < 0) fprintf(stderr, "暂停失败: %s\n", snd_strerror(rc));
+            paused = 1;
+        } else if ((cmd & PCM_CTL_RESUME) && paused) {
+            if ((rc = pcm_pause(handle, 0)) < 0) fprintf(stderr, "继续播放失败: %s\n", snd_strerror(rc));
+            pcm_stats_wake_reset(play_stats); // 停着的那段不算抖动
+            paused = 0;
         }
+        if (cmd) pcm_ctl_ack(&ctl);
+        if (paused || !ready) continue;
 
-        // 读文件
-        if (fread(buffer, 1, size, fp) == 0) {
-            // 读完了，从头循环播放
-            fseek(fp, 44, SEEK_SET);
-            continue;
+        const void *data;
+        size_t n = frames;
+        if (solo) {
+            // 取下一个周期 (只是个指针，最后一段可能不满一个周期)
+            data = wav_source_next(&solo->src, &n);
+            if (!data) {
+                // 读完了，从头循环播放；倒回开头也读不出来 (比如坏了的 .lac) 就不放了
+                if (solo->since_rewind == 0) {
+                    solo->unreadable = 1;
+                    break;
+                }
+                wav_source_rewind(&solo->src);
+                solo->since_rewind = 0;
+                continue;
+            }
+            solo->since_rewind += n;
+        } else {
+            // 混一个周期 (各路都放完了就是静音，第一路循环所以一般不会)
+            mixer_render(mix, acc, frames);
+            data = acc;
         }
 
-        // 写声卡
-        rc = snd_pcm_writei(handle, buffer, frames);
-        if (rc == -EPIPE) {
+        // 写声卡 (poll 说能写了，不满一个周期的写不会阻塞)
+        play_cursor c = { (const char *)data, mix->channels * sf_bytes(feed_fmt), mix->channels, feed_fmt, dev_fmt, dith };
+        unsigned long long t0 = pcm_stats_io_begin();
+        if (mmap_mode == 1) {
+            rc = pcm_mmap_xfer(handle, n, copy_to_area, &c);
+        } else if (conv) {
+            copy_to_area(&c, conv, n);
+            rc = snd_pcm_writei(handle, conv, n);
+        } else {
+            rc = snd_pcm_writei(handle, data, n);
+        }
+        pcm_stats_io_end(play_stats, t0, rc);
+        pcm_stats_wakeup(play_stats);
+        if (rc == -EPIPE || rc == -ESTRPIPE) {
+            pcm_stats_xrun(play_stats, rc);
             snd_pcm_prepare(handle);
+        } else {
+            pcm_stats_sample(play_stats, handle);
         }
     }
 
-    // 清理工作
-    fclose(fp);
-    snd_pcm_drain(handle);
+    // 清理工作：要退出就别把缓冲区放完了，直接停
+    snd_pcm_drop(handle);
     snd_pcm_close(handle);
-    free(buffer);
+    free(acc);
+    free(conv);
     return NULL;
 }
 
+// --- -B：不开声卡，看一个核能同时混多少路 ---
+// 路数从 1 翻倍往上加 (文件不够就轮着用)，每次混 seconds 秒：读文件转 float、混音、
+// 转 16 位全在这一个线程里做，按这个线程的 CPU 时间算比实时快多少倍。
+// 混音的开销和路数成正比，最多那一档的 "路数 x 倍数" 就是一个核的上限
+#define BENCH_PERIOD 256
+
+static int run_mix_bench(char **specs, int nspecs, double seconds) {
+    static mixer m; // 64 路的结构不小，不放栈上
+    double capacity = 0;
+    int top = 0;
+
+    printf("# 混音基准 isa=%s，每档混 %.1f 秒，周期 %d 帧\n", synth_isa(), seconds, BENCH_PERIOD);
+    printf("# %4s %12s %18s\n", "路数", "倍实时", "每路 CPU (%)");
+    for (int n = 1; n <= MIX_MAX_STREAMS; n *= 2) {
+        mixer_init(&m);
+        for (int i = 0; i < n; i++) {
+            if (mixer_add_spec(&m, specs[i % nspecs], 1) < 0) {
+                mixer_free(&m);
+                return 1;
+            }
+        }
+        if (mixer_start(&m, 0) < 0) {
+            mixer_free(&m);
+            return 1;
+        }
+
+        size_t samples = BENCH_PERIOD * m.channels;
+        float *acc = malloc(samples * sizeof(float));
+        short *out = malloc(samples * sizeof(short));
+        sf_dither dither;
+        sf_dither_init(&dither, 1);
+        size_t total = seconds * m.rate;
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+        for (size_t done = 0; done < total; done += BENCH_PERIOD) {
+            mixer_render(&m, acc, BENCH_PERIOD);
+            sf_from_f32(out, SF_S16, acc, samples, &dither);
+            mixer_fill(&m);
+        }
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+
+        double cpu = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        double audio = (double)total / m.rate;
+        double speed = cpu > 0 ? audio / cpu : 0;
+        printf("%6d %12.1f %18.4f\n", n, speed, 100.0 * cpu / audio / n);
+        capacity = n * speed;
+        top = n;
+
+        unsigned long starved = atomic_load(&m.starved);
+        if (starved) printf("#   欠数据 %lu 帧 (不该发生)\n", starved);
+        free(acc);
+        free(out);
+        mixer_free(&m);
+    }
+    printf("# 按 %d 路那一档推算，一个核大约能同时混 %.0f 路 (%u Hz %d 声道)\n", top, capacity, m.rate, m.channels);
+    return 0;
+}
+
 // --- 主线程：负责界面和指挥 ---
-int main() {
+int main(int argc, char *argv[]) {
     pthread_t thread_id;
+    int fps = 10; // 只有一根进度条，不用刷太快
+    const char *json_path = NULL;
+    double bench_seconds = 0;
+    int opt;
+
+    pcm_stats_init("player");
+    rt_default(&rt);
+
+    while ((opt = getopt(argc, argv, "f:J:mF:B:h")) != -1) {
+        switch (opt) {
+        case 'f': fps = atoi(optarg); break;
+        case 'J': json_path = optarg; break;
+        case 'm': use_mmap = 1; break;
+        case 'F':
+            if (rt_parse(&rt, optarg) < 0) return 1;
+            break;
+        case 'B': bench_seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "用法: %s [-f 帧率] [-J 文件] [-m] [-F 优先级[:CPU]] [-B 秒数] [文件[:增益dB[:起始秒]] ...]\n"
+                            "  不给文件就放 output.wav。给好几个就一起混：第一个当背景循环放，\n"
+                            "  其余的各放一遍，比如 %s bgm.wav:-6 news.wav:0:2.5\n"
+                            "  运行时按 s 显示渲染统计\n"
+                            "  -J 每秒往文件里追加一行 JSON 统计 (kill -USR1 打印到 stderr)\n"
+                            "  -m 用 mmap 直接写声卡的 DMA 缓冲区 (不支持时自动退回 writei)\n"
+                            "  -F 实时模式：音频线程 SCHED_FIFO (rr:优先级 用 SCHED_RR)，可以绑到一个 CPU，锁内存\n"
+                            "  -B 不开声卡，测一个核能同时混多少路 (每档混这么多秒)\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    char *default_spec = "output.wav";
+    char **specs = optind < argc ? argv + optind : &default_spec;
+    int nspecs = optind < argc ? argc - optind : 1;
+    if (bench_seconds > 0) return run_mix_bench(specs, nspecs, bench_seconds);
+
+    mixer_init(&mix);
+    for (int i = 0; i < nspecs; i++) {
+        if (mixer_add_spec(&mix, specs[i], i == 0) < 0) return 1;
+    }
+    mixer_describe(&mix, stdout);
+    if (pcm_ctl_init(&ctl) < 0) return 1;
+    // 流要在统计线程开始之前登记好，之后它会不加锁地遍历
+    play_stats = pcm_stats_stream("playback", mix.rate);
+    if (pcm_stats_start(json_path, 1000) < 0) return 1;
 
     // 1. 启动音频线程
     // pthread_create(线程ID指针, 属性, 线程函数, 参数)
-    pthread_create(&thread_id, NULL, audio_thread_func, NULL);
+    pthread_create(&thread_id, NULL, audio_thread_func, &mix);
 
-    // 2. 初始化 Ncurses 界面
-    initscr();
-    cbreak();
-    noecho();
-    curs_set(0);
-    timeout(100); // 关键！getch 只等待 100ms，超时就返回 (防止彻底卡死)
+    // 2. 初始化界面：getch 最多等到下一帧，刷新节奏由帧率决定
+    tui ui;
+    tui_init(&ui, fps);
 
     // 3. UI 循环
+    int bar_len = 0;
     while (keep_running) {
-        // --- 画图 ---
-        clear(); // 清屏
-        box(stdscr, 0, 0); // 画框框
-
-        mvprintw(2, 4, "=== SUPER COOL ALSA PLAYER ===");
-        mvprintw(4, 4, "Status: %s", is_paused ? "[ PAUSED ]" : "[ PLAYING ]");
-        mvprintw(6, 4, "Key Controls:");
-        mvprintw(7, 6, "[Space] : Pause / Resume");
-        mvprintw(8, 6, "[ q ]   : Quit");
-        
-        // 画个假装的进度条（让它动起来）
-        static int bar_len = 0;
-        if (!is_paused) bar_len = (bar_len + 1) % 40;
-        mvprintw(10, 4, "[");
-        for(int i=0; i<40; i++) {
-            if (i < bar_len) addch('=');
-            else addch(' ');
-        }
-        addch(']');
-
-        refresh(); // 提交渲染
-
         // --- 处理按键 ---
-        int ch = getch();
+        int ch = tui_getch(&ui);
         if (ch == 'q') {
-            keep_running = 0; // 通知音频线程退出
+            keep_running = 0;
+            pcm_ctl_send(&ctl, PCM_CTL_QUIT); // 通知音频线程退出，它马上就醒
         } else if (ch == ' ') {
             is_paused = !is_paused; // 切换暂停状态
+            pcm_ctl_send(&ctl, is_paused ? PCM_CTL_PAUSE : PCM_CTL_RESUME);
+        } else if (ch == 's') {
+            ui.overlay = !ui.overlay;
+            if (!ui.overlay) tui_invalidate(&ui);
+        } else if (ch == KEY_RESIZE) {
+            tui_invalidate(&ui);
+        }
+
+        if (!tui_frame_due(&ui)) continue;
+
+        // --- 画图 (只动变了的地方) ---
+        if (tui_begin(&ui)) {
+            box(stdscr, 0, 0); // 画框框
+            mvprintw(2, 4, "=== SUPER COOL ALSA PLAYER ===");
+            mvprintw(6, 4, "Key Controls:");
+            mvprintw(7, 6, "[Space] : Pause / Resume");
+            mvprintw(8, 6, "[ q ]   : Quit");
         }
+
+        tui_text(&ui, 0, 4, 4, "Status: %s  xrun %lu  %s %s", is_paused ? "[ PAUSED ]" : "[ PLAYING ]",
+                 play_stats ? atomic_load(&play_stats->xruns) : 0, access_name, format_name);
+
+        // 画个假装的进度条（让它动起来）
+        char bar[41];
+        if (!is_paused) bar_len = (bar_len + 1) % 40;
+        memset(bar, ' ', 40);
+        memset(bar, '=', bar_len);
+        bar[40] = 0;
+        tui_text(&ui, 1, 10, 4, "[%s]", bar);
+        tui_text(&ui, 2, 12, 4, "Streams: %d  clipped %lu  starved %lu", mix.nstreams,
+                 atomic_load(&mix.clipped), atomic_load(&mix.starved));
+
+        tui_finish(&ui); // 提交渲染
     }
 
     // 等待音频线程彻底结束
     pthread_join(thread_id, NULL);
     
     // 退出界面
-    endwin();
+    tui_end(&ui);
+    tui_report(&ui);
+    mixer_stop(&mix);
+    mixer_report(&mix, stdout);
+    mixer_free(&mix);
+    pcm_ctl_report(&ctl, stdout);
+    rt_report(&rt, stdout);
+    pcm_stats_stop(stdout);
+    pcm_ctl_destroy(&ctl);
     return 0;
 }
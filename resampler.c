@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "resampler.h"
+#include "synth.h"
+
+// 一个 vfloat 8 个抽头，RS_TAPS 个抽头就是 RS_TAPS / 8 个向量
+typedef float vfloat __attribute__((vector_size(8 * sizeof(float))));
+#define RS_VECS (RS_TAPS / 8)
+
+// 通带到输入/输出里较低那个奈奎斯特频率的多少 (剩下的留给过渡带)
+#define RS_CUTOFF 0.92
+#define RS_KAISER_BETA 8.0
+
+// 漂移跟踪：头一秒只量水位定目标；之后水位先过 0.2 秒的低通，
+// 再进 PI (kp 对应 2 秒左右的时间常数，ki = kp²/4 刚好不过冲)；
+// 锁定 5 秒之后才开始统计稳态抖动
+#define RS_SETTLE_SEC 1.0
+#define RS_LP_SEC 0.2
+#define RS_KP 0.5
+#define RS_KI (RS_KP * RS_KP / 4)
+#define RS_STEADY_SEC 5.0
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 第一类零阶修正贝塞尔函数，Kaiser 窗要用
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+// 系数表：第 p 行是输出点落在两个输入样本之间 p/RS_PHASES 处时的 RS_TAPS 个权重
+// 第 k 个抽头对应的输入样本离输出点 k - (RS_TAPS/2 - 1) - p/RS_PHASES 个样本
+static void build_coef(float *coef, double fc) {
+    double half = RS_TAPS / 2;
+    double norm = bessel_i0(RS_KAISER_BETA);
+
+    for (int p = 0; p <= RS_PHASES; p++) {
+        float *row = coef + p * RS_TAPS;
+        double sum = 0;
+        for (int k = 0; k < RS_TAPS; k++) {
+            double d = k - (half - 1) - (double)p / RS_PHASES;
+            double x = 2 * fc * d;
+            double sinc = fabs(x) < 1e-12 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double r = d / half;
+            double w = fabs(r) >= 1 ? 0 : bessel_i0(RS_KAISER_BETA * sqrt(1 - r * r)) / norm;
+            row[k] = 2 * fc * sinc * w;
+            sum += row[k];
+        }
+        // 每一行直流增益都归一，不同相位之间不会有音量起伏
+        for (int k = 0; k < RS_TAPS; k++) row[k] /= sum;
+    }
+}
+
+int resampler_init(resampler *rs, int channels, unsigned int in_rate, unsigned int out_rate, int max_in) {
+    memset(rs, 0, sizeof(*rs));
+    if (channels < 1 || channels > RS_MAX_CHANNELS || in_rate == 0 || out_rate == 0) return -1;
+
+    rs->channels = channels;
+    rs->in_rate = in_rate;
+    rs->out_rate = out_rate;
+    rs->nominal = (double)in_rate / out_rate;
+    rs->step = rs->nominal;
+    rs->cap = max_in + RS_TAPS * 2;
+
+    rs->coef = (float *)malloc(sizeof(float) * (RS_PHASES + 1) * RS_TAPS);
+    if (!rs->coef) return -1;
+    // 降采样时截止频率跟着输出的奈奎斯特走，防混叠
+    double fc = 0.5 * RS_CUTOFF * (out_rate < in_rate ? (double)out_rate / in_rate : 1.0);
+    build_coef(rs->coef, fc);
+
+    for (int c = 0; c < channels; c++) {
+        rs->hist[c] = (float *)malloc(sizeof(float) * rs->cap);
+        if (!rs->hist[c]) {
+            resampler_free(rs);
+            return -1;
+        }
+    }
+    rs->scratch = (float *)malloc(sizeof(float) * rs->cap * channels);
+    if (!rs->scratch) {
+        resampler_free(rs);
+        return -1;
+    }
+    sf_dither_init(&rs->dither, in_rate ^ out_rate);
+    resampler_reset(rs);
+    return 0;
+}
+
+void resampler_free(resampler *rs) {
+    free(rs->coef);
+    rs->coef = NULL;
+    free(rs->scratch);
+    rs->scratch = NULL;
+    for (int c = 0; c < RS_MAX_CHANNELS; c++) {
+        free(rs->hist[c]);
+        rs->hist[c] = NULL;
+    }
+}
+
+void resampler_reset(resampler *rs) {
+    // 开头垫半个滤波器长度的零，第一个输出点正好落在第一个输入样本上
+    rs->len = RS_TAPS / 2 - 1;
+    rs->pos = RS_TAPS / 2 - 1;
+    for (int c = 0; c < rs->channels; c++) memset(rs->hist[c], 0, sizeof(float) * rs->len);
+}
+
+// --- 内核：对每个输出帧插一次系数，所有声道共用，输出交错 float ---
+static inline __attribute__((always_inline))
+int kernel(resampler *rs, float *out, int max_out) {
+    const int ch = rs->channels;
+    double pos = rs->pos;
+    int n = 0;
+
+    while (n < max_out) {
+        int i = (int)pos;
+        if (i + RS_TAPS / 2 >= rs->len) break; // 右边的样本还没来
+        double pp = (pos - i) * RS_PHASES;
+        int ip = (int)pp;
+        float w = (float)(pp - ip);
+
+        const float *h0 = rs->coef + ip * RS_TAPS;
+        vfloat h[RS_VECS];
+        for (int v = 0; v < RS_VECS; v++) {
+            vfloat a, b;
+            memcpy(&a, h0 + v * 8, sizeof(vfloat));
+            memcpy(&b, h0 + RS_TAPS + v * 8, sizeof(vfloat));
+            h[v] = a + (b - a) * w;
+        }
+
+        for (int c = 0; c < ch; c++) {
+            const float *x = rs->hist[c] + i - (RS_TAPS / 2 - 1);
+            vfloat acc = {0};
+            for (int v = 0; v < RS_VECS; v++) {
+                vfloat xv;
+                memcpy(&xv, x + v * 8, sizeof(vfloat));
+                acc += h[v] * xv;
+            }
+            float sum = 0;
+            for (int k = 0; k < 8; k++) sum += acc[k];
+            out[n * ch + c] = sum;
+        }
+        pos += rs->step;
+        n++;
+    }
+    rs->pos = pos;
+    return n;
+}
+
+static int kernel_generic(resampler *rs, float *out, int max_out) {
+    return kernel(rs, out, max_out);
+}
+
+__attribute__((target("avx2")))
+static int kernel_avx2(resampler *rs, float *out, int max_out) {
+    return kernel(rs, out, max_out);
+}
+
+int resampler_process(resampler *rs, const void *in, sf_format in_fmt, int in_frames,
+                      void *out, sf_format out_fmt, int max_out) {
+    unsigned long long t0 = now_ns();
+    const int ch = rs->channels;
+    const int avx2 = strcmp(synth_isa(), "avx2") == 0;
+
+    if (rs->len + in_frames > rs->cap) {
+        rs->frames_dropped += in_frames;
+        return -1;
+    }
+
+    // 转成 float，再拆成每声道一条
+    float *dst[RS_MAX_CHANNELS];
+    for (int c = 0; c < ch; c++) dst[c] = rs->hist[c] + rs->len;
+    sf_to_f32(rs->scratch, in, in_fmt, (size_t)in_frames * ch);
+    sf_deinterleave(dst, rs->scratch, ch, in_frames);
+    rs->len += in_frames;
+
+    // 输出先落在 scratch 里，一段段转成目标格式
+    int n = 0;
+    while (n < max_out) {
+        int want = max_out - n < rs->cap ? max_out - n : rs->cap;
+        int got = avx2 ? kernel_avx2(rs, rs->scratch, want) : kernel_generic(rs, rs->scratch, want);
+        sf_from_f32((char *)out + (size_t)n * ch * sf_bytes(out_fmt), out_fmt,
+                    rs->scratch, (size_t)got * ch, &rs->dither);
+        n += got;
+        if (got < want) break;
+    }
+
+    // 已经用不到的输入挪掉，只留下一个输出点左边那半个滤波器
+    int drop = (int)rs->pos - (RS_TAPS / 2 - 1);
+    if (drop > 0) {
+        for (int c = 0; c < ch; c++)
+            memmove(rs->hist[c], rs->hist[c] + drop, sizeof(float) * (rs->len - drop));
+        rs->len -= drop;
+        rs->pos -= drop;
+    }
+
+    rs->frames_in += in_frames;
+    rs->frames_out += n;
+    rs->ns += now_ns() - t0;
+    return n;
+}
+
+void resampler_track(resampler *rs, double fill, double dt) {
+    rs->elapsed += dt;
+
+    // 刚启动：只量，头一秒的平均水位就是目标
+    if (rs->elapsed < RS_SETTLE_SEC) {
+        rs->settle_n++;
+        rs->target += (fill - rs->target) / rs->settle_n;
+        rs->fill_lp = rs->target;
+        return;
+    }
+
+    rs->fill_lp += (fill - rs->fill_lp) * dt / (RS_LP_SEC + dt);
+
+    // 水位偏高 = 输出攒多了，就让每个输出帧多吃点输入 (少出帧)，反之亦然
+    double err = (rs->fill_lp - rs->target) / rs->out_rate; // 秒
+    double integ = rs->integ + err * dt;
+    double corr = RS_KP * err + RS_KI * integ;
+    if (corr > RS_MAX_CORRECTION) corr = RS_MAX_CORRECTION;
+    else if (corr < -RS_MAX_CORRECTION) corr = -RS_MAX_CORRECTION;
+    else rs->integ = integ; // 顶到限幅就别再积分了，不然回来的时候会过冲
+
+    rs->correction = corr;
+    rs->step = rs->nominal * (1 + corr);
+
+    if (rs->elapsed < RS_SETTLE_SEC + RS_STEADY_SEC) return;
+    if (rs->fill_n == 0 || corr < rs->corr_min) rs->corr_min = corr;
+    if (rs->fill_n == 0 || corr > rs->corr_max) rs->corr_max = corr;
+    rs->fill_n++;
+    double delta = fill - rs->fill_mean;
+    rs->fill_mean += delta / rs->fill_n;
+    rs->fill_m2 += delta * (fill - rs->fill_mean);
+}
+
+void resampler_report(const resampler *rs) {
+    printf("重采样: %u -> %u Hz, %d 抽头 x %d 相位, %s\n",
+           rs->in_rate, rs->out_rate, RS_TAPS, RS_PHASES, synth_isa());
+    if (rs->frames_out > 0) {
+        double audio_sec = (double)rs->frames_out / rs->out_rate;
+        printf("  开销: 每声道 %.1f ns/采样, %.3f%% 单核\n",
+               (double)rs->ns / (rs->frames_out * rs->channels),
+               100.0 * rs->ns / 1e9 / audio_sec / rs->channels);
+    }
+    printf("  目标水位 %.0f 帧, 当前修正 %+.1f ppm\n", rs->target, rs->correction * 1e6);
+    if (rs->frames_dropped)
+        printf("  输入放不下扔掉了 %llu 帧 (%.1f ms)\n", rs->frames_dropped,
+               rs->frames_dropped * 1000.0 / rs->in_rate);
+    if (rs->fill_n > 1) {
+        double var = rs->fill_m2 / (rs->fill_n - 1);
+        printf("  稳态 (%lu 次采样): 水位平均 %.1f 帧, 方差 %.1f 帧² (标准差 %.1f 帧 = %.3f ms), "
+               "修正 %+.1f ~ %+.1f ppm\n",
+               rs->fill_n, rs->fill_mean, var, sqrt(var), sqrt(var) * 1000 / rs->out_rate,
+               rs->corr_min * 1e6, rs->corr_max * 1e6);
+    } else {
+        printf("  运行时间太短，还没进入稳态 (要 %.0f 秒以上)\n", RS_SETTLE_SEC + RS_STEADY_SEC);
+    }
+}
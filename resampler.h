@@ -0,0 +1,71 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "sample_fmt.h"
+
+// --- 多相滤波重采样 + 时钟漂移跟踪 ---
+// 录音和播放不在同一个时钟上 (两个 USB 声卡之类) 时，哪怕标称采样率一样，
+// 实际也会差个几十上百 ppm，回声机跑久了播放端不是慢慢饿死就是慢慢撑爆。
+// 这里在录音和播放之间插一级重采样：
+//   * 带限插值：Kaiser 窗 sinc，RS_TAPS 个抽头，预先算好 RS_PHASES 个相位的系数，
+//     两个相邻相位之间再线性插一下，所以比例可以是任意实数、还能随时微调
+//   * 内层是 RS_TAPS 点点积，用向量扩展写，默认 SSE，CPU 支持就走 avx2
+//   * 每个周期把 "播放端还有多少没放完" 报给它，低通后用 PI 控制器微调比例，
+//     让这个水位稳定在刚启动时的位置
+#define RS_TAPS 64
+#define RS_PHASES 256
+#define RS_MAX_CHANNELS 8
+// 比例最多在标称值上修正多少 (0.5%，正常时钟偏差远小于这个)
+#define RS_MAX_CORRECTION 0.005
+
+typedef struct {
+    int channels;
+    unsigned int in_rate, out_rate;
+    double nominal;         // in_rate / out_rate：每输出一帧输入前进多少
+    double step;            // 实际用的，nominal * (1 + correction)
+    double correction;
+
+    float *coef;            // (RS_PHASES + 1) * RS_TAPS，最后一行给相位插值用
+    float *hist[RS_MAX_CHANNELS];   // 每个声道一条，还没用完的输入 (float，满刻度 ±1)
+    float *scratch;         // 交错 float 的中转：输入转成 float、输出转回目标格式
+    int cap;
+    int len;
+    double pos;             // 下一个输出帧落在 hist 的哪个位置
+    sf_dither dither;       // 输出变窄 (比如回到 16 位) 时用
+
+    // 漂移跟踪
+    double fill_lp;         // 低通后的水位 (帧)
+    double target;          // 要稳住的水位，启动后头一秒的平均值
+    double integ;           // PI 的积分项
+    double elapsed;         // 跟踪了多久 (秒)
+    unsigned long settle_n;
+    double corr_min, corr_max;
+
+    // 统计：稳态水位的均值/方差 (Welford)，进入稳态后才开始记
+    unsigned long fill_n;
+    double fill_mean, fill_m2;
+
+    unsigned long long ns;  // 花在重采样上的时间
+    unsigned long long frames_in, frames_out;
+    unsigned long long frames_dropped;  // 历史缓冲放不下、整段扔掉的输入帧
+} resampler;
+
+// max_in：一次最多喂多少帧输入
+int resampler_init(resampler *rs, int channels, unsigned int in_rate, unsigned int out_rate, int max_in);
+void resampler_free(resampler *rs);
+// 流重启时清掉历史 (漂移修正量保留，时钟差不会因为重启就没了)
+void resampler_reset(resampler *rs);
+
+// 喂进 in_frames 帧交错的 in_fmt，尽量多地产生交错的 out_fmt 输出 (最多 max_out 帧)，
+// 返回输出帧数。没用完的输入留在里面下次接着用；输入放不下返回 -1 (扔掉的帧数记在 frames_dropped)
+int resampler_process(resampler *rs, const void *in, sf_format in_fmt, int in_frames,
+                      void *out, sf_format out_fmt, int max_out);
+
+// 报告当前水位 (播放端缓冲区里没放完的 + 手里还没写出去的，单位：输出帧)，
+// dt 是距上次报告过了多少秒。内部据此调整比例
+void resampler_track(resampler *rs, double fill, double dt);
+
+// 打印每声道的 CPU 开销、稳态水位的抖动、修正量范围和扔掉的输入
+void resampler_report(const resampler *rs);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ringbuf.h"
+
+int ringbuf_init(ringbuf *rb, size_t size) {
+    size_t cap = 4096;
+    while (cap < size) cap <<= 1;
+
+    void *p = NULL;
+    if (posix_memalign(&p, 4096, cap) != 0) return -1;
+    rb->buf = p;
+    rb->size = cap;
+    rb->mask = cap - 1;
+    atomic_init(&rb->head, 0);
+    atomic_init(&rb->tail, 0);
+    return 0;
+}
+
+void ringbuf_free(ringbuf *rb) {
+    free(rb->buf);
+    rb->buf = NULL;
+}
+
+// 自己这一端的计数用 relaxed 读就行，对方的要 acquire，
+// 保证看到计数变化时对方写的数据也已经可见
+size_t ringbuf_read_avail(ringbuf *rb) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    return head - tail;
+}
+
+size_t ringbuf_write_space(ringbuf *rb) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    return rb->size - (head - tail);
+}
+
+size_t ringbuf_write_ptr(ringbuf *rb, void **p) {
+    size_t space = ringbuf_write_space(rb);
+    size_t off = atomic_load_explicit(&rb->head, memory_order_relaxed) & rb->mask;
+    size_t contig = rb->size - off;
+    *p = rb->buf + off;
+    return space < contig ? space : contig;
+}
+
+void ringbuf_write_advance(ringbuf *rb, size_t n) {
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    atomic_store_explicit(&rb->head, head + n, memory_order_release);
+}
+
+size_t ringbuf_read_ptr(ringbuf *rb, const void **p) {
+    size_t avail = ringbuf_read_avail(rb);
+    size_t off = atomic_load_explicit(&rb->tail, memory_order_relaxed) & rb->mask;
+    size_t contig = rb->size - off;
+    *p = rb->buf + off;
+    return avail < contig ? avail : contig;
+}
+
+void ringbuf_read_advance(ringbuf *rb, size_t n) {
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    atomic_store_explicit(&rb->tail, tail + n, memory_order_release);
+}
+
+size_t ringbuf_write(ringbuf *rb, const void *data, size_t n) {
+    size_t space = ringbuf_write_space(rb);
+    if (n > space) n = space;
+
+    // 可能绕过结尾，分两段拷
+    size_t off = atomic_load_explicit(&rb->head, memory_order_relaxed) & rb->mask;
+    size_t first = rb->size - off;
+    if (first > n) first = n;
+    memcpy(rb->buf + off, data, first);
+    memcpy(rb->buf, (const char *)data + first, n - first);
+
+    ringbuf_write_advance(rb, n);
+    return n;
+}
+
+size_t ringbuf_read(ringbuf *rb, void *data, size_t n) {
+    size_t avail = ringbuf_read_avail(rb);
+    if (n > avail) n = avail;
+
+    size_t off = atomic_load_explicit(&rb->tail, memory_order_relaxed) & rb->mask;
+    size_t first = rb->size - off;
+    if (first > n) first = n;
+    memcpy(data, rb->buf + off, first);
+    memcpy((char *)data + first, rb->buf, n - first);
+
+    ringbuf_read_advance(rb, n);
+    return n;
+}
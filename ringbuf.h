@@ -0,0 +1,35 @@
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// --- 单生产者/单消费者 无锁环形缓冲区 ---
+// 一个线程只写，一个线程只读，不用锁，谁也不会阻塞谁。
+// 容量是 2 的幂，head/tail 是一直往上加的字节计数，取模只用位与。
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t mask;
+    atomic_size_t head;     // 生产者写了多少 (只有生产者改)
+    atomic_size_t tail;     // 消费者读了多少 (只有消费者改)
+} ringbuf;
+
+// size 会向上取到 2 的幂，内存按页对齐
+int ringbuf_init(ringbuf *rb, size_t size);
+void ringbuf_free(ringbuf *rb);
+
+size_t ringbuf_read_avail(ringbuf *rb);
+size_t ringbuf_write_space(ringbuf *rb);
+
+// 拷贝进/出，返回实际处理的字节数 (空间不够时可能少于 n)
+size_t ringbuf_write(ringbuf *rb, const void *data, size_t n);
+size_t ringbuf_read(ringbuf *rb, void *data, size_t n);
+
+// 零拷贝：拿到一段连续可读/可写的区域，用完再 advance
+size_t ringbuf_read_ptr(ringbuf *rb, const void **p);
+void ringbuf_read_advance(ringbuf *rb, size_t n);
+size_t ringbuf_write_ptr(ringbuf *rb, void **p);
+void ringbuf_write_advance(ringbuf *rb, size_t n);
+
+#endif
@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "rt.h"
+
+#ifndef MCL_ONFAULT
+#define MCL_ONFAULT 4 // 老的 glibc 头文件里没有，内核 4.4 起就支持
+#endif
+
+#define RT_STACK_PREFAULT (256 * 1024) // 音频线程栈先摸这么深
+
+void rt_default(rt_opts *o) {
+    memset(o, 0, sizeof(*o));
+    o->policy = SCHED_FIFO;
+    o->cpu = -1;
+    o->got_cpu = -1;
+}
+
+int rt_parse(rt_opts *o, const char *arg) {
+    char *end;
+
+    rt_default(o);
+    if (strncmp(arg, "rr:", 3) == 0) {
+        o->policy = SCHED_RR;
+        arg += 3;
+    }
+    o->priority = strtol(arg, &end, 10);
+    if (*end == ':') o->cpu = strtol(end + 1, &end, 10);
+    if (*end || o->priority < sched_get_priority_min(o->policy) ||
+        o->priority > sched_get_priority_max(o->policy) || o->cpu < -1) {
+        fprintf(stderr, "实时参数要写成 优先级[:CPU] (优先级 %d ~ %d)，前面加 rr: 用 SCHED_RR\n",
+                sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+        return -1;
+    }
+    return 0;
+}
+
+static const char *rlimit_str(int resource, char *buf, size_t len) {
+    struct rlimit rl;
+    if (getrlimit(resource, &rl) < 0) return "?";
+    if (rl.rlim_cur == RLIM_INFINITY) return "unlimited";
+    snprintf(buf, len, "%llu", (unsigned long long)rl.rlim_cur);
+    return buf;
+}
+
+// 在自己的栈上开一大块摸一遍，之后函数调用再深也不会缺页
+static void __attribute__((noinline)) prefault_stack(void) {
+    volatile char stack[RT_STACK_PREFAULT];
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < sizeof(stack); i += page) stack[i] = 0;
+}
+
+void rt_enter(rt_opts *o, const char *who) {
+    char lim[32];
+    int err;
+
+    if (o->priority <= 0) return;
+
+    // --- 1. 实时调度 ---
+    struct sched_param sp = { .sched_priority = o->priority };
+    err = pthread_setschedparam(pthread_self(), o->policy, &sp);
+    if (err == EPERM) {
+        // 给了 rtprio 但没给这么高：用允许的最高值也比普通调度强
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_RTPRIO, &rl) == 0 && rl.rlim_cur > 0 && rl.rlim_cur < (rlim_t)o->priority) {
+            sp.sched_priority = rl.rlim_cur;
+            err = pthread_setschedparam(pthread_self(), o->policy, &sp);
+        }
+    }
+    if (err) {
+        fprintf(stderr, "%s: 拿不到实时优先级 %d (%s, RLIMIT_RTPRIO = %s)，按普通优先级跑\n"
+                        "  要实时优先级：给用户配 rtprio (比如 limits.conf 里 @audio - rtprio 95)，或者用 root\n",
+                who, o->priority, strerror(err), rlimit_str(RLIMIT_RTPRIO, lim, sizeof(lim)));
+    } else {
+        o->got_priority = sp.sched_priority;
+        if (sp.sched_priority != o->priority)
+            fprintf(stderr, "%s: RLIMIT_RTPRIO 只允许到 %d，用它\n", who, sp.sched_priority);
+    }
+
+    // --- 2. 绑核 ---
+    if (o->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(o->cpu, &set);
+        err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err) fprintf(stderr, "%s: 绑不到 CPU %d (%s)，不绑了\n", who, o->cpu, strerror(err));
+        else o->got_cpu = o->cpu;
+    }
+
+    // --- 3. 栈摸一遍，再把已经在内存里的页全锁住 ---
+    prefault_stack();
+    if (mlockall(MCL_CURRENT | MCL_ONFAULT) < 0) {
+        fprintf(stderr, "%s: mlockall 失败 (%s, RLIMIT_MEMLOCK = %s 字节)，内存不锁\n"
+                        "  要锁内存：给用户配 memlock unlimited，或者用 root\n",
+                who, strerror(errno), rlimit_str(RLIMIT_MEMLOCK, lim, sizeof(lim)));
+    } else {
+        o->locked = 1;
+    }
+}
+
+void rt_prefault(void *p, size_t len) {
+    volatile char *c = (volatile char *)p;
+    long page = sysconf(_SC_PAGESIZE);
+
+    if (!p || len == 0) return;
+    for (size_t i = 0; i < len; i += page) c[i] = c[i];
+    c[len - 1] = c[len - 1];
+}
+
+void rt_unlock(const void *p, size_t len) {
+    if (p && len) munlock(p, len);
+}
+
+void rt_report(const rt_opts *o, FILE *fp) {
+    if (o->priority <= 0) return;
+    fprintf(fp, "实时: ");
+    if (o->got_priority)
+        fprintf(fp, "%s %d", o->policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO", o->got_priority);
+    else
+        fprintf(fp, "普通调度 (要的 %d 没拿到)", o->priority);
+    if (o->cpu >= 0) {
+        if (o->got_cpu >= 0) fprintf(fp, ", CPU %d", o->got_cpu);
+        else fprintf(fp, ", 没绑上 CPU %d", o->cpu);
+    }
+    fprintf(fp, ", %s\n", o->locked ? "内存已锁定" : "内存没锁");
+}
@@ -0,0 +1,46 @@
+#ifndef RT_H
+#define RT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// --- 实时模式 (可选)：让音频线程不被别的进程挤掉、热路径上不缺页 ---
+// 机器一忙，普通优先级的音频线程就可能晚醒几个毫秒，周期一短就是 xrun。
+// 打开以后音频线程自己调 rt_enter()：
+//   * SCHED_FIFO (或 SCHED_RR) 实时优先级，比所有普通进程先跑
+//   * 绑到指定的 CPU 上，不被调度器搬来搬去 (缓存也是热的)
+//   * 把自己的栈先摸一遍，再 mlockall 把已经摸过的页锁在内存里
+// 周期缓冲区、环这些在 rt_enter 之前用 rt_prefault() 摸一遍，锁的时候它们都在内存里。
+// mlockall 用 MCL_ONFAULT：还没摸过的页 (比如整个映射进来的 WAV) 不会被一口气读进来，
+// 大文件映射再用 rt_unlock() 放掉，交给正常的换页。
+// 拿不到 (RLIMIT_RTPRIO / RLIMIT_MEMLOCK 不够，CPU 不存在) 就打印原因，按普通方式接着跑。
+// 开和不开各跑一次，对比 pcm_stats 报告里的 "唤醒间隔 ... 抖动" 那一行
+typedef struct {
+    int priority;           // 0 = 不开实时模式
+    int policy;             // SCHED_FIFO / SCHED_RR
+    int cpu;                // -1 = 不绑核
+
+    // rt_enter 之后：实际拿到了什么
+    int got_priority;       // 0 = 没拿到实时调度
+    int got_cpu;            // -1 = 没绑上
+    int locked;             // mlockall 成功了没有
+} rt_opts;
+
+// 解析 "优先级[:CPU]"，前面加 "rr:" 用 SCHED_RR，比如 "80"、"80:2"、"rr:70:3"
+// 格式不对打印原因并返回 -1
+int rt_parse(rt_opts *o, const char *arg);
+// 没开实时模式时的默认值
+void rt_default(rt_opts *o);
+
+// 音频线程自己调用 (调度策略和绑核是按线程的)。在它开别的线程之前调，
+// 不然新线程会继承实时优先级。o->priority == 0 时什么都不做
+void rt_enter(rt_opts *o, const char *who);
+// 每一页读一下再写回去，让内核现在就把页给我们 (内容不变)
+void rt_prefault(void *p, size_t len);
+// 不想锁住的大映射 (整个 WAV 文件)，rt_enter 之后调
+void rt_unlock(const void *p, size_t len);
+
+// "实时: SCHED_FIFO 80, CPU 2, 内存已锁定" 这样的一行
+void rt_report(const rt_opts *o, FILE *fp);
+
+#endif
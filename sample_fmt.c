@@ -0,0 +1,350 @@
+#include <string.h>
+#include <strings.h>
+#include "sample_fmt.h"
+#include "synth.h"
+
+// 向量扩展：8 个采样一组，默认编译时拆成 SSE 指令，avx2 版本里是一条 256 位指令
+typedef float v8f __attribute__((vector_size(32)));
+typedef int32_t v8i __attribute__((vector_size(32)));
+typedef uint32_t v8u __attribute__((vector_size(32)));
+typedef int16_t v8s __attribute__((vector_size(16)));
+
+// 经过 float 转换时一次处理多少个采样 (栈上的临时区)
+#define SF_CHUNK 512
+
+static const char *names[SF_COUNT] = { "s16", "s24_3", "s32", "f32" };
+
+const char *sf_name(sf_format f) {
+    return f >= 0 && f < SF_COUNT ? names[f] : "unknown";
+}
+
+sf_format sf_parse(const char *name) {
+    for (int f = 0; f < SF_COUNT; f++)
+        if (strcasecmp(name, names[f]) == 0) return (sf_format)f;
+    if (strcasecmp(name, "s24") == 0) return SF_S24_3;
+    if (strcasecmp(name, "float") == 0) return SF_F32;
+    return SF_UNKNOWN;
+}
+
+void sf_dither_init(sf_dither *d, uint32_t seed) {
+    // xorshift 的状态不能是 0
+    for (int i = 0; i < 16; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        d->state[i] = seed | 1;
+    }
+}
+
+// --- 24 位紧凑格式：小端 3 字节，读的时候符号扩展 ---
+static inline int32_t load_s24(const unsigned char *p) {
+    int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+    return v >> 8;
+}
+
+static inline void store_s24(unsigned char *p, int32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+}
+
+// --- 标量版 (处理向量版剩下的尾巴，以及 24 位这种不好向量化的) ---
+static inline uint32_t xorshift1(uint32_t *s) {
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+// [-1, 1) 的三角分布：两个 [0, 1) 的均匀分布相减
+static inline float tpdf1(sf_dither *d) {
+    float a = (xorshift1(&d->state[0]) >> 8) * (1.0f / 16777216);
+    float b = (xorshift1(&d->state[8]) >> 8) * (1.0f / 16777216);
+    return a - b;
+}
+
+// x 已经乘到目标的 LSB 单位，加抖动、四舍五入、饱和
+static inline int32_t quantize1(float x, float lo, float hi, sf_dither *d) {
+    if (d) x += tpdf1(d);
+    if (x < lo) x = lo;
+    if (x > hi) x = hi;
+    return (int32_t)(x < 0 ? x - 0.5f : x + 0.5f);
+}
+
+// --- 向量内核 (always_inline，下面各编一份通用版和 avx2 版) ---
+static inline __attribute__((always_inline))
+size_t s16_to_f32_kernel(float *dst, const int16_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        v8s s;
+        memcpy(&s, src + i, sizeof(s));
+        v8f f = __builtin_convertvector(s, v8f) * (1.0f / 32768);
+        memcpy(dst + i, &f, sizeof(f));
+    }
+    return i;
+}
+
+static inline __attribute__((always_inline))
+size_t s32_to_f32_kernel(float *dst, const int32_t *src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        v8i s;
+        memcpy(&s, src + i, sizeof(s));
+        v8f f = __builtin_convertvector(s, v8f) * (1.0f / 2147483648.0f);
+        memcpy(dst + i, &f, sizeof(f));
+    }
+    return i;
+}
+
+// 向量只在函数内部用，不按值传进传出 (那样 avx2 和通用版之间 ABI 不一样)
+static inline __attribute__((always_inline))
+void xorshift8(v8u *s, v8f *out) {
+    v8u x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    *out = __builtin_convertvector(x >> 8, v8f);
+}
+
+// 按掩码选：m 的每一格是全 1 (取 a) 或者全 0 (取 b)
+#define SELECT8(m, a, b) ((v8f)(((v8i)(a) & (m)) | ((v8i)(b) & ~(m))))
+
+static inline __attribute__((always_inline))
+size_t f32_to_s16_kernel(int16_t *dst, const float *src, size_t n, sf_dither *d) {
+    const v8f lo = {-32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768};
+    const v8f hi = {32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767};
+    v8u sa = {0}, sb = {0};
+    size_t i = 0;
+
+    if (d) {
+        memcpy(&sa, d->state, sizeof(sa));
+        memcpy(&sb, d->state + 8, sizeof(sb));
+    }
+    for (; i + 8 <= n; i += 8) {
+        v8f x;
+        memcpy(&x, src + i, sizeof(x));
+        x *= 32768.0f;
+        if (d) {
+            v8f a, b;
+            xorshift8(&sa, &a);
+            xorshift8(&sb, &b);
+            x += (a - b) * (1.0f / 16777216);
+        }
+        x = SELECT8(x < lo, lo, x);
+        x = SELECT8(x > hi, hi, x);
+        // 先挪到正数区间，截断就等于向下取整，再挪回来：四舍五入
+        v8i r = __builtin_convertvector(x + 32768.5f, v8i) - 32768;
+        v8s s = __builtin_convertvector(r, v8s);
+        memcpy(dst + i, &s, sizeof(s));
+    }
+    if (d) {
+        memcpy(d->state, &sa, sizeof(sa));
+        memcpy(d->state + 8, &sb, sizeof(sb));
+    }
+    return i;
+}
+
+static inline __attribute__((always_inline))
+size_t f32_to_s32_kernel(int32_t *dst, const float *src, size_t n) {
+    // 2^31 在 float 里刚好表示得出来但已经溢出了，上限取它下面那个 float
+    const v8f lo = {-2147483648.0f, -2147483648.0f, -2147483648.0f, -2147483648.0f,
+                    -2147483648.0f, -2147483648.0f, -2147483648.0f, -2147483648.0f};
+    const v8f hi = {2147483520.0f, 2147483520.0f, 2147483520.0f, 2147483520.0f,
+                    2147483520.0f, 2147483520.0f, 2147483520.0f, 2147483520.0f};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        v8f x;
+        memcpy(&x, src + i, sizeof(x));
+        x *= 2147483648.0f;
+        x = SELECT8(x < lo, lo, x);
+        x = SELECT8(x > hi, hi, x);
+        v8i r = __builtin_convertvector(x, v8i);
+        memcpy(dst + i, &r, sizeof(r));
+    }
+    return i;
+}
+
+// 同一份内核编两遍：默认的 (SSE) 和 avx2 的
+static size_t s16_to_f32_generic(float *dst, const int16_t *src, size_t n) {
+    return s16_to_f32_kernel(dst, src, n);
+}
+
+__attribute__((target("avx2")))
+static size_t s16_to_f32_avx2(float *dst, const int16_t *src, size_t n) {
+    return s16_to_f32_kernel(dst, src, n);
+}
+
+static size_t s32_to_f32_generic(float *dst, const int32_t *src, size_t n) {
+    return s32_to_f32_kernel(dst, src, n);
+}
+
+__attribute__((target("avx2")))
+static size_t s32_to_f32_avx2(float *dst, const int32_t *src, size_t n) {
+    return s32_to_f32_kernel(dst, src, n);
+}
+
+static size_t f32_to_s16_generic(int16_t *dst, const float *src, size_t n, sf_dither *d) {
+    return f32_to_s16_kernel(dst, src, n, d);
+}
+
+__attribute__((target("avx2")))
+static size_t f32_to_s16_avx2(int16_t *dst, const float *src, size_t n, sf_dither *d) {
+    return f32_to_s16_kernel(dst, src, n, d);
+}
+
+static size_t f32_to_s32_generic(int32_t *dst, const float *src, size_t n) {
+    return f32_to_s32_kernel(dst, src, n);
+}
+
+__attribute__((target("avx2")))
+static size_t f32_to_s32_avx2(int32_t *dst, const float *src, size_t n) {
+    return f32_to_s32_kernel(dst, src, n);
+}
+
+static int use_avx2(void) {
+    return strcmp(synth_isa(), "avx2") == 0;
+}
+
+void sf_to_f32(float *dst, const void *src, sf_format fmt, size_t n) {
+    size_t i = 0;
+
+    switch (fmt) {
+    case SF_S16: {
+        const int16_t *s = (const int16_t *)src;
+        i = use_avx2() ? s16_to_f32_avx2(dst, s, n) : s16_to_f32_generic(dst, s, n);
+        for (; i < n; i++) dst[i] = s[i] * (1.0f / 32768);
+        break;
+    }
+    case SF_S24_3: {
+        const unsigned char *s = (const unsigned char *)src;
+        for (; i < n; i++) dst[i] = load_s24(s + i * 3) * (1.0f / 8388608);
+        break;
+    }
+    case SF_S32: {
+        const int32_t *s = (const int32_t *)src;
+        i = use_avx2() ? s32_to_f32_avx2(dst, s, n) : s32_to_f32_generic(dst, s, n);
+        for (; i < n; i++) dst[i] = s[i] * (1.0f / 2147483648.0f);
+        break;
+    }
+    case SF_F32:
+        memcpy(dst, src, n * sizeof(float));
+        break;
+    default:
+        memset(dst, 0, n * sizeof(float));
+        break;
+    }
+}
+
+void sf_from_f32(void *dst, sf_format fmt, const float *src, size_t n, sf_dither *dither) {
+    size_t i = 0;
+
+    switch (fmt) {
+    case SF_S16: {
+        int16_t *d = (int16_t *)dst;
+        i = use_avx2() ? f32_to_s16_avx2(d, src, n, dither) : f32_to_s16_generic(d, src, n, dither);
+        for (; i < n; i++) d[i] = quantize1(src[i] * 32768.0f, -32768.0f, 32767.0f, dither);
+        break;
+    }
+    case SF_S24_3: {
+        unsigned char *d = (unsigned char *)dst;
+        for (; i < n; i++)
+            store_s24(d + i * 3, quantize1(src[i] * 8388608.0f, -8388608.0f, 8388607.0f, dither));
+        break;
+    }
+    case SF_S32: {
+        // float 只有 24 位尾数，比 32 位的 LSB 粗得多，加抖动没意义
+        int32_t *d = (int32_t *)dst;
+        i = use_avx2() ? f32_to_s32_avx2(d, src, n) : f32_to_s32_generic(d, src, n);
+        for (; i < n; i++) {
+            float x = src[i] * 2147483648.0f;
+            if (x < -2147483648.0f) x = -2147483648.0f;
+            if (x > 2147483520.0f) x = 2147483520.0f;
+            d[i] = (int32_t)x;
+        }
+        break;
+    }
+    case SF_F32:
+        memcpy(dst, src, n * sizeof(float));
+        break;
+    default:
+        break;
+    }
+}
+
+// 整数加宽：左对齐到 32 位再按目标宽度取高位，一位都不丢
+static void widen(void *dst, sf_format dfmt, const void *src, sf_format sfmt, size_t n) {
+    const unsigned char *s8 = (const unsigned char *)src;
+    unsigned char *d8 = (unsigned char *)dst;
+
+    for (size_t i = 0; i < n; i++) {
+        int32_t v;
+        if (sfmt == SF_S16) v = (int32_t)((const int16_t *)src)[i] * 65536;
+        else v = load_s24(s8 + i * 3) * 256;
+
+        if (dfmt == SF_S32) ((int32_t *)dst)[i] = v;
+        else store_s24(d8 + i * 3, v >> 8);
+    }
+}
+
+void sf_convert(void *dst, sf_format dfmt, const void *src, sf_format sfmt, size_t n, sf_dither *dither) {
+    if (dfmt == sfmt) {
+        memcpy(dst, src, n * sf_bytes(sfmt));
+        return;
+    }
+    if (!sf_is_float(sfmt) && !sf_is_float(dfmt) && sf_bits(dfmt) > sf_bits(sfmt)) {
+        widen(dst, dfmt, src, sfmt, n);
+        return;
+    }
+    if (dfmt == SF_F32) {
+        sf_to_f32((float *)dst, src, sfmt, n);
+        return;
+    }
+    if (sfmt == SF_F32) {
+        sf_from_f32(dst, dfmt, (const float *)src, n, dither);
+        return;
+    }
+
+    // 整数变窄：一段段经过 float
+    float tmp[SF_CHUNK];
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned char *d = (unsigned char *)dst;
+    for (size_t off = 0; off < n; off += SF_CHUNK) {
+        size_t k = n - off < SF_CHUNK ? n - off : SF_CHUNK;
+        sf_to_f32(tmp, s + off * sf_bytes(sfmt), sfmt, k);
+        sf_from_f32(d + off * sf_bytes(dfmt), dfmt, tmp, k, dither);
+    }
+}
+
+void sf_deinterleave(float *const *dst, const float *src, int channels, size_t frames) {
+    if (channels == 2) {
+        // 最常见的立体声单独写，编译器能向量化
+        float *l = dst[0], *r = dst[1];
+        for (size_t i = 0; i < frames; i++) {
+            l[i] = src[i * 2];
+            r[i] = src[i * 2 + 1];
+        }
+        return;
+    }
+    for (int c = 0; c < channels; c++) {
+        float *d = dst[c];
+        const float *s = src + c;
+        for (size_t i = 0; i < frames; i++) d[i] = s[i * channels];
+    }
+}
+
+void sf_interleave(float *dst, const float *const *src, int channels, size_t frames) {
+    if (channels == 2) {
+        const float *l = src[0], *r = src[1];
+        for (size_t i = 0; i < frames; i++) {
+            dst[i * 2] = l[i];
+            dst[i * 2 + 1] = r[i];
+        }
+        return;
+    }
+    for (int c = 0; c < channels; c++) {
+        const float *s = src[c];
+        float *d = dst + c;
+        for (size_t i = 0; i < frames; i++) d[i * channels] = s[i];
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef SAMPLE_FMT_H
+#define SAMPLE_FMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- 采样格式层 ---
+// 声卡和文件不一定是 16 位立体声：声卡常见 S32_LE / S24_3LE、8 声道以上，
+// 文件常见 32 位 float。这里统一描述格式，并提供它们之间的转换：
+//   * 整数加宽 (16 -> 24/32 位) 是移位，无损
+//   * 变窄、float 转整数时加 TPDF 抖动 (两个均匀分布相减，幅度 ±1 LSB)，
+//     量化误差变成和信号无关的白噪声，不会在小信号上出现谐波失真
+//   * 热点的几条 (s16/s32 <-> f32) 用向量扩展写，CPU 支持就走 avx2
+// 格式一样时工具直接用原始数据，不经过这里。
+// float 的满刻度是 ±1.0
+
+typedef enum {
+    SF_UNKNOWN = -1,
+    SF_S16 = 0,     // 16 位有符号
+    SF_S24_3,       // 24 位有符号，每个采样紧凑地占 3 字节
+    SF_S32,         // 32 位有符号
+    SF_F32,         // 32 位 float
+    SF_COUNT
+} sf_format;
+
+// 每个采样几个字节
+static inline int sf_bytes(sf_format f) {
+    static const int bytes[SF_COUNT] = { 2, 3, 4, 4 };
+    return f >= 0 && f < SF_COUNT ? bytes[f] : 0;
+}
+
+// 有效位数 (float 按尾数算)
+static inline int sf_bits(sf_format f) {
+    static const int bits[SF_COUNT] = { 16, 24, 32, 24 };
+    return f >= 0 && f < SF_COUNT ? bits[f] : 0;
+}
+
+static inline int sf_is_float(sf_format f) {
+    return f == SF_F32;
+}
+
+// WAV fmt 块里的格式号 (1 = PCM, 3 = float) 和容器位深 -> 格式
+static inline sf_format sf_from_wav(int wav_format, int bits) {
+    if (wav_format == 1 && bits == 16) return SF_S16;
+    if (wav_format == 1 && bits == 24) return SF_S24_3;
+    if (wav_format == 1 && bits == 32) return SF_S32;
+    if (wav_format == 3 && bits == 32) return SF_F32;
+    return SF_UNKNOWN;
+}
+
+// "s16" / "s24_3" / "s32" / "f32"
+const char *sf_name(sf_format f);
+// 命令行参数 -> 格式，认不出返回 SF_UNKNOWN (也认 "s24" "float")
+sf_format sf_parse(const char *name);
+
+// TPDF 抖动用的随机数，每个通路一份 (16 路 xorshift：三角分布要的两个均匀分布
+// 各用 8 路，向量化时一路一格，两条依赖链互不等待)
+typedef struct {
+    uint32_t state[16];
+} sf_dither;
+
+void sf_dither_init(sf_dither *d, uint32_t seed);
+
+// 以下的 n 都是采样数 (帧数 * 声道数)，交错格式不用管声道
+
+// 任意格式 -> float
+void sf_to_f32(float *dst, const void *src, sf_format fmt, size_t n);
+// float -> 任意格式，饱和；dither 不为 NULL 且目标是 16/24 位时加抖动
+void sf_from_f32(void *dst, sf_format fmt, const float *src, size_t n, sf_dither *dither);
+// 任意格式之间：一样就是 memcpy，整数加宽直接移位，其余经过 float (按需抖动)
+void sf_convert(void *dst, sf_format dfmt, const void *src, sf_format sfmt, size_t n, sf_dither *dither);
+
+// N 声道：交错 <-> 每声道一条
+void sf_deinterleave(float *const *dst, const float *src, int channels, size_t frames);
+void sf_interleave(float *dst, const float *const *src, int channels, size_t frames);
+
+#endif
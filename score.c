@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "score.h"
+
+void score_init(score *sc, int rate) {
+    memset(sc, 0, sizeof(*sc));
+    sc->rate = rate;
+}
+
+void score_free(score *sc) {
+    free(sc->notes);
+    sc->notes = NULL;
+    sc->count = sc->capacity = 0;
+}
+
+int score_add(score *sc, long start, double duration, double freq1, double amp1,
+              double freq2, double amp2, ADSR env) {
+    if (sc->count == sc->capacity) {
+        int cap = sc->capacity ? sc->capacity * 2 : 64;
+        note_event *p = (note_event *) realloc(sc->notes, sizeof(note_event) * cap);
+        if (!p) return -1;
+        sc->notes = p;
+        sc->capacity = cap;
+    }
+
+    note_event *ne = &sc->notes[sc->count++];
+    ne->start = start;
+    ne->length = duration * sc->rate; // 和 generate_poly_tone 一样向下取整
+    ne->freq1 = freq1;
+    ne->amp1 = amp1;
+    ne->freq2 = freq2;
+    ne->amp2 = amp2;
+    adsr_ramps(&ne->env, env, duration, sc->rate, ne->length);
+
+    if (ne->length > sc->max_length) sc->max_length = ne->length;
+    if (start + ne->length > sc->total_samples) sc->total_samples = start + ne->length;
+    return 0;
+}
+
+void score_drop_before(score *sc, long t) {
+    // 按 start 排序，开始得比 t 早超过 max_length 的都响完了
+    int k = 0;
+    while (k < sc->count && sc->notes[k].start + sc->max_length <= t) k++;
+    if (k == 0) return;
+    memmove(sc->notes, sc->notes + k, sizeof(note_event) * (sc->count - k));
+    sc->count -= k;
+}
+
+// 二分找第一个 start >= t 的音符
+static int first_note_from(const score *sc, long t) {
+    int lo = 0, hi = sc->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (sc->notes[mid].start < t) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void score_render_block(const score *sc, short *out, long start, int n) {
+    float acc[SYNTH_BLOCK];
+    float tmp[SYNTH_BLOCK];
+
+    for (long pos = start; pos < start + n; pos += SYNTH_BLOCK) {
+        int m = start + n - pos < SYNTH_BLOCK ? start + n - pos : SYNTH_BLOCK;
+        memset(acc, 0, sizeof(float) * m);
+
+        // 开始得比 pos 早超过 max_length 的音符肯定已经响完了，不用看
+        for (int i = first_note_from(sc, pos - sc->max_length);
+             i < sc->count && sc->notes[i].start < pos + m; i++) {
+            const note_event *ne = &sc->notes[i];
+            long end = ne->start + ne->length;
+            if (end <= pos) continue;
+
+            long from = ne->start > pos ? ne->start : pos;
+            long to = end < pos + m ? end : pos + m;
+            int k = to - from;
+            long local = from - ne->start; // 在这个音符里的位置
+
+            // 每个音符单独算、单独乘包络，再加到总线上
+            // 按音符顺序相加，所以不管哪个线程算，结果都一样
+            memset(tmp, 0, sizeof(float) * k);
+            synth_osc_add(tmp, k, ne->freq1, ne->amp1, sc->rate, local);
+            synth_osc_add(tmp, k, ne->freq2, ne->amp2, sc->rate, local);
+            synth_env_apply(tmp, k, &ne->env, local);
+
+            float *dst = acc + (from - pos);
+            for (int j = 0; j < k; j++) dst[j] += tmp[j];
+        }
+
+        synth_store_stereo_s16(out + (pos - start) * 2, acc, m);
+    }
+}
+
+// --- 线程池 ---
+typedef struct {
+    const score *sc;
+    short *out;
+    long start;
+    long end;
+    int block_frames;
+    long nblocks;
+    atomic_long next;   // 下一个没人领的块
+} render_job;
+
+static void *render_worker(void *arg) {
+    render_job *job = (render_job *)arg;
+    const score *sc = job->sc;
+
+    while (1) {
+        long b = atomic_fetch_add(&job->next, 1);
+        if (b >= job->nblocks) break;
+
+        long start = job->start + b * job->block_frames;
+        long n = job->end - start;
+        if (n > job->block_frames) n = job->block_frames;
+        score_render_block(sc, job->out + (start - job->start) * 2, start, n);
+    }
+    return NULL;
+}
+
+double score_render_parallel(const score *sc, short *out, long start, long n,
+                             int threads, int block_frames) {
+    struct timespec t0, t1;
+    render_job job;
+    // 分配不到就只有主线程自己干，慢一点但输出一样
+    pthread_t *tids = threads > 1 ? (pthread_t *)malloc(sizeof(pthread_t) * (threads - 1)) : NULL;
+
+    job.sc = sc;
+    job.out = out;
+    job.start = start;
+    job.end = start + n;
+    job.block_frames = block_frames;
+    job.nblocks = (n + block_frames - 1) / block_frames;
+    atomic_init(&job.next, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    // 主线程自己也干活，只需要再开 threads-1 个
+    int started = 0;
+    for (int i = 0; tids && i < threads - 1; i++) {
+        if (pthread_create(&tids[started], NULL, render_worker, &job) == 0) started++;
+    }
+    render_worker(&job);
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    free(tids);
+
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
@@ -0,0 +1,47 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+#include "synth.h"
+
+// --- 乐谱：一串带绝对时间的音符 ---
+// 每个音符自己知道从第几个采样开始、响多久，音符之间可以重叠
+// (比如上一个音的释音尾巴拖进下一个音里)。
+typedef struct {
+    long start;         // 从第几个采样开始
+    long length;        // 一共多少个采样 (含释音)
+    double freq1;       // 主旋律频率
+    double amp1;
+    double freq2;       // 和声频率
+    double amp2;
+    env_ramps env;      // 预先拆好的包络
+} note_event;
+
+typedef struct {
+    note_event *notes;  // 按 start 从小到大排好
+    int count;
+    int capacity;
+    long total_samples; // 整首曲子多长
+    long max_length;    // 最长的一个音符，用来快速找和某一段时间重叠的音符
+    int rate;
+} score;
+
+void score_init(score *sc, int rate);
+void score_free(score *sc);
+
+// 加一个两声部音符 (按时间顺序加)
+int score_add(score *sc, long start, double duration, double freq1, double amp1,
+              double freq2, double amp2, ADSR env);
+
+// 渲染 [start, start+n) 这一段到交错立体声 int16
+// 每一段只依赖乐谱本身，和别的段无关，所以可以随便分给哪个线程
+void score_render_block(const score *sc, short *out, long start, int n);
+
+// 把 [start, start+n) 切成 block_frames 一块，threads 个线程抢着渲染到 out
+// 输出和线程数无关，每个字节都一样。返回耗时 (秒)
+double score_render_parallel(const score *sc, short *out, long start, long n,
+                             int threads, int block_frames);
+
+// 流式渲染用：扔掉在 t 之前肯定已经响完的音符，让乐谱只保留 "正在响" 的那一小段
+void score_drop_before(score *sc, long t);
+
+#endif
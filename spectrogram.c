@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "spectrogram.h"
+#include "spectrum.h"
+#include "sample_fmt.h"
+
+// 线程一次领多少片：太小了抢计数器，太大了最后几个线程干等
+#define SPECTROGRAM_CHUNK 256
+
+// --- 所有线程共享的 (只读，除了 next) ---
+typedef struct {
+    const wav_source *src;
+    int n, hop, type;
+    int bins;
+    uint32_t frames;
+    unsigned char *rows;        // 映射的输出文件里矩阵开始的地方
+    size_t row_bytes;
+    double *window;
+    float db_offset;            // 满刻度正弦的峰值 bin 正好是 0 dB
+    atomic_uint next;           // 下一块从第几片开始
+} sg_job;
+
+typedef struct {
+    sg_job *job;
+    pthread_t tid;
+    fftw_plan plan;
+    double *in;                 // SPECTROGRAM_BATCH 段，每段 n 个
+    fftw_complex *out;          // SPECTROGRAM_BATCH 段，每段 n/2+1 个
+    float *conv;                // 这一块的原始样本转成 float (交错)
+    float *mono;                // 混成单声道
+    size_t span;                // 一块最多要多少帧样本
+    unsigned long slices;
+} sg_worker;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 把 [first, first+count) 这些帧转成 float 混成单声道，文件结尾之后补零
+static void load_mono(sg_worker *w, size_t first, size_t count) {
+    const wav_source *src = w->job->src;
+    int ch = src->channels;
+    size_t have = first < src->frames ? src->frames - first : 0;
+    if (have > count) have = count;
+
+    if (ch == 1) {
+        sf_to_f32(w->mono, src->data + first * src->block_align, src->sample_fmt, have);
+    } else {
+        sf_to_f32(w->conv, src->data + first * src->block_align, src->sample_fmt, have * ch);
+        float scale = 1.0f / ch;
+        for (size_t i = 0; i < have; i++) {
+            float sum = 0;
+            for (int c = 0; c < ch; c++) sum += w->conv[i * ch + c];
+            w->mono[i] = sum * scale;
+        }
+    }
+    memset(w->mono + have, 0, (count - have) * sizeof(float));
+}
+
+// 一批 FFT 的结果换成 dB 写进对应的行
+static void store_rows(sg_worker *w, uint32_t row, int count) {
+    sg_job *j = w->job;
+    const float floor_db = SPECTROGRAM_DB_FLOOR;
+    const float q = 255.0f / -SPECTROGRAM_DB_FLOOR;
+
+    for (int k = 0; k < count; k++) {
+        const fftw_complex *o = w->out + (size_t)k * (j->n / 2 + 1);
+        unsigned char *dst = j->rows + (size_t)(row + k) * j->row_bytes;
+        for (int b = 0; b < j->bins; b++) {
+            float p = (float)(o[b][0] * o[b][0] + o[b][1] * o[b][1]);
+            float db = 10.0f * log10f(p + 1e-30f) - j->db_offset;
+            if (db < floor_db) db = floor_db;
+            if (j->type == SPECTROGRAM_U8) {
+                if (db > 0) db = 0;
+                dst[b] = (unsigned char)((db - floor_db) * q + 0.5f);
+            } else {
+                ((float *)dst)[b] = db;
+            }
+        }
+    }
+}
+
+static void *worker_func(void *arg) {
+    sg_worker *w = (sg_worker *)arg;
+    sg_job *j = w->job;
+    const int n = j->n;
+
+    while (1) {
+        uint32_t start = atomic_fetch_add(&j->next, SPECTROGRAM_CHUNK);
+        if (start >= j->frames) break;
+        uint32_t count = j->frames - start < SPECTROGRAM_CHUNK ? j->frames - start : SPECTROGRAM_CHUNK;
+
+        load_mono(w, (size_t)start * j->hop, (size_t)(count - 1) * j->hop + n);
+
+        for (uint32_t b = 0; b < count; b += SPECTROGRAM_BATCH) {
+            int k = count - b < SPECTROGRAM_BATCH ? count - b : SPECTROGRAM_BATCH;
+            for (int s = 0; s < k; s++) {
+                const float *x = w->mono + (size_t)(b + s) * j->hop;
+                double *in = w->in + (size_t)s * n;
+                for (int i = 0; i < n; i++) in[i] = x[i] * j->window[i];
+            }
+            // 最后一批不满也整批算，多出来的那几段不写出去
+            fftw_execute(w->plan);
+            store_rows(w, start + b, k);
+        }
+        w->slices += count;
+    }
+    return NULL;
+}
+
+static void worker_free(sg_worker *w) {
+    if (w->plan) fftw_destroy_plan(w->plan);
+    fftw_free(w->in);
+    fftw_free(w->out);
+    free(w->conv);
+    free(w->mono);
+}
+
+// 矩阵量化成灰度写出去：一行一片，亮 = 响
+static int write_pgm(const char *path, const sg_job *j) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    fprintf(fp, "P5\n%d %u\n255\n", j->bins, j->frames);
+    if (j->type == SPECTROGRAM_U8) {
+        fwrite(j->rows, j->row_bytes, j->frames, fp);
+    } else {
+        unsigned char *line = (unsigned char *)malloc(j->bins);
+        const float q = 255.0f / -SPECTROGRAM_DB_FLOOR;
+        for (uint32_t r = 0; r < j->frames && line; r++) {
+            const float *db = (const float *)(j->rows + (size_t)r * j->row_bytes);
+            for (int b = 0; b < j->bins; b++) {
+                float v = (db[b] > 0 ? 0 : db[b]) - SPECTROGRAM_DB_FLOOR;
+                line[b] = (unsigned char)(v * q + 0.5f);
+            }
+            fwrite(line, 1, j->bins, fp);
+        }
+        free(line);
+    }
+    if (fclose(fp) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+int spectrogram_export(const wav_source *src, const spectrogram_opts *opts, const char *path) {
+    sg_job job;
+    int n = opts->fft_size;
+    int hop = opts->hop;
+    int rc = -1;
+
+    if (n < SPECTRUM_MIN_FFT || n > SPECTRUM_MAX_FFT || hop < 1 || hop > n) {
+        fprintf(stderr, "FFT 点数要在 %d ~ %d 之间，帧移要在 1 ~ 点数之间\n", SPECTRUM_MIN_FFT, SPECTRUM_MAX_FFT);
+        return -1;
+    }
+    if (src->sample_fmt == SF_UNKNOWN || src->frames == 0) {
+        fprintf(stderr, "没有可以分析的数据\n");
+        return -1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.src = src;
+    job.n = n;
+    job.hop = hop;
+    job.type = opts->type;
+    job.bins = n / 2 + 1;
+    job.frames = (src->frames + hop - 1) / hop;
+    job.row_bytes = (size_t)job.bins * (opts->type == SPECTROGRAM_U8 ? 1 : sizeof(float));
+    atomic_init(&job.next, 0);
+
+    // 汉宁窗，和实时分析一样
+    double wsum = 0;
+    job.window = (double *)malloc(sizeof(double) * n);
+    if (!job.window) return -1;
+    for (int i = 0; i < n; i++) {
+        job.window[i] = 0.5 * (1 - cos(2 * M_PI * i / (n - 1)));
+        wsum += job.window[i];
+    }
+    job.db_offset = 20 * log10(wsum / 2);
+
+    // --- 输出文件按最终大小建好，映射进来让线程直接写 ---
+    size_t body = (size_t)job.frames * job.row_bytes;
+    size_t total = sizeof(struct spectrogram_header) + body;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        free(job.window);
+        return -1;
+    }
+    if (ftruncate(fd, total) < 0) {
+        perror("ftruncate");
+        close(fd);
+        free(job.window);
+        return -1;
+    }
+    unsigned char *map = (unsigned char *)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        free(job.window);
+        return -1;
+    }
+    struct spectrogram_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SPECTROGRAM_MAGIC, 4);
+    hdr.version = 1;
+    hdr.sample_rate = src->sample_rate;
+    hdr.fft_size = n;
+    hdr.hop = hop;
+    hdr.frames = job.frames;
+    hdr.bins = job.bins;
+    hdr.type = opts->type;
+    hdr.db_floor = SPECTROGRAM_DB_FLOOR;
+    memcpy(map, &hdr, sizeof(hdr));
+    job.rows = map + sizeof(hdr);
+
+    // --- 线程池：计划在这里一个个建 (FFTW 规划不能并发)，之后各跑各的 ---
+    int threads = opts->threads > 0 ? opts->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int chunks = (job.frames + SPECTROGRAM_CHUNK - 1) / SPECTROGRAM_CHUNK;
+    if (threads < 1) threads = 1;
+    if (threads > chunks) threads = chunks;
+    sg_worker *workers = (sg_worker *)calloc(threads, sizeof(sg_worker));
+    if (!workers) goto out;
+
+    int started = 0;
+    double t0 = 0;
+    size_t span = (size_t)(SPECTROGRAM_CHUNK - 1) * hop + n;
+    for (int t = 0; t < threads; t++) {
+        sg_worker *w = &workers[t];
+        w->job = &job;
+        w->span = span;
+        w->in = (double *)fftw_malloc(sizeof(double) * n * SPECTROGRAM_BATCH);
+        w->out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * job.bins * SPECTROGRAM_BATCH);
+        w->mono = (float *)malloc(sizeof(float) * span);
+        w->conv = src->channels > 1 ? (float *)malloc(sizeof(float) * span * src->channels) : NULL;
+        if (!w->in || !w->out || !w->mono || (src->channels > 1 && !w->conv)) {
+            fprintf(stderr, "内存不足\n");
+            goto join;
+        }
+        w->plan = spectrum_plan_batch(n, SPECTROGRAM_BATCH, w->in, w->out, opts->plan_flags, opts->wisdom_file);
+        if (!w->plan) {
+            fprintf(stderr, "FFT 初始化失败\n");
+            goto join;
+        }
+    }
+
+    t0 = now_sec();
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started].tid, NULL, worker_func, &workers[started]) != 0) break;
+    }
+    if (started == 0) {
+        fprintf(stderr, "无法创建线程\n");
+        goto join;
+    }
+join:
+    for (int t = 0; t < started; t++) pthread_join(workers[t].tid, NULL);
+    if (started > 0 && atomic_load(&job.next) >= job.frames) {
+        double wall = now_sec() - t0;
+        double audio_sec = (double)src->frames / src->sample_rate;
+        unsigned long lo = workers[0].slices, hi = workers[0].slices;
+        for (int t = 1; t < started; t++) {
+            if (workers[t].slices < lo) lo = workers[t].slices;
+            if (workers[t].slices > hi) hi = workers[t].slices;
+        }
+        printf("频谱图: %.1f 秒音频, %u 片 x %d bin (%s), %.1f MB -> %s\n", audio_sec, job.frames, job.bins,
+               opts->type == SPECTROGRAM_U8 ? "uint8" : "float32", total / 1048576.0, path);
+        printf("  %d 线程 (每个 %lu ~ %lu 片), 用时 %.3f 秒 = %.1f 倍实时, %.2f us/片\n",
+               started, lo, hi, wall, wall > 0 ? audio_sec / wall : 0, wall * 1e6 * started / job.frames);
+        rc = 0;
+    }
+    for (int t = 0; t < threads; t++) worker_free(&workers[t]);
+    free(workers);
+
+    if (rc == 0 && opts->pgm_path) {
+        if (write_pgm(opts->pgm_path, &job) == 0) printf("  图: %s (%d x %u)\n", opts->pgm_path, job.bins, job.frames);
+        else rc = -1;
+    }
+out:
+    munmap(map, total);
+    free(job.window);
+    return rc;
+}
@@ -0,0 +1,47 @@
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+
+#include <stdint.h>
+#include "wav_source.h"
+
+// --- 整个文件的频谱图 (离线导出) ---
+// 实时的柱状图只看最近一帧；这里把整段录音按帧移切片，每片都算，
+// 结果是一个 帧数 x (n/2+1) 的幅度矩阵 (dBFS)，一行一个时间片，低频在前。
+//   * 输出文件先按最终大小建好再 mmap，工作线程直接往里写自己那几行
+//   * 线程池按块领活 (原子计数)，每个线程一个批量 FFTW 计划，一次算 SPECTROGRAM_BATCH 片
+//   * 多声道先混成单声道再分析
+// 文件格式：下面这个头 + 矩阵 (float32 dB，或者量化成 uint8：0 = db_floor，255 = 0 dBFS)
+// 可选再出一张 PGM 灰度图：一行一个时间片 (时间往下走)，一列一个 bin
+#define SPECTROGRAM_MAGIC "SPEC"
+#define SPECTROGRAM_BATCH 16
+#define SPECTROGRAM_DB_FLOOR -120.0f
+
+enum { SPECTROGRAM_F32 = 0, SPECTROGRAM_U8 = 1 };
+
+struct spectrogram_header {
+    char magic[4];          // "SPEC"
+    uint32_t version;       // 1
+    uint32_t sample_rate;
+    uint32_t fft_size;
+    uint32_t hop;
+    uint32_t frames;        // 行数 (时间)
+    uint32_t bins;          // 列数 = fft_size/2 + 1
+    uint32_t type;          // SPECTROGRAM_F32 / SPECTROGRAM_U8
+    float db_floor;         // 量化的下限 (float32 时也会把更低的值夹到这里)
+    uint32_t reserved;
+} __attribute__((packed));
+
+typedef struct {
+    int fft_size;
+    int hop;
+    int type;               // SPECTROGRAM_F32 / SPECTROGRAM_U8
+    int threads;            // <= 0：有几个核用几个
+    unsigned plan_flags;    // FFTW_MEASURE 之类
+    const char *wisdom_file;
+    const char *pgm_path;   // 可以为 NULL
+} spectrogram_opts;
+
+// 把 src 整个分析一遍写到 path，打印耗时和实时倍数。失败打印原因并返回 -1
+int spectrogram_export(const wav_source *src, const spectrogram_opts *opts, const char *path);
+
+#endif
@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "spectrum.h"
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int spectrum_init(spectrum_ctx *ctx, int n, unsigned flags, const char *wisdom_file) {
+    ctx->n = n;
+    ctx->frames = 0;
+    ctx->total_ns = 0;
+
+    ctx->in = (double*) fftw_malloc(sizeof(double) * n);
+    ctx->out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+    ctx->window = (double*) malloc(sizeof(double) * n);
+    if (!ctx->in || !ctx->out || !ctx->window) {
+        spectrum_destroy(ctx);
+        return -1;
+    }
+
+    // 汉宁窗只跟 n 有关，算一次就够了，不用每帧都调 cos()
+    for (int i = 0; i < n; i++) {
+        ctx->window[i] = 0.5 * (1 - cos(2*M_PI*i/(n-1)));
+    }
+
+    ctx->plan = spectrum_plan_batch(n, 1, ctx->in, ctx->out, flags, wisdom_file);
+    if (!ctx->plan) {
+        spectrum_destroy(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+fftw_plan spectrum_plan_batch(int n, int howmany, double *in, fftw_complex *out,
+                              unsigned flags, const char *wisdom_file) {
+    fftw_plan plan;
+
+    // 先读智慧文件，有现成的计划就秒出
+    if (wisdom_file) fftw_import_wisdom_from_filename(wisdom_file);
+
+    // 文件里可能只有别的点数的计划，先只用智慧试一下，拿不到才真的去测
+    // MEASURE/PATIENT 会往 in/out 里写测试数据，所以必须在开始用之前做
+    int have_wisdom = 0;
+    if (howmany == 1) {
+        plan = fftw_plan_dft_r2c_1d(n, in, out, flags | FFTW_WISDOM_ONLY);
+        if (plan) have_wisdom = 1;
+        else plan = fftw_plan_dft_r2c_1d(n, in, out, flags);
+    } else {
+        // 相邻两段输入隔 n 个、输出隔 n/2+1 个
+        plan = fftw_plan_many_dft_r2c(1, &n, howmany, in, NULL, 1, n, out, NULL, 1, n / 2 + 1,
+                                      flags | FFTW_WISDOM_ONLY);
+        if (plan) have_wisdom = 1;
+        else plan = fftw_plan_many_dft_r2c(1, &n, howmany, in, NULL, 1, n, out, NULL, 1, n / 2 + 1, flags);
+    }
+    if (!plan) return NULL;
+
+    // 没有现成智慧时才是真的测了一遍，存下来下次用
+    if (wisdom_file && !have_wisdom) {
+        if (!fftw_export_wisdom_to_filename(wisdom_file))
+            fprintf(stderr, "无法保存 FFTW 智慧文件: %s\n", wisdom_file);
+    }
+    return plan;
+}
+
+void spectrum_destroy(spectrum_ctx *ctx) {
+    if (ctx->plan) fftw_destroy_plan(ctx->plan);
+    fftw_free(ctx->in);
+    fftw_free(ctx->out);
+    free(ctx->window);
+    ctx->plan = NULL;
+    ctx->in = NULL;
+    ctx->out = NULL;
+    ctx->window = NULL;
+}
+
+// 把 FFT 结果 "分桶" 到 bars 根柱子里
+static void bin_to_bars(const fftw_complex *out, int n, double *heights, int bars) {
+    // FFT 的结果是对称的，我们只需要前半部分
+    int samples_per_bar = (n / 2) / bars;
+    if (samples_per_bar < 1) samples_per_bar = 1;
+
+    for (int i = 0; i < bars; i++) {
+        double power = 0;
+        for (int j = 0; j < samples_per_bar; j++) {
+            int index = i * samples_per_bar + j;
+            if (index > n / 2) break;
+            // 模长 = sqrt(实部^2 + 虚部^2)
+            power += sqrt(out[index][0]*out[index][0] + out[index][1]*out[index][1]);
+        }
+        // 取平均并做一点数学缩小，防止柱子冲出屏幕
+        power /= samples_per_bar;
+        heights[i] = power / 100000.0; // 这个除数取决于音量大小，可调
+    }
+}
+
+void compute_spectrum(spectrum_ctx *ctx, const short *pcm, int stride, int count,
+                      double *heights, int bars) {
+    unsigned long long t0 = now_ns();
+    int n = ctx->n;
+    if (count > n) count = n;
+
+    // 唯一的一次拷贝：short -> double 顺便乘上窗
+    for (int i = 0; i < count; i++) {
+        ctx->in[i] = pcm[i * stride] * ctx->window[i];
+    }
+    for (int i = count; i < n; i++) ctx->in[i] = 0;
+
+    fftw_execute(ctx->plan);
+    bin_to_bars(ctx->out, n, heights, bars);
+
+    ctx->total_ns += now_ns() - t0;
+    ctx->frames++;
+}
+
+// --- 以前的写法，只留给 spectrum_bench 做对比 ---
+static void compute_spectrum_oneshot(const short *pcm, int n, double *heights, int bars) {
+    double *in = (double*) fftw_malloc(sizeof(double) * n);
+    fftw_complex *out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * n);
+
+    for (int i = 0; i < n; i++) {
+        double multiplier = 0.5 * (1 - cos(2*M_PI*i/(n-1)));
+        in[i] = pcm[i] * multiplier;
+    }
+
+    fftw_plan p = fftw_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE);
+    fftw_execute(p);
+    bin_to_bars(out, n, heights, bars);
+
+    fftw_destroy_plan(p);
+    fftw_free(in);
+    fftw_free(out);
+}
+
+void spectrum_bench(int n, int iterations, unsigned flags, const char *wisdom_file) {
+    short *pcm = (short*) malloc(sizeof(short) * n);
+    double heights[64];
+    spectrum_ctx ctx = {0};
+
+    // 随便来个 440Hz + 噪声，内容不重要
+    for (int i = 0; i < n; i++) {
+        pcm[i] = (short)(8000 * sin(2*M_PI*440*i/44100.0) + (rand() % 200 - 100));
+    }
+
+    unsigned long long t0 = now_ns();
+    for (int i = 0; i < iterations; i++) compute_spectrum_oneshot(pcm, n, heights, 40);
+    double before = (double)(now_ns() - t0) / iterations;
+
+    t0 = now_ns();
+    if (spectrum_init(&ctx, n, flags, wisdom_file) < 0) {
+        fprintf(stderr, "spectrum_init 失败\n");
+        free(pcm);
+        return;
+    }
+    double setup_ms = (now_ns() - t0) / 1e6;
+
+    for (int i = 0; i < iterations; i++) compute_spectrum(&ctx, pcm, 1, n, heights, 40);
+    double after = (double)ctx.total_ns / ctx.frames;
+
+    printf("FFT 点数: %d, 迭代: %d\n", n, iterations);
+    printf("  before (每帧建计划):   %10.0f ns/帧\n", before);
+    printf("  after  (常驻上下文):   %10.0f ns/帧\n", after);
+    printf("  加速比: %.1fx, 一次性初始化: %.2f ms\n", before / after, setup_ms);
+
+    spectrum_destroy(&ctx);
+    free(pcm);
+}
+
+// --- 三缓冲快照通道 ---
+#define SLOT_DIRTY 4u   // middle 的第 2 位：中间槽位里有消费者还没看过的帧
+
+void spectrum_channel_init(spectrum_channel *ch) {
+    memset(ch->slots, 0, sizeof(ch->slots));
+    ch->write_idx = 0;
+    atomic_init(&ch->middle, 1);
+    ch->read_idx = 2;
+    ch->next_seq = 0;
+    ch->last_seq = 0;
+    ch->dropped = 0;
+}
+
+spectrum_frame *spectrum_channel_begin(spectrum_channel *ch) {
+    return &ch->slots[ch->write_idx];
+}
+
+void spectrum_channel_publish(spectrum_channel *ch) {
+    ch->slots[ch->write_idx].seq = ++ch->next_seq;
+    // release：保证这一帧的内容在下标交换之前全部可见
+    unsigned int prev = atomic_exchange_explicit(&ch->middle, ch->write_idx | SLOT_DIRTY,
+                                                 memory_order_acq_rel);
+    ch->write_idx = prev & 3u;
+}
+
+const spectrum_frame *spectrum_channel_latest(spectrum_channel *ch, int *fresh) {
+    *fresh = 0;
+    if (atomic_load_explicit(&ch->middle, memory_order_relaxed) & SLOT_DIRTY) {
+        unsigned int prev = atomic_exchange_explicit(&ch->middle, ch->read_idx,
+                                                     memory_order_acq_rel);
+        ch->read_idx = prev & 3u;
+
+        const spectrum_frame *f = &ch->slots[ch->read_idx];
+        if (ch->last_seq && f->seq > ch->last_seq + 1)
+            ch->dropped += f->seq - ch->last_seq - 1;
+        ch->last_seq = f->seq;
+        *fresh = 1;
+    }
+    return &ch->slots[ch->read_idx];
+}
+
+// --- STFT ---
+// 对数频率分柱：从第一个非直流 bin 到奈奎斯特频率按等比切成 bars 段，
+// 每段至少一个 bin，低频那头 bin 不够分时往上顺延
+static void build_bar_table(spectrum_stft *st) {
+    int n = st->fft.n;
+    int last = n / 2 + 1;
+    double f_lo = (double)st->rate / n;     // bin 1 的频率
+    double f_hi = st->rate / 2.0;
+
+    st->bar_edge[0] = 1;
+    for (int i = 1; i <= st->bars; i++) {
+        double f = f_lo * pow(f_hi / f_lo, (double)i / st->bars);
+        int bin = (int)(f * n / st->rate + 0.5);
+        if (bin <= st->bar_edge[i - 1]) bin = st->bar_edge[i - 1] + 1;
+        if (bin > last) bin = last;
+        st->bar_edge[i] = bin;
+    }
+}
+
+int spectrum_stft_init(spectrum_stft *st, int n, int hop, int rate, int bars,
+                       unsigned flags, const char *wisdom_file) {
+    memset(st, 0, sizeof(*st));
+    if (n < SPECTRUM_MIN_FFT || n > SPECTRUM_MAX_FFT) {
+        fprintf(stderr, "FFT 点数要在 %d ~ %d 之间\n", SPECTRUM_MIN_FFT, SPECTRUM_MAX_FFT);
+        return -1;
+    }
+    if (hop < 1 || hop > n) {
+        fprintf(stderr, "帧移要在 1 ~ %d 之间\n", n);
+        return -1;
+    }
+    if (bars < 1 || bars > SPECTRUM_MAX_BARS || bars > n / 2) {
+        fprintf(stderr, "柱子数太多\n");
+        return -1;
+    }
+
+    st->rate = rate;
+    st->hop = hop;
+    st->bars = bars;
+    st->hist = (float*) calloc(2 * n, sizeof(float));
+    st->bar_edge = (int*) malloc(sizeof(int) * (bars + 1));
+    st->smooth = (double*) calloc(bars, sizeof(double));
+    st->peak = (double*) calloc(bars, sizeof(double));
+    st->peak_age = (int*) calloc(bars, sizeof(int));
+    if (!st->hist || !st->bar_edge || !st->smooth || !st->peak || !st->peak_age ||
+        spectrum_init(&st->fft, n, flags, wisdom_file) < 0) {
+        spectrum_stft_destroy(st);
+        return -1;
+    }
+
+    build_bar_table(st);
+    return 0;
+}
+
+void spectrum_stft_destroy(spectrum_stft *st) {
+    spectrum_destroy(&st->fft);
+    free(st->hist);
+    free(st->bar_edge);
+    free(st->smooth);
+    free(st->peak);
+    free(st->peak_age);
+    st->hist = NULL;
+    st->bar_edge = NULL;
+    st->smooth = st->peak = NULL;
+    st->peak_age = NULL;
+}
+
+void spectrum_stft_set_smoothing(spectrum_stft *st, double decay, int peak_hold) {
+    st->decay = decay;
+    st->peak_hold = peak_hold;
+}
+
+// 对历史环里最近 n 个样本算一帧
+static void stft_analyze(spectrum_stft *st, spectrum_frame *frame) {
+    unsigned long long t0 = now_ns();
+    spectrum_ctx *ctx = &st->fft;
+    int n = ctx->n;
+    const float *x = st->hist + st->hist_pos; // 最老的样本
+
+    for (int i = 0; i < n; i++) ctx->in[i] = x[i] * ctx->window[i];
+    fftw_execute(ctx->plan);
+
+    // 汉宁窗下，幅度 A 的正弦在峰值 bin 的模长约为 A*n/4
+    double scale = SPECTRUM_FULL_SCALE / (32768.0 * n / 4);
+    for (int b = 0; b < st->bars; b++) {
+        // 一根柱子取范围内最大的 bin：宽的柱子 (高频) 不会因为求平均被压扁
+        double m2 = 0;
+        for (int k = st->bar_edge[b]; k < st->bar_edge[b + 1]; k++) {
+            double p = ctx->out[k][0] * ctx->out[k][0] + ctx->out[k][1] * ctx->out[k][1];
+            if (p > m2) m2 = p;
+        }
+        double h = sqrt(m2) * scale;
+
+        // 平滑：上涨立刻跟上，下落最多落到上一帧的 decay 倍
+        if (st->decay > 0 && h < st->smooth[b] * st->decay) h = st->smooth[b] * st->decay;
+        st->smooth[b] = h;
+        frame->heights[b] = h;
+
+        // 峰值保持：新高就停住，停够 peak_hold 帧后每帧掉一点
+        if (st->peak_hold > 0) {
+            if (h >= st->peak[b]) {
+                st->peak[b] = h;
+                st->peak_age[b] = 0;
+            } else if (++st->peak_age[b] > st->peak_hold) {
+                st->peak[b] *= 0.9;
+                if (st->peak[b] < h) st->peak[b] = h;
+            }
+        }
+        frame->peaks[b] = st->peak[b];
+    }
+
+    ctx->total_ns += now_ns() - t0;
+    ctx->frames++;
+}
+
+static inline void hist_put(spectrum_stft *st, float v) {
+    st->hist[st->hist_pos] = v;
+    st->hist[st->hist_pos + st->fft.n] = v;
+    if (++st->hist_pos == st->fft.n) st->hist_pos = 0;
+}
+
+int spectrum_stft_push(spectrum_stft *st, const short *pcm, int stride, int count,
+                       spectrum_channel *ch) {
+    int produced = 0;
+
+    for (int i = 0; i < count; i++) {
+        hist_put(st, pcm[i * stride]);
+
+        if (++st->since_hop == st->hop) {
+            st->since_hop = 0;
+            stft_analyze(st, spectrum_channel_begin(ch));
+            spectrum_channel_publish(ch);
+            produced++;
+        }
+    }
+    st->samples += count;
+    return produced;
+}
+
+void spectrum_stft_feed(spectrum_stft *st, const short *pcm, int stride, int count) {
+    for (int i = 0; i < count; i++) hist_put(st, pcm[i * stride]);
+    st->samples += count;
+}
+
+void spectrum_stft_flush(spectrum_stft *st, spectrum_channel *ch) {
+    st->since_hop = 0;
+    stft_analyze(st, spectrum_channel_begin(ch));
+    spectrum_channel_publish(ch);
+}
+
+double spectrum_stft_cost(const spectrum_stft *st) {
+    if (st->samples == 0) return 0;
+    return (double)st->fft.total_ns * st->rate / st->samples;
+}
+
+void spectrum_stft_report(const spectrum_stft *st) {
+    double cost = spectrum_stft_cost(st);
+    printf("STFT: %d 点, 帧移 %d (%.1f 帧/秒), %.2f Hz/bin, 最低一根柱子 %.0f~%.0f Hz\n",
+           st->fft.n, st->hop, (double)st->rate / st->hop, (double)st->rate / st->fft.n,
+           (double)st->bar_edge[0] * st->rate / st->fft.n,
+           (double)st->bar_edge[1] * st->rate / st->fft.n);
+    if (st->fft.frames > 0) {
+        printf("  分析开销: %.0f ns/帧, %.3f ms CPU/秒音频 (单核 %.2f%%)\n",
+               (double)st->fft.total_ns / st->fft.frames, cost / 1e6, cost / 1e7);
+    }
+}
+
+void spectrum_stft_bench(int rate, int bars, unsigned flags, const char *wisdom_file) {
+    int count = rate * 2; // 每种组合喂 2 秒音频
+    short *pcm = (short*) malloc(sizeof(short) * count);
+    spectrum_channel ch;
+
+    for (int i = 0; i < count; i++) {
+        pcm[i] = (short)(8000 * sin(2*M_PI*440*i/(double)rate) + (rand() % 200 - 100));
+    }
+
+    printf("%6s %6s %8s %10s %12s %8s\n", "FFT", "帧移", "帧/秒", "ns/帧", "ms/秒音频", "单核%");
+    for (int n = SPECTRUM_MIN_FFT; n <= SPECTRUM_MAX_FFT; n *= 2) {
+        for (int div = 1; div <= 8; div *= 2) {
+            spectrum_stft st;
+            if (spectrum_stft_init(&st, n, n / div, rate, bars, flags, wisdom_file) < 0) {
+                free(pcm);
+                return;
+            }
+            spectrum_channel_init(&ch);
+            spectrum_stft_push(&st, pcm, 1, count, &ch);
+
+            double cost = spectrum_stft_cost(&st);
+            printf("%6d %6d %8.1f %10.0f %12.3f %8.2f\n", n, st.hop, (double)rate / st.hop,
+                   (double)st.fft.total_ns / st.fft.frames, cost / 1e6, cost / 1e7);
+            spectrum_stft_destroy(&st);
+        }
+    }
+    free(pcm);
+}
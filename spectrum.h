@@ -0,0 +1,129 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <fftw3.h>
+#include <stdatomic.h>
+
+// FFTW 的 "智慧" 文件：第一次启动时 MEASURE 出来的最优计划存在这里，
+// 以后启动直接读取，不用再花几百毫秒重新测
+#define SPECTRUM_WISDOM_FILE ".fftw_wisdom"
+
+// --- 频谱分析上下文 ---
+// 启动时创建一次，之后每个周期只做 "加窗拷贝 + fftw_execute"
+typedef struct {
+    int n;              // FFT 点数
+    double *in;         // 输入 (fftw_malloc 保证 SIMD 对齐)
+    fftw_complex *out;  // 输出，只有 n/2+1 个有效点
+    double *window;     // 预先算好的汉宁窗
+    fftw_plan plan;
+
+    // 计时统计 (纳秒)，用来证明优化效果
+    unsigned long long frames;
+    unsigned long long total_ns;
+} spectrum_ctx;
+
+// 创建上下文
+// flags: FFTW_MEASURE 或 FFTW_PATIENT (越大越慢，但计划越好)
+// wisdom_file: 可以为 NULL，表示不读写智慧文件
+int spectrum_init(spectrum_ctx *ctx, int n, unsigned flags, const char *wisdom_file);
+void spectrum_destroy(spectrum_ctx *ctx);
+
+// 建一个一次算 howmany 个 n 点实数 FFT 的计划 (in 里相邻两段隔 n 个，out 里隔 n/2+1 个)，
+// 读写智慧文件的规矩和 spectrum_init 一样。FFTW 的规划不是线程安全的，要在一个线程里建
+fftw_plan spectrum_plan_batch(int n, int howmany, double *in, fftw_complex *out,
+                              unsigned flags, const char *wisdom_file);
+
+// 计算一帧频谱
+// pcm: 交错的 PCM 数据，stride 是相邻两个样本的间隔 (立体声取左声道就传 2)
+// count: 实际可用的样本数，不足 n 的部分补零
+// heights: 输出 bars 根柱子的高度
+void compute_spectrum(spectrum_ctx *ctx, const short *pcm, int stride, int count,
+                      double *heights, int bars);
+
+// 老办法 (每帧 malloc + 建计划 + 销毁) 对比新办法的每帧耗时
+void spectrum_bench(int n, int iterations, unsigned flags, const char *wisdom_file);
+
+// --- 音频线程 -> UI 线程 的频谱快照通道 ---
+// 单生产者/单消费者三缓冲：三个槽位，生产者和消费者各占一个，
+// 第三个放在 "中间" 交换。双方都只做一次原子交换，谁都不会等谁，
+// UI 拿到的永远是一整帧，不会画出写了一半的柱子。
+#define SPECTRUM_MAX_BARS 128
+
+typedef struct {
+    unsigned long seq;                  // 帧序号，从 1 开始递增
+    double heights[SPECTRUM_MAX_BARS];
+    double peaks[SPECTRUM_MAX_BARS];    // 峰值保持的位置 (没开峰值保持时全 0)
+} spectrum_frame;
+
+typedef struct {
+    spectrum_frame slots[3];
+    atomic_uint middle;         // 中间槽位的下标，带 "有新数据" 标志位
+    unsigned int write_idx;     // 只有生产者碰
+    unsigned int read_idx;      // 只有消费者碰
+    unsigned long next_seq;     // 生产者的序号计数
+    unsigned long last_seq;     // 消费者上次看到的序号
+    unsigned long dropped;      // 消费者没来得及看就被覆盖的帧数
+} spectrum_channel;
+
+void spectrum_channel_init(spectrum_channel *ch);
+
+// 生产者：拿到一个可以随便写的槽位，写完调用 publish
+spectrum_frame *spectrum_channel_begin(spectrum_channel *ch);
+void spectrum_channel_publish(spectrum_channel *ch);
+
+// 消费者：返回最新的完整帧；fresh 告诉你它是不是上次之后的新帧
+// 没有新帧时返回上次那帧 (一帧都没有时 seq 为 0)
+const spectrum_frame *spectrum_channel_latest(spectrum_channel *ch, int *fresh);
+
+// --- 短时傅里叶分析 (STFT)：FFT 点数和播放的周期大小无关 ---
+// 播放线程每个周期把样本推进来，先进一个历史环，每攒够 hop 个新样本就对
+// "最近 n 个样本" 做一次 FFT。hop 比 n 小时相邻两帧重叠，帧率 = rate / hop。
+// 柱子按对数频率分：每根柱子覆盖哪些 bin 启动时算成一张表，低音也能分得开。
+#define SPECTRUM_MIN_FFT 1024
+#define SPECTRUM_MAX_FFT 16384
+// 满刻度正弦 (0 dBFS) 对应的柱子高度 (行)
+#define SPECTRUM_FULL_SCALE 20.0
+
+typedef struct {
+    spectrum_ctx fft;
+    int rate;
+    int hop;
+    int bars;
+    float *hist;        // 2n 个：每个样本同时写在 pos 和 pos+n，最近 n 个永远是连续的
+    int hist_pos;
+    int since_hop;      // 上一帧之后又来了几个样本
+    int *bar_edge;      // bars+1 个，第 i 根柱子是 [bar_edge[i], bar_edge[i+1]) 这些 bin
+
+    // 平滑和峰值保持
+    double decay;       // 柱子每帧最多落到上一帧的多少倍 (0 = 不平滑)
+    int peak_hold;      // 峰值停多少帧再开始掉 (0 = 关)
+    double *smooth;
+    double *peak;
+    int *peak_age;
+
+    unsigned long long samples; // 一共推进来多少样本，用来算每秒音频的分析开销
+} spectrum_stft;
+
+// n: FFT 点数 (SPECTRUM_MIN_FFT ~ SPECTRUM_MAX_FFT)；hop: 帧移 (1 ~ n)
+int spectrum_stft_init(spectrum_stft *st, int n, int hop, int rate, int bars,
+                       unsigned flags, const char *wisdom_file);
+void spectrum_stft_destroy(spectrum_stft *st);
+void spectrum_stft_set_smoothing(spectrum_stft *st, double decay, int peak_hold);
+
+// 推入 count 个样本 (交错 PCM，跳着取 stride)，每攒够 hop 个就算一帧发布到 ch
+// 返回这次算了几帧
+int spectrum_stft_push(spectrum_stft *st, const short *pcm, int stride, int count,
+                       spectrum_channel *ch);
+// 跟不上时用：feed 只把样本放进历史环不算帧，最后调一次 flush 对最新的窗口算一帧，
+// 中间本该出的那些帧就合并掉了
+void spectrum_stft_feed(spectrum_stft *st, const short *pcm, int stride, int count);
+void spectrum_stft_flush(spectrum_stft *st, spectrum_channel *ch);
+
+// 每秒音频花了多少 CPU 时间 (纳秒)
+double spectrum_stft_cost(const spectrum_stft *st);
+void spectrum_stft_report(const spectrum_stft *st);
+
+// 各种 FFT 点数 / 帧移组合的每秒开销对照表，用来按 CPU 预算挑参数
+void spectrum_stft_bench(int rate, int bars, unsigned flags, const char *wisdom_file);
+
+#endif
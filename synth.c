@@ -0,0 +1,430 @@
+#include <math.h>
+#include <string.h>
+#include "synth.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SYNTH_X86 1
+#endif
+
+// --- 路径选择 ---
+enum { ISA_SCALAR, ISA_SSE2, ISA_AVX2 };
+static int isa = -1;
+static int forced_isa = -1;
+
+static int pick_isa(void) {
+    if (isa >= 0) return isa;
+    isa = ISA_SCALAR;
+#ifdef SYNTH_X86
+#ifdef __SSE2__
+    isa = ISA_SSE2;
+#endif
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) isa = ISA_AVX2;
+#endif
+    return isa;
+}
+
+static const char *isa_names[] = { "scalar", "sse2", "avx2" };
+
+static int cur_isa(void) {
+    return forced_isa >= 0 ? forced_isa : pick_isa();
+}
+
+const char *synth_isa(void) {
+    return isa_names[cur_isa()];
+}
+
+int synth_set_isa(const char *name) {
+    if (!name) {
+        forced_isa = -1;
+        return 0;
+    }
+    for (int i = ISA_SCALAR; i <= ISA_AVX2; i++) {
+        // 只能往下选，不能选 CPU 没有的
+        if (strcmp(name, isa_names[i]) == 0 && i <= pick_isa()) {
+            forced_isa = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// --- ADSR 拆段 ---
+// 找第一个满足 i/rate >= t 的采样下标，比较方式和 get_adsr_volume 完全一样
+static long first_sample_at(double t, int rate) {
+    long i = (long)ceil(t * rate);
+    if (i < 0) i = 0;
+    while (i > 0 && (double)(i - 1) / rate >= t) i--;
+    while ((double)i / rate < t) i++;
+    return i;
+}
+
+static void add_segment(env_ramps *r, long start, long end, double level, double slope) {
+    if (end <= start) return;
+    env_segment *s = &r->seg[r->count++];
+    s->start = start;
+    s->end = end;
+    s->level = level;
+    s->slope = slope;
+}
+
+void adsr_ramps(env_ramps *r, ADSR env, double duration, int rate, long total_samples) {
+    r->count = 0;
+
+    long a_end = first_sample_at(env.attack, rate);
+    long d_end = first_sample_at(env.attack + env.decay, rate);
+    long s_end = first_sample_at(duration - env.release, rate);
+    if (a_end > total_samples) a_end = total_samples;
+    if (d_end > total_samples) d_end = total_samples;
+    if (s_end > total_samples) s_end = total_samples;
+
+    // Attack: 0 -> 1
+    add_segment(r, 0, a_end, 0.0, 1.0 / (env.attack * rate));
+
+    // Decay: 1 -> Sustain
+    double d_slope = -(1.0 - env.sustain_level) / (env.decay * rate);
+    add_segment(r, a_end, d_end,
+                1.0 + d_slope * (a_end - env.attack * rate), d_slope);
+
+    // Sustain: 保持
+    add_segment(r, d_end, s_end, env.sustain_level, 0.0);
+
+    // Release: Sustain -> 0，起点用 duration - release，和原公式一致
+    long r_start = s_end > d_end ? s_end : d_end;
+    double r_slope = -env.sustain_level / (env.release * rate);
+    double release_start = (duration - env.release) * rate;
+    add_segment(r, r_start, total_samples,
+                env.sustain_level + r_slope * (r_start - release_start), r_slope);
+}
+
+// --- 正弦振荡器 ---
+// 块开头精确算相位；相位先对 1 取模，长曲子也不会因为 t 很大丢精度
+static void osc_seed(double freq, int rate, long start, double *s0, double *c0,
+                     double *sw, double *cw) {
+    double cycles = freq * (double)start / rate;
+    double p0 = 2.0 * M_PI * (cycles - floor(cycles));
+    double w = 2.0 * M_PI * freq / rate;
+    *s0 = sin(p0);
+    *c0 = cos(p0);
+    *sw = sin(w);
+    *cw = cos(w);
+}
+
+// 标量版：double 递推，每个采样旋转一次
+static void osc_add_scalar(float *acc, int n, double amp,
+                           double s, double c, double sw, double cw) {
+    for (int i = 0; i < n; i++) {
+        acc[i] += (float)(amp * s);
+        double ns = s * cw + c * sw;
+        c = c * cw - s * sw;
+        s = ns;
+    }
+}
+
+// 把 (s, c) 往前转 k 步，给每个 SIMD 通道定初值
+static void rotate(double *s, double *c, double sw, double cw, int k) {
+    for (int i = 0; i < k; i++) {
+        double ns = *s * cw + *c * sw;
+        *c = *c * cw - *s * sw;
+        *s = ns;
+    }
+}
+
+#ifdef SYNTH_X86
+#ifdef __SSE2__
+// SSE2：4 个通道分别是第 i, i+1, i+2, i+3 个采样，每步一起转 4 个采样的角度
+static int osc_add_sse2(float *acc, int n, double amp,
+                        double s, double c, double sw, double cw) {
+    float ls[4], lc[4];
+    double ts = s, tc = c;
+    for (int l = 0; l < 4; l++) {
+        ls[l] = (float)ts;
+        lc[l] = (float)tc;
+        rotate(&ts, &tc, sw, cw, 1);
+    }
+    double s4 = 0, c4 = 1;
+    rotate(&s4, &c4, sw, cw, 4);
+
+    __m128 vs = _mm_loadu_ps(ls), vc = _mm_loadu_ps(lc);
+    __m128 vsw = _mm_set1_ps((float)s4), vcw = _mm_set1_ps((float)c4);
+    __m128 va = _mm_set1_ps((float)amp);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(acc + i);
+        _mm_storeu_ps(acc + i, _mm_add_ps(a, _mm_mul_ps(va, vs)));
+        __m128 ns = _mm_add_ps(_mm_mul_ps(vs, vcw), _mm_mul_ps(vc, vsw));
+        vc = _mm_sub_ps(_mm_mul_ps(vc, vcw), _mm_mul_ps(vs, vsw));
+        vs = ns;
+    }
+    return i;
+}
+#endif
+
+__attribute__((target("avx2")))
+static int osc_add_avx2(float *acc, int n, double amp,
+                        double s, double c, double sw, double cw) {
+    float ls[8], lc[8];
+    double ts = s, tc = c;
+    for (int l = 0; l < 8; l++) {
+        ls[l] = (float)ts;
+        lc[l] = (float)tc;
+        rotate(&ts, &tc, sw, cw, 1);
+    }
+    double s8 = 0, c8 = 1;
+    rotate(&s8, &c8, sw, cw, 8);
+
+    __m256 vs = _mm256_loadu_ps(ls), vc = _mm256_loadu_ps(lc);
+    __m256 vsw = _mm256_set1_ps((float)s8), vcw = _mm256_set1_ps((float)c8);
+    __m256 va = _mm256_set1_ps((float)amp);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(acc + i);
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(a, _mm256_mul_ps(va, vs)));
+        __m256 ns = _mm256_add_ps(_mm256_mul_ps(vs, vcw), _mm256_mul_ps(vc, vsw));
+        vc = _mm256_sub_ps(_mm256_mul_ps(vc, vcw), _mm256_mul_ps(vs, vsw));
+        vs = ns;
+    }
+    return i;
+}
+#endif
+
+void synth_osc_add(float *acc, int n, double freq, double amp, int rate, long start) {
+    double s, c, sw, cw;
+    osc_seed(freq, rate, start, &s, &c, &sw, &cw);
+
+    int done = 0;
+#ifdef SYNTH_X86
+    int which = cur_isa();
+    if (which == ISA_AVX2) done = osc_add_avx2(acc, n, amp, s, c, sw, cw);
+#ifdef __SSE2__
+    else if (which == ISA_SSE2) done = osc_add_sse2(acc, n, amp, s, c, sw, cw);
+#endif
+#endif
+    // 向量版剩下的尾巴 (或者整块，在标量路径下) 重新定相位接着算
+    if (done < n) {
+        if (done > 0) osc_seed(freq, rate, start + done, &s, &c, &sw, &cw);
+        osc_add_scalar(acc + done, n - done, amp, s, c, sw, cw);
+    }
+}
+
+// --- 包络 ---
+static void ramp_scalar(float *acc, int n, double level, double slope) {
+    for (int i = 0; i < n; i++) acc[i] *= (float)(level + slope * i);
+}
+
+#ifdef SYNTH_X86
+#ifdef __SSE2__
+static int ramp_sse2(float *acc, int n, double level, double slope) {
+    __m128 base = _mm_set1_ps((float)level);
+    __m128 vslope = _mm_set1_ps((float)slope);
+    __m128 k = _mm_setr_ps(0, 1, 2, 3);
+    __m128 four = _mm_set1_ps(4);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 g = _mm_add_ps(base, _mm_mul_ps(vslope, k));
+        _mm_storeu_ps(acc + i, _mm_mul_ps(_mm_loadu_ps(acc + i), g));
+        k = _mm_add_ps(k, four);
+    }
+    return i;
+}
+#endif
+
+__attribute__((target("avx2")))
+static int ramp_avx2(float *acc, int n, double level, double slope) {
+    __m256 base = _mm256_set1_ps((float)level);
+    __m256 vslope = _mm256_set1_ps((float)slope);
+    __m256 k = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 eight = _mm256_set1_ps(8);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 g = _mm256_add_ps(base, _mm256_mul_ps(vslope, k));
+        _mm256_storeu_ps(acc + i, _mm256_mul_ps(_mm256_loadu_ps(acc + i), g));
+        k = _mm256_add_ps(k, eight);
+    }
+    return i;
+}
+#endif
+
+static void ramp(float *acc, int n, double level, double slope) {
+    int done = 0;
+#ifdef SYNTH_X86
+    int which = cur_isa();
+    if (which == ISA_AVX2) done = ramp_avx2(acc, n, level, slope);
+#ifdef __SSE2__
+    else if (which == ISA_SSE2) done = ramp_sse2(acc, n, level, slope);
+#endif
+#endif
+    ramp_scalar(acc + done, n - done, level + slope * done, slope);
+}
+
+void synth_env_apply(float *acc, int n, const env_ramps *r, long start) {
+    long end = start + n;
+    long covered = start;
+
+    for (int k = 0; k < r->count; k++) {
+        const env_segment *s = &r->seg[k];
+        long from = s->start > start ? s->start : start;
+        long to = s->end < end ? s->end : end;
+        if (from >= to) continue;
+
+        // 段之间如果有空隙 (不应该有)，按静音处理
+        for (long j = covered; j < from; j++) acc[j - start] = 0;
+        ramp(acc + (from - start), to - from, s->level + s->slope * (from - s->start), s->slope);
+        covered = to;
+    }
+    for (long j = covered; j < end; j++) acc[j - start] = 0;
+}
+
+// --- 输出 ---
+static short clip_s16(float v) {
+    // 和 (short)x 一样向零截断，但超范围时饱和
+    if (v >= 32767.0f) return 32767;
+    if (v <= -32768.0f) return -32768;
+    return (short)v;
+}
+
+void synth_store_stereo_s16(short *out, const float *in, int n) {
+    int i = 0;
+#if defined(SYNTH_X86) && defined(__SSE2__)
+    if (cur_isa() != ISA_SCALAR) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i a = _mm_cvttps_epi32(_mm_loadu_ps(in + i));
+            __m128i b = _mm_cvttps_epi32(_mm_loadu_ps(in + i + 4));
+            __m128i p = _mm_packs_epi32(a, b);              // 饱和到 int16
+            _mm_storeu_si128((__m128i *)(out + i * 2), _mm_unpacklo_epi16(p, p));
+            _mm_storeu_si128((__m128i *)(out + i * 2 + 8), _mm_unpackhi_epi16(p, p));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        short v = clip_s16(in[i]);
+        out[i * 2] = v;     // Left
+        out[i * 2 + 1] = v; // Right
+    }
+}
+
+void synth_store_stereo_f32(float *out, const float *in, int n) {
+    int i = 0;
+#if defined(SYNTH_X86) && defined(__SSE2__)
+    if (cur_isa() != ISA_SCALAR) {
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(in + i);
+            _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(v, v));
+            _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(v, v));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        out[i * 2] = in[i];
+        out[i * 2 + 1] = in[i];
+    }
+}
+
+// --- 逐采样的参考实现 ---
+// 两个生成器最早的写法，留着做对照 (误差测试、make bench)
+// 生成一个音符里的一小段波形
+// buffer: 写入的目标 (交错立体声)
+// freq: 频率 (Hz)
+// rate: 采样率
+// from: 从这个音符的第几个采样开始
+// n: 生成多少个采样
+void generate_tone(short *buffer, double freq, int rate, long from, int n) {
+    for (int i = 0; i < n; i++) {
+        double t = (double)(from + i) / rate;
+        
+        // 核心：生成正弦波
+        // 振幅设为 10000 (最大32767)，防止太吵
+        short sample_value = (short)(10000 * sin(2.0 * M_PI * freq * t));
+        
+        // 写入立体声 (左声道 = 右声道)
+        buffer[i*2]     = sample_value; // Left
+        buffer[i*2 + 1] = sample_value; // Right
+    }
+}
+
+// ADSR 计算函数：根据当前时间 t 返回一个 0.0 ~ 1.0 的音量系数
+double get_adsr_volume(double t, double total_duration, ADSR env) {
+    double volume = 0.0;
+    double sustain_time = total_duration - env.attack - env.decay - env.release;
+    
+    // 防止音符太短导致时间计算出错
+    if (sustain_time < 0) sustain_time = 0;
+
+    if (t < env.attack) {
+        // Attack 阶段: 0 -> 1
+        volume = t / env.attack;
+    } else if (t < env.attack + env.decay) {
+        // Decay 阶段: 1 -> Sustain
+        double progress = (t - env.attack) / env.decay;
+        volume = 1.0 - progress * (1.0 - env.sustain_level);
+    } else if (t < total_duration - env.release) {
+        // Sustain 阶段: 保持 Sustain Level
+        volume = env.sustain_level;
+    } else {
+        // Release 阶段: Sustain -> 0
+        double release_start_time = total_duration - env.release;
+        double progress = (t - release_start_time) / env.release;
+        volume = env.sustain_level * (1.0 - progress);
+    }
+    
+    return (volume > 0) ? volume : 0;
+}
+
+// 生成并混合音符
+// buffer: 写入目标
+// freq1: 主旋律频率
+// freq2: 和声频率
+// duration: 持续时间
+// rate: 采样率
+// offset: 写入位置
+int generate_poly_tone(short *buffer, double freq1, double freq2, double duration, int rate, int offset) {
+    int total_samples = duration * rate;
+    ADSR env = {0.05, 0.1, 0.7, 0.15}; // 定义一个舒服的包络
+
+    for (int i = 0; i < total_samples; i++) {
+        double t = (double)i / rate;
+        
+        // 1. 计算 ADSR 音量 (让声音有动态)
+        double vol_factor = get_adsr_volume(t, duration, env);
+
+        // 2. 生成两个波形 (主旋律 + 和声)
+        // 振幅设为 8000，两个加起来 16000，不会爆音 (最大32767)
+        double wave1 = 8000.0 * sin(2.0 * M_PI * freq1 * t); // 主旋律
+        double wave2 = 6000.0 * sin(2.0 * M_PI * freq2 * t); // 和声 (稍微小声点)
+
+        // 3. 混音 (直接相加) 并应用 ADSR，超出 16 位的饱和，不让 (short) 强转回绕
+        double mixed = (wave1 + wave2) * vol_factor;
+        if (mixed > 32767.0) mixed = 32767.0;
+        if (mixed < -32768.0) mixed = -32768.0;
+        short mixed_sample = (short)mixed;
+        
+        // 写入立体声
+        buffer[offset + i*2]     = mixed_sample; 
+        buffer[offset + i*2 + 1] = mixed_sample; 
+    }
+    
+    return offset + total_samples * 2;
+}
+
+// 和 generate_poly_tone 一样的声音，但走向量化内核：
+// 按块渲染，正弦用递推、包络用预先拆好的线性段，最后一次性饱和转换成交错立体声
+int generate_poly_tone_fast(short *buffer, double freq1, double freq2, double duration, int rate, int offset) {
+    int total_samples = duration * rate;
+    ADSR env = {0.05, 0.1, 0.7, 0.15};
+    env_ramps ramps;
+    float block[SYNTH_BLOCK];
+
+    adsr_ramps(&ramps, env, duration, rate, total_samples);
+
+    for (int i = 0; i < total_samples; i += SYNTH_BLOCK) {
+        int n = total_samples - i < SYNTH_BLOCK ? total_samples - i : SYNTH_BLOCK;
+        memset(block, 0, sizeof(float) * n);
+        synth_osc_add(block, n, freq1, 8000.0, rate, i); // 主旋律
+        synth_osc_add(block, n, freq2, 6000.0, rate, i); // 和声
+        synth_env_apply(block, n, &ramps, i);
+        synth_store_stereo_s16(buffer + offset + i * 2, block, n);
+    }
+
+    return offset + total_samples * 2;
+}
@@ -0,0 +1,67 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+// --- ADSR 参数 (单位：秒) ---
+// Attack(起音): 0.05s 瞬间达到最大音量
+// Decay(衰减): 0.1s  稍微回落
+// Sustain(延音): 0.8   保持在 80% 音量
+// Release(释音): 0.2s  松手后声音慢慢消失
+typedef struct {
+    double attack;
+    double decay;
+    double sustain_level;
+    double release;
+} ADSR;
+
+// --- 包络预先拆成线性段 ---
+// ADSR 每一段本来就是直线，所以提前算好 "从第几个采样开始、起点多高、每个采样涨多少"，
+// 内层循环就只剩乘加，不用每个采样都做一串 if。
+typedef struct {
+    long start;     // 这一段从第几个采样开始
+    long end;       // 到第几个采样为止 (不含)
+    double level;   // 起点音量
+    double slope;   // 每个采样的变化量
+} env_segment;
+
+typedef struct {
+    env_segment seg[4];
+    int count;
+} env_ramps;
+
+// 按 get_adsr_volume 同样的规则拆段，total_samples 是整个音符的采样数
+void adsr_ramps(env_ramps *r, ADSR env, double duration, int rate, long total_samples);
+
+// 内核一次处理的块大小 (采样)
+// 精度：内部用 float，每块重新定相位，递推误差不会累积。
+// 和全 double 的 generate_poly_tone 比，int16 输出最多差 1 LSB (取整边界上)，
+// gen_music_poly -b 会实际测一遍并打印出来。
+#define SYNTH_BLOCK 256
+
+// acc[0..n) += amp * sin(2π·freq·(start+i)/rate)
+// 用旋转递推代替 sin()：每块开头用 double 精确定一次相位，块内只做乘加
+void synth_osc_add(float *acc, int n, double freq, double amp, int rate, long start);
+
+// acc[0..n) *= 包络，start 是这一块在音符里的采样位置
+void synth_env_apply(float *acc, int n, const env_ramps *r, long start);
+
+// 单声道 float -> 交错立体声 (左右相同)
+// s16 版本截断取整并饱和到 [-32768, 32767]，不会像 (short) 强转那样回绕
+void synth_store_stereo_s16(short *out, const float *in, int n);
+void synth_store_stereo_f32(float *out, const float *in, int n);
+
+// 当前用的是哪条路径："avx2" / "sse2" / "scalar"
+const char *synth_isa(void);
+// 强制走某条路径 (测试/对比用)，NULL 恢复自动选择；CPU 不支持返回 -1
+int synth_set_isa(const char *name);
+
+// --- 逐采样的参考实现 (每个采样都调 sin) ---
+// 单音正弦，交错立体声；from 是这一段在音符里的起点
+void generate_tone(short *buffer, double freq, int rate, long from, int n);
+// t 时刻的包络音量 (0.0 ~ 1.0)
+double get_adsr_volume(double t, double total_duration, ADSR env);
+// 主旋律 + 和声两个正弦叠加再乘包络，写到 buffer[offset..]，返回新的 offset
+int generate_poly_tone(short *buffer, double freq1, double freq2, double duration, int rate, int offset);
+// 同样的声音走上面的向量化内核
+int generate_poly_tone_fast(short *buffer, double freq1, double freq2, double duration, int rate, int offset);
+
+#endif
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "tui.h"
+
+// 统计浮层用最后一个文字槽
+#define OVERLAY_SLOT (TUI_MAX_TEXT - 1)
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 这个线程一共 write() 了多少字节。UI 线程只往终端写东西，
+// 所以 refresh 前后一减就是这一帧发给终端的字节数
+static unsigned long long thread_wchar(const tui *t) {
+    char buf[512];
+    if (t->io_fd < 0) return 0;
+    ssize_t n = pread(t->io_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return 0;
+    buf[n] = 0;
+    const char *p = strstr(buf, "wchar:");
+    return p ? strtoull(p + 6, NULL, 10) : 0;
+}
+
+int tui_init(tui *t, int fps) {
+    memset(t, 0, sizeof(*t));
+    if (fps < 1) fps = TUI_DEFAULT_FPS;
+    t->interval_ns = 1000000000LL / fps;
+    t->next_frame = now_ns();
+    t->stats_start = t->next_frame;
+    t->io_fd = open("/proc/thread-self/io", O_RDONLY);
+
+    if (!initscr()) return -1;
+    cbreak();
+    noecho();
+    curs_set(0);
+    keypad(stdscr, TRUE);
+    tui_invalidate(t);
+    return 0;
+}
+
+void tui_end(tui *t) {
+    endwin();
+    if (t->io_fd >= 0) close(t->io_fd);
+    t->io_fd = -1;
+}
+
+int tui_getch(tui *t) {
+    long long wait = t->next_frame - now_ns();
+    // 往上取整：不到 1ms 的时候按 0 算的话就成了不等待，一直空转到下一帧
+    timeout(wait > 0 ? (int)((wait + 999999) / 1000000) : 0);
+    return getch();
+}
+
+int tui_frame_due(tui *t) {
+    long long now = now_ns();
+    if (now < t->next_frame) return 0;
+    t->next_frame += t->interval_ns;
+    // 落后太多 (比如被挂起过) 就别连着补帧了，从现在重新开始计
+    if (t->next_frame < now) t->next_frame = now + t->interval_ns;
+    return 1;
+}
+
+void tui_invalidate(tui *t) {
+    t->need_chrome = 1;
+    t->generation++;
+    memset(t->texts, 0, sizeof(t->texts));
+    for (int i = 0; i < TUI_MAX_TEXT; i++) t->texts[i].row = -1;
+}
+
+int tui_begin(tui *t) {
+    t->frame_start = now_ns();
+    t->wchar_start = thread_wchar(t);
+    if (!t->need_chrome) return 0;
+    t->need_chrome = 0;
+    erase();
+    return 1;
+}
+
+void tui_finish(tui *t) {
+    if (t->overlay) {
+        double secs = (now_ns() - t->stats_start) / 1e9;
+        tui_text(t, OVERLAY_SLOT, LINES - 1, 2,
+                 " render %lld us/frame  %llu B/frame  %.1f KB/s ",
+                 t->render_total_ns / (t->frames ? t->frames : 1) / 1000,
+                 t->bytes_last, secs > 0 ? t->bytes_total / secs / 1024 : 0.0);
+    }
+    refresh();
+
+    t->render_ns = now_ns() - t->frame_start;
+    t->render_total_ns += t->render_ns;
+    t->bytes_last = thread_wchar(t) - t->wchar_start;
+    t->bytes_total += t->bytes_last;
+    t->frames++;
+}
+
+void tui_text(tui *t, int slot, int row, int col, const char *fmt, ...) {
+    tui_text_slot *s = &t->texts[slot];
+    char buf[TUI_TEXT_LEN];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (s->row == row && s->col == col && strcmp(s->text, buf) == 0) return;
+
+    int len = strlen(buf);
+    mvaddstr(row, col, buf);
+    // 新内容比上次短，剩下那截用空格盖掉
+    if (s->row == row && s->col == col && s->len > len) printw("%*s", s->len - len, "");
+
+    s->row = row;
+    s->col = col;
+    s->len = len;
+    memcpy(s->text, buf, len + 1);
+}
+
+int tui_bars_init(tui_bars *b, int count, int base_row, int col0, int col_step,
+                  int width, int max_height, attr_t attr) {
+    memset(b, 0, sizeof(*b));
+    b->count = count;
+    b->base_row = base_row;
+    b->col0 = col0;
+    b->col_step = col_step;
+    b->width = width;
+    b->max_height = max_height;
+    b->attr = attr;
+    b->generation = -1;
+    b->shown = (int *)calloc(count, sizeof(int));
+    b->shown_peak = (int *)calloc(count, sizeof(int));
+    if (!b->shown || !b->shown_peak) {
+        tui_bars_free(b);
+        return -1;
+    }
+    return 0;
+}
+
+void tui_bars_free(tui_bars *b) {
+    free(b->shown);
+    free(b->shown_peak);
+    b->shown = b->shown_peak = NULL;
+}
+
+// 第 k 格 (从 1 开始，往上数) 画成 c
+static void bar_cell(const tui_bars *b, int i, int k, char c) {
+    char cell[16];
+    int w = b->width < (int)sizeof(cell) ? b->width : (int)sizeof(cell);
+    memset(cell, c, w);
+    mvaddnstr(b->base_row - (k - 1), b->col0 + i * b->col_step, cell, w);
+}
+
+static int clamp_height(const tui_bars *b, double v) {
+    int h = (int)v;
+    if (h < 0) h = 0;
+    if (h > b->max_height) h = b->max_height;
+    return h;
+}
+
+void tui_bars_update(tui *t, tui_bars *b, const double *heights, const double *peaks) {
+    // 屏幕被清过了，按 "现在什么都没画" 重新来
+    if (b->generation != t->generation) {
+        memset(b->shown, 0, sizeof(int) * b->count);
+        memset(b->shown_peak, 0, sizeof(int) * b->count);
+        b->generation = t->generation;
+    }
+
+    attron(b->attr);
+    for (int i = 0; i < b->count; i++) {
+        int old = b->shown[i];
+        int h = clamp_height(b, heights[i]);
+        int old_peak = b->shown_peak[i];
+        int p = peaks ? clamp_height(b, peaks[i]) : 0;
+        if (p <= h) p = 0; // 峰值被柱子盖住了就不用画
+
+        // 旧的峰值标记挪走了：不在新柱子里的话擦掉
+        if (old_peak && old_peak != p && old_peak > h) bar_cell(b, i, old_peak, ' ');
+
+        // 柱子长高了只补上面几格，变矮了只擦掉多出来的几格
+        for (int k = old + 1; k <= h; k++) bar_cell(b, i, k, '#');
+        for (int k = h + 1; k <= old; k++) bar_cell(b, i, k, ' ');
+
+        // 新位置，或者原来那格刚被柱子擦过
+        if (p && (p != old_peak || p <= old)) bar_cell(b, i, p, '-');
+
+        b->shown[i] = h;
+        b->shown_peak[i] = p;
+    }
+    attroff(b->attr);
+}
+
+void tui_report(const tui *t) {
+    if (t->frames == 0) return;
+    double secs = (now_ns() - t->stats_start) / 1e9;
+    printf("界面: %lu 帧, 平均渲染 %.0f us/帧, 往终端写了 %llu 字节 (%.0f B/帧, %.1f KB/s)\n",
+           t->frames, t->render_total_ns / 1e3 / t->frames, t->bytes_total,
+           (double)t->bytes_total / t->frames, secs > 0 ? t->bytes_total / secs / 1024 : 0.0);
+}
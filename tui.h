@@ -0,0 +1,83 @@
+#ifndef TUI_H
+#define TUI_H
+
+#include <ncurses.h>
+
+// --- 只画变化部分的终端渲染器 ---
+// 以前每一轮都 erase()/clear() 再把所有柱子和文字重画一遍，
+// clear() 还会逼 ncurses 把整屏重新发一遍，走 SSH 时能把链路占满。
+// 现在：
+//   * 边框、标题这些不变的东西只在启动 / 窗口大小变了的时候画一次
+//   * 文字记住上次写的内容，没变就不碰
+//   * 柱子记住上次的高度，只补画长出来的格子、擦掉缩回去的格子
+//   * 刷新按固定帧率走，和 getch 的超时无关：getch 最多等到下一帧的时间点
+#define TUI_DEFAULT_FPS 30
+#define TUI_MAX_TEXT 16     // 最多缓存多少段文字
+#define TUI_TEXT_LEN 128
+
+typedef struct {
+    int row, col;
+    int len;                // 上次写了多长，新内容短了要用空格盖掉
+    char text[TUI_TEXT_LEN];
+} tui_text_slot;
+
+typedef struct {
+    long long interval_ns;  // 一帧多长
+    long long next_frame;   // 下一帧的时间点 (CLOCK_MONOTONIC 纳秒)
+    int generation;         // 每次整屏重画加一，柱子/文字看到变了就知道屏幕被清过
+    int need_chrome;
+    int overlay;            // 是否显示统计浮层
+
+    tui_text_slot texts[TUI_MAX_TEXT];
+
+    // 统计
+    int io_fd;              // /proc/thread-self/io，用 wchar 算往终端写了多少字节
+    unsigned long frames;
+    long long render_ns;    // 最近一帧的渲染耗时
+    long long render_total_ns;
+    unsigned long long bytes_total;
+    unsigned long long bytes_last;  // 最近一帧写了多少字节
+    long long stats_start;
+    long long frame_start;
+    unsigned long long wchar_start;
+} tui;
+
+// 一组竖着的柱子：第 i 根在 col0 + i*col_step 列，宽 width 格，从 base_row 往上长
+typedef struct {
+    int count;
+    int base_row, col0, col_step, width, max_height;
+    attr_t attr;
+    int *shown;             // 屏幕上现在每根柱子多高
+    int *shown_peak;        // 屏幕上峰值标记在哪一格 (0 = 没有)
+    int generation;
+} tui_bars;
+
+// 初始化 ncurses (cbreak/noecho/隐藏光标)
+int tui_init(tui *t, int fps);
+void tui_end(tui *t);
+
+// 等按键，最多等到下一帧的时间点；没有按键返回 ERR
+int tui_getch(tui *t);
+// 到该画下一帧的时候了吗 (到了就把时间点往后推一帧)
+int tui_frame_due(tui *t);
+// 整屏作废 (窗口大小变了之类)，下一帧重画边框
+void tui_invalidate(tui *t);
+
+// 一帧的开始/结束。begin 返回 1 表示这一帧要先画不变的边框和标题
+int tui_begin(tui *t);
+void tui_finish(tui *t);
+
+// 在 (row, col) 写一段文字，slot 是调用方自己定的编号，内容没变就什么都不做
+void tui_text(tui *t, int slot, int row, int col, const char *fmt, ...)
+    __attribute__((format(printf, 5, 6)));
+
+int tui_bars_init(tui_bars *b, int count, int base_row, int col0, int col_step,
+                  int width, int max_height, attr_t attr);
+void tui_bars_free(tui_bars *b);
+// 把柱子更新到新高度 (peaks 可以为 NULL)，只动变了的格子
+void tui_bars_update(tui *t, tui_bars *b, const double *heights, const double *peaks);
+
+// 打印整段运行的渲染统计
+void tui_report(const tui *t);
+
+#endif
@@ -1,177 +1,443 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <unistd.h>
 #include <alsa/asoundlib.h>
 #include <ncurses.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <signal.h>
 #include <fftw3.h> // 引入 FFT 神器
+#include "spectrum.h"
+#include "wav_source.h"
+#include "spectrogram.h"
+#include "ringbuf.h"
+#include "tui.h"
+#include "pcm_stats.h"
+#include "audio_backend.h"
+#include "pcm_ctl.h"
+#include "rt.h"
 
-#define FRAMES 256  // 增大缓冲区，FFT 需要足够的数据样本才能算得准
+#define FRAMES 256  // 播放的周期大小；FFT 点数和它无关，见 -n
+#define OFFLINE_FRAMES 4096 // 离线时一次送多少帧 (不用管延迟，大点省开销)
 #define BARS 40     // 我们要在屏幕上画多少根柱子
+#define FFT_SIZE 4096 // 默认 FFT 点数：44.1kHz 下约 10.8 Hz 一个 bin
+#define ANALYSIS_RING_BYTES (512 * 1024) // 播放 -> 分析 的样本环，比最大的 FFT 窗口大得多
+#define ANALYSIS_CHUNK 1024 // 分析线程一次从环里取多少帧
 
 // --- 全局变量 ---
 volatile int keep_running = 1;
-volatile int is_paused = 0;
-// 这是一个共享数组，音频线程算好高度填进去，UI线程读出来画图
-double spectrum_heights[BARS]; 
-
-// --- 辅助函数：计算频谱 ---
-// 这是整个程序的灵魂！
-void compute_spectrum(short *buffer, int frames) {
-    // 1. 准备输入数据 (FFT 需要 double 类型)
-    double *in;
-    fftw_complex *out;
-    fftw_plan p;
-
-    in = (double*) fftw_malloc(sizeof(double) * frames);
-    out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * frames);
-
-    // 把 short (PCM) 转成 double，并加一个简单的汉宁窗(Hanning Window)让数据更平滑
-    for (int i = 0; i < frames; i++) {
-        double multiplier = 0.5 * (1 - cos(2*M_PI*i/(frames-1)));
-        in[i] = buffer[i] * multiplier; 
-    }
+int is_paused = 0;          // 界面上显示的状态
+pcm_ctl ctl;                // 界面 -> 播放线程：暂停/继续/退出 (离线模式不用，靠 keep_running)
+rt_opts rt;                 // -F：播放线程实时模式 (离线时不开，不然会把一个核占死)
+// 音频送到哪 (声卡 / 扔掉 / 文件)。不限速的后端就是离线模式：
+// 文件从头到尾过一遍，播放线程等分析线程而不是丢数据，不开界面，最后报吞吐
+audio_backend backend;
+int offline = 0;
+// 音频线程算好高度发布进来，UI线程取最新的一整帧画图 (无锁三缓冲)
+spectrum_channel spectrum_chan;
+// STFT 分析：分析线程把样本推进去，攒够一个帧移就算一帧 (FFT 计划启动时建好)
+spectrum_stft stft;
+// 播放线程把刚写给声卡的交错 PCM 丢进这个环 (文件不是 16 位的话先转成 16 位)，
+// 分析线程按自己的节奏取
+// 环满了播放线程就丢掉这一段，绝不等分析线程 (离线模式例外，见 analysis_space)
+ringbuf analysis_ring;
+sem_t analysis_ready;
+sem_t analysis_space;       // 离线模式：分析线程取走了数据，播放线程可以接着写
+atomic_int audio_done;      // 离线模式：文件放完了，分析线程把环读空就退出
+// 统计：确认播放没被分析拖累
+atomic_ulong ring_dropped;  // 环满了没送去分析的帧数
+atomic_ulong coalesced;     // 分析线程积压时合并掉的帧数 (按帧移算)
+
+// --- 音频线程 ---
+void *audio_thread_func(void *arg) {
+    wav_source *src = (wav_source *)arg; // main 里已经打开了，后端也开好了
+    snd_pcm_uframes_t frames = backend.period;
+    sf_dither dither;
+    char *conv = NULL;          // 文件格式声卡不吃时的中转
+    short *ana = NULL;          // 文件不是 16 位时送去分析的那份
+
+    sf_dither_init(&dither, 1);
+    if (backend.fmt != src->sample_fmt) conv = malloc(frames * src->channels * sf_bytes(backend.fmt));
+    if (src->sample_fmt != SF_S16) ana = malloc(frames * src->channels * sizeof(short));
+    if (conv) rt_prefault(conv, frames * src->channels * sf_bytes(backend.fmt));
+    if (ana) rt_prefault(ana, frames * src->channels * sizeof(short));
+    rt_enter(&rt, "visualizer");
+    rt_unlock(src->map, src->map_len);
 
-    // 2. 制定 FFT 计划并执行 (Real to Complex)
-    p = fftw_plan_dft_r2c_1d(frames, in, out, FFTW_ESTIMATE);
-    fftw_execute(p);
-
-    // 3. 计算这一帧的能量 (算出柱子高度)
-    // FFT 的结果是对称的，我们只需要前半部分
-    // 我们把结果简单的“分桶”到 BARS 根柱子里
-    int samples_per_bar = (frames / 2) / BARS; 
-
-    for (int i = 0; i < BARS; i++) {
-        double power = 0;
-        for (int j = 0; j < samples_per_bar; j++) {
-            // index 对应的频率数据
-            int index = i * samples_per_bar + j;
-            // 模长 = sqrt(实部^2 + 虚部^2)
-            double mag = sqrt(out[index][0]*out[index][0] + out[index][1]*out[index][1]);
-            power += mag;
+    int paused = 0;
+    while (keep_running) {
+        if (!offline) {
+            // 睡到声卡能写一个周期或者来了命令；暂停时声卡停住，只等命令
+            int ready;
+            int cmd = pcm_ctl_wait(&ctl, paused ? NULL : backend.pcm, &ready);
+            if (cmd < 0 || (cmd & PCM_CTL_QUIT)) break;
+            if ((cmd & PCM_CTL_PAUSE) && !paused) {
+                audio_backend_pause(&backend, 1);
+                paused = 1;
+            } else if ((cmd & PCM_CTL_RESUME) && paused) {
+                audio_backend_pause(&backend, 0);
+                pcm_stats_wake_reset(backend.stats);
+                paused = 0;
+            }
+            if (cmd) pcm_ctl_ack(&ctl);
+            if (paused || !ready) continue;
         }
-        
-        // 取平均并做一点数学缩小，防止柱子冲出屏幕
-        power /= samples_per_bar;
-        spectrum_heights[i] = power / 100000.0; // 这个除数取决于音量大小，可调
+
+        // 直接拿映射区里的指针，循环播放只是把读指针拨回开头 (离线只过一遍)
+        size_t n = frames;
+        const void *pcm = wav_source_next(src, &n);
+        if (!pcm) {
+            if (offline) break;
+            wav_source_rewind(src);
+            continue;
+        }
+        size_t samples = n * src->channels;
+
+        // 播放线程只管喂声卡：样本抄一份进环，叫醒分析线程就走
+        // 环满了说明分析跟不上，这一段直接不分析了；离线时没有声卡在等，就等分析线程
+        size_t bytes = samples * sizeof(short);
+        while (offline && keep_running && ringbuf_write_space(&analysis_ring) < bytes)
+            sem_wait(&analysis_space);
+        if (ringbuf_write_space(&analysis_ring) >= bytes) {
+            if (ana) sf_convert(ana, SF_S16, pcm, src->sample_fmt, samples, NULL); // 只是看，不用抖动
+            ringbuf_write(&analysis_ring, ana ? ana : pcm, bytes);
+            sem_post(&analysis_ready);
+        } else {
+            atomic_fetch_add(&ring_dropped, n);
+        }
+
+        if (conv) sf_convert(conv, backend.fmt, pcm, src->sample_fmt, samples, &dither);
+        if (audio_backend_write(&backend, conv ? conv : pcm, n) < 0) break;
     }
 
-    // 4. 清理内存 (极其重要，否则瞬间内存泄露爆炸)
-    fftw_destroy_plan(p);
-    fftw_free(in);
-    fftw_free(out);
+    atomic_store(&audio_done, 1);
+    sem_post(&analysis_ready);
+    free(conv);
+    free(ana);
+    return NULL;
 }
 
-// --- 音频线程 ---
-void *audio_thread_func(void *arg) {
-    int rc;
-    snd_pcm_t *handle;
-    snd_pcm_hw_params_t *params;
-    unsigned int val = 44100;
-    int dir;
-    snd_pcm_uframes_t frames = FRAMES;
-    char *buffer;
-    int size;
-
-    // 打开文件 (确保你有 output.wav)
-    FILE *fp = fopen("output.wav", "rb");
-    if (!fp) return NULL;
-    fseek(fp, 44, SEEK_SET);
-
-    rc = snd_pcm_open(&handle, "default", SND_PCM_STREAM_PLAYBACK, 0);
-    if (rc < 0) return NULL;
-
-    snd_pcm_hw_params_t *hw_params;
-    snd_pcm_hw_params_alloca(&hw_params);
-    snd_pcm_hw_params_any(handle, hw_params);
-    snd_pcm_hw_params_set_access(handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(handle, hw_params, SND_PCM_FORMAT_S16_LE);
-    snd_pcm_hw_params_set_channels(handle, hw_params, 2);
-    snd_pcm_hw_params_set_rate_near(handle, hw_params, &val, &dir);
-    // 这里强制设置 buffer size，方便 FFT 计算
-    snd_pcm_hw_params_set_period_size_near(handle, hw_params, &frames, &dir); 
-    snd_pcm_hw_params(handle, hw_params);
-
-    size = frames * 4; // 2 channel * 16bit
-    buffer = (char *) malloc(size);
+// --- 分析线程 ---
+// 从环里取样本喂给 STFT。积压超过一个 FFT 窗口时，前面那些样本算出来的帧
+// 反正马上就被更新的帧盖掉，干脆跳过，只用最后一个窗口算一帧
+void *analysis_thread_func(void *arg) {
+    wav_source *src = (wav_source *)arg;
+    int frame_bytes = src->channels * sizeof(short); // 环里总是 16 位
+    size_t window_bytes = (size_t)(stft.fft.n + stft.hop) * frame_bytes;
+    short *buf = (short *)malloc((size_t)ANALYSIS_CHUNK * frame_bytes);
 
     while (keep_running) {
-        if (is_paused) { usleep(100000); continue; }
-
-        if (fread(buffer, 1, size, fp) == 0) {
-            fseek(fp, 44, SEEK_SET);
+        // 先看 done 再看环：看到 done 时，它之前写进环的数据一定也看得到
+        int done = offline && atomic_load(&audio_done);
+        size_t avail = ringbuf_read_avail(&analysis_ring);
+        if (avail < (size_t)frame_bytes) {
+            if (done) break;
+            // 最多 100ms 醒一次看看要不要退出
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 100 * 1000000;
+            if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+            sem_timedwait(&analysis_ready, &ts);
             continue;
         }
 
-        // >>> 在播放之前，先算频谱！ <<<
-        // 我们只取左声道数据来分析 (short 是间隔排列的 L R L R)
-        // 创建一个临时 buffer 存左声道
-        short pcm_data[FRAMES];
-        short *raw_data = (short*)buffer;
-        for(int i=0; i<FRAMES; i++) {
-            pcm_data[i] = raw_data[i*2]; // 取偶数位，即左声道
+        int merge = 0;
+        if (!offline && avail > window_bytes) {
+            // 只留最后 n 帧
+            size_t skip = avail - (size_t)stft.fft.n * frame_bytes;
+            skip -= skip % frame_bytes;
+            ringbuf_read_advance(&analysis_ring, skip);
+            atomic_fetch_add(&coalesced, skip / frame_bytes / stft.hop);
+            avail -= skip;
+            merge = 1;
         }
-        compute_spectrum(pcm_data, FRAMES); // 计算！
 
-        rc = snd_pcm_writei(handle, buffer, frames);
-        if (rc == -EPIPE) snd_pcm_prepare(handle);
-    }
+        while (avail >= (size_t)frame_bytes) {
+            size_t frames = avail / frame_bytes;
+            if (frames > ANALYSIS_CHUNK) frames = ANALYSIS_CHUNK;
+            ringbuf_read(&analysis_ring, buf, frames * frame_bytes);
+            avail -= frames * frame_bytes;
+            if (offline) sem_post(&analysis_space);
 
-    fclose(fp);
-    snd_pcm_close(handle);
-    free(buffer);
+            // 只取左声道 (stride = 声道数)
+            if (merge) spectrum_stft_feed(&stft, buf, src->channels, frames);
+            else spectrum_stft_push(&stft, buf, src->channels, frames, &spectrum_chan);
+        }
+        if (merge) spectrum_stft_flush(&stft, &spectrum_chan);
+    }
+    sem_post(&analysis_space); // 离线时播放线程可能还在等空位，别让它卡住
+    free(buf);
     return NULL;
 }
 
-// --- UI 线程 ---
-int main() {
-    pthread_t thread_id;
-    pthread_create(&thread_id, NULL, audio_thread_func, NULL);
+static void usage(const char *prog) {
+    fprintf(stderr, "用法: %s [-n FFT点数] [-H 帧移] [-d 衰减] [-k 峰值保持帧数] [-f 帧率] [-J 文件] [-i 文件] [-a 后端] [-P] [-b] [-F 优先级[:CPU]]\n"
+                    "       %s -S 输出 [-i 文件] [-n FFT点数] [-H 帧移] [-Q] [-T 线程数] [-G 图.pgm] [-P]\n"
+                    "  -n  FFT 点数 %d ~ %d (默认 %d)\n"
+                    "  -H  帧移，比 FFT 点数小就是重叠分析 (默认 FFT 点数的 1/4)\n"
+                    "  -d  柱子下落的平滑系数 0 ~ 1 (默认 0.85，0 = 不平滑)\n"
+                    "  -k  峰值保持多少帧 (默认 0 = 关)\n"
+                    "  -f  界面刷新帧率 (默认 %d)，运行时按 s 显示渲染统计\n"
+                    "  -J  每秒往文件里追加一行 JSON 统计 (kill -USR1 打印到 stderr)\n"
+                    "  -i  要分析的 WAV (默认 output.wav)\n"
+                    "  -a  音频送到哪：alsa[:设备] (默认) / null / file:路径\n"
+                    "      null 和 file 不用声卡，不开界面，整个文件能多快就多快地分析一遍，\n"
+                    "      最后报告是实时的多少倍 (CI、批处理、没声卡的机器)\n"
+                    "  -P  FFTW_PATIENT 规划\n"
+                    "  -F  实时模式：播放线程 SCHED_FIFO (rr:优先级 用 SCHED_RR)，可以绑到一个 CPU，锁内存\n"
+                    "  -b  只跑 FFT 基准测试和 STFT 开销对照表\n"
+                    "  -S  不放不画，把整个文件的频谱图导出成矩阵文件 (多线程，见 spectrogram.h)\n"
+                    "  -Q  矩阵存成 uint8 dB (默认 float32)\n"
+                    "  -T  导出用几个线程 (默认有几个核用几个)\n"
+                    "  -G  顺便出一张 PGM 灰度图\n",
+            prog, prog, SPECTRUM_MIN_FFT, SPECTRUM_MAX_FFT, FFT_SIZE, TUI_DEFAULT_FPS);
+}
 
-    initscr();
-    cbreak();
-    noecho();
-    curs_set(0);
-    timeout(50); // 刷新率提高一点，让动画更流畅
+// --- 界面：跟着声卡的节奏实时画 ---
+static void run_ui(int fps, int peak_hold) {
+    tui ui;
+    tui_bars bars;
+    tui_init(&ui, fps);
 
     // 启用颜色 (让柱子变帅)
     start_color();
     init_pair(1, COLOR_CYAN, COLOR_BLACK); // 青色柱子
     init_pair(2, COLOR_GREEN, COLOR_BLACK); // 绿色文字
 
+    // 屏幕高度大概是 24行，我们在底部留点空，从 22 行开始往上画，最高 20 格
+    // x 坐标放大一点，每根柱子两格宽
+    tui_bars_init(&bars, BARS, 22, 4, 2, 2, 20, COLOR_PAIR(1));
+
+    int need_redraw = 1;
     while (keep_running) {
-        erase(); // 清屏 (比 clear 更快)
-        box(stdscr, 0, 0);
+        // 最多等到下一帧该画的时候，按键和刷新节奏互不影响
+        int ch = tui_getch(&ui);
+        if (ch == 'q') {
+            keep_running = 0;
+            pcm_ctl_send(&ctl, PCM_CTL_QUIT);
+        } else if (ch == ' ') {
+            is_paused = !is_paused;
+            pcm_ctl_send(&ctl, is_paused ? PCM_CTL_PAUSE : PCM_CTL_RESUME);
+            need_redraw = 1;
+        }
+        else if (ch == 's') {
+            ui.overlay = !ui.overlay;
+            if (!ui.overlay) tui_invalidate(&ui); // 浮层盖在边框上，关掉时整屏重画一次
+            need_redraw = 1;
+        } else if (ch == KEY_RESIZE) {
+            tui_invalidate(&ui);
+            need_redraw = 1;
+        }
+
+        if (!tui_frame_due(&ui)) continue;
+
+        int fresh;
+        const spectrum_frame *frame = spectrum_channel_latest(&spectrum_chan, &fresh);
+
+        // 音频线程没出新帧就不重画
+        if (!fresh && !need_redraw && !ui.overlay) continue;
+        need_redraw = 0;
+
+        if (tui_begin(&ui)) {
+            // 不变的部分只在第一帧和整屏作废之后画
+            box(stdscr, 0, 0);
+            attron(COLOR_PAIR(2));
+            mvprintw(1, 2, "LINUX FFT VISUALIZER");
+            attroff(COLOR_PAIR(2));
+        }
 
         attron(COLOR_PAIR(2));
-        mvprintw(1, 2, "LINUX FFT VISUALIZER");
+        tui_text(&ui, 0, 1, 30, "fft %d hop %d  frame %lu  dropped %lu%s", stft.fft.n, stft.hop,
+                 frame->seq, spectrum_chan.dropped, is_paused ? "  [PAUSED]" : "");
+        tui_text(&ui, 1, 2, 30, "xrun %lu  analysis: skipped %lu merged %lu",
+                 atomic_load(&backend.stats->xruns), atomic_load(&ring_dropped), atomic_load(&coalesced));
         attroff(COLOR_PAIR(2));
 
-        // --- 画柱状图的核心循环 ---
-        attron(COLOR_PAIR(1));
-        for (int i = 0; i < BARS; i++) {
-            // 获取高度 (限制最大值)
-            int height = (int)spectrum_heights[i];
-            if (height > 20) height = 20; // 防止冲出边框
-
-            // 从下往上画
-            // 屏幕高度大概是 24行，我们在底部留点空，从 22 行开始往上画
-            for (int h = 0; h < height; h++) {
-                // x 坐标放大一点，让柱子宽一点
-                mvaddch(22 - h, 4 + i*2, '#'); 
-                mvaddch(22 - h, 4 + i*2 + 1, '#'); 
-            }
+        // --- 柱状图：只补画/擦掉和上一帧不一样的格子 ---
+        tui_bars_update(&ui, &bars, frame->heights, peak_hold > 0 ? frame->peaks : NULL);
+
+        tui_finish(&ui);
+    }
+
+    tui_bars_free(&bars);
+    tui_end(&ui);
+
+    tui_report(&ui);
+}
+
+// --- 离线：不开界面，文件过一遍，能多快就多快 ---
+static void on_signal(int sig) {
+    (void)sig;
+    keep_running = 0;
+}
+
+static void run_offline(wav_source *src) {
+    pthread_t audio_id, analysis_id;
+    struct timespec t0, t1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("离线分析: %.1f 秒音频 (%s, %d 声道, %u Hz) -> %s\n",
+           (double)src->frames / src->sample_rate, sf_name(src->sample_fmt), src->channels,
+           src->sample_rate, audio_backend_name(&backend));
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_create(&audio_id, NULL, audio_thread_func, src);
+    pthread_create(&analysis_id, NULL, analysis_thread_func, src);
+    pthread_join(audio_id, NULL);
+    pthread_join(analysis_id, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double audio_sec = (double)backend.frames / src->sample_rate;
+    printf("用时 %.3f 秒, 处理 %.1f 秒音频 = %.1f 倍实时, 共 %llu 帧频谱\n",
+           wall, audio_sec, wall > 0 ? audio_sec / wall : 0, stft.fft.frames);
+}
+
+// --- UI 线程 ---
+int main(int argc, char *argv[]) {
+    pthread_t thread_id;
+    unsigned plan_flags = FFTW_MEASURE;
+    int fft_size = FFT_SIZE;
+    int hop = 0;
+    double decay = 0.85;
+    int peak_hold = 0;
+    int bench = 0;
+    int fps = TUI_DEFAULT_FPS;
+    int opt;
+    const char *json_path = NULL;
+    const char *in_path = "output.wav";
+    const char *backend_spec = "alsa";
+    const char *export_path = NULL;
+    spectrogram_opts sg = { .type = SPECTROGRAM_F32 };
+
+    // 要在开任何线程之前，让所有线程都屏蔽 SIGUSR1
+    pcm_stats_init("visualizer");
+    rt_default(&rt);
+
+    while ((opt = getopt(argc, argv, "n:H:d:k:f:J:i:a:PbS:G:QT:F:h")) != -1) {
+        switch (opt) {
+        case 'n': fft_size = atoi(optarg); break;
+        case 'H': hop = atoi(optarg); break;
+        case 'd': decay = atof(optarg); break;
+        case 'k': peak_hold = atoi(optarg); break;
+        case 'f': fps = atoi(optarg); break;
+        case 'J': json_path = optarg; break;
+        case 'i': in_path = optarg; break;
+        case 'a': backend_spec = optarg; break;
+        case 'P': plan_flags = FFTW_PATIENT; break; // 更慢的规划，换更快的执行
+        case 'b': bench = 1; break;
+        case 'S': export_path = optarg; break;
+        case 'G': sg.pgm_path = optarg; break;
+        case 'Q': sg.type = SPECTROGRAM_U8; break;
+        case 'T': sg.threads = atoi(optarg); break;
+        case 'F':
+            if (rt_parse(&rt, optarg) < 0) return 1;
+            break;
+        default: usage(argv[0]); return 1;
         }
-        attroff(COLOR_PAIR(1));
+    }
+    if (hop <= 0) hop = fft_size / 4;
+
+    if (bench) {
+        // 不开声卡，只跑 FFT 前后对比，再列出各种点数/帧移的开销
+        spectrum_bench(fft_size, 2000, plan_flags, SPECTRUM_WISDOM_FILE);
+        spectrum_stft_bench(44100, BARS, plan_flags, SPECTRUM_WISDOM_FILE);
+        return 0;
+    }
+
+    // 打开文件 (默认 output.wav)，映射进内存，按 RIFF 块找到真正的数据
+    wav_source src;
+    if (wav_source_open(&src, in_path) < 0) return 1;
+    if (src.sample_fmt == SF_UNKNOWN) {
+        fprintf(stderr, "不支持的 WAV 格式 (格式 %d, %d 位)\n", src.format, src.bits_per_sample);
+        wav_source_close(&src);
+        return 1;
+    }
+
+    if (export_path) {
+        // 不开声卡不开界面，整个文件切片分给线程池算完就走
+        sg.fft_size = fft_size;
+        sg.hop = hop;
+        sg.plan_flags = plan_flags;
+        sg.wisdom_file = SPECTRUM_WISDOM_FILE;
+        // 切片是随机访问的，压缩文件先整个解出来
+        if (wav_source_load(&src) < 0) {
+            wav_source_close(&src);
+            return 1;
+        }
+        int rc = spectrogram_export(&src, &sg, export_path);
+        wav_source_report(&src, stdout);
+        wav_source_close(&src);
+        return rc < 0 ? 1 : 0;
+    }
 
-        refresh();
+    spectrum_channel_init(&spectrum_chan);
 
-        int ch = getch();
-        if (ch == 'q') keep_running = 0;
-        else if (ch == ' ') is_paused = !is_paused;
+    // FFT 计划只在这里做一次 (有智慧文件时几乎不花时间)
+    // 对数分柱的表按文件的采样率建
+    if (spectrum_stft_init(&stft, fft_size, hop, src.sample_rate, BARS,
+                           plan_flags, SPECTRUM_WISDOM_FILE) < 0) {
+        fprintf(stderr, "FFT 初始化失败\n");
+        wav_source_close(&src);
+        return 1;
     }
+    spectrum_stft_set_smoothing(&stft, decay, peak_hold);
 
-    pthread_join(thread_id, NULL);
-    endwin();
+    if (ringbuf_init(&analysis_ring, ANALYSIS_RING_BYTES) < 0) {
+        fprintf(stderr, "内存不足\n");
+        return 1;
+    }
+    sem_init(&analysis_ready, 0, 0);
+    sem_init(&analysis_space, 0, 0);
+    rt_prefault(analysis_ring.buf, analysis_ring.size);
+    if (pcm_ctl_init(&ctl) < 0) return 1;
+
+    if (audio_backend_open(&backend, backend_spec, src.sample_fmt, src.channels,
+                           src.sample_rate, FRAMES) < 0) {
+        wav_source_close(&src);
+        return 1;
+    }
+    offline = !backend.realtime;
+    if (offline) backend.period = OFFLINE_FRAMES;
+    if (offline && rt.priority > 0) {
+        fprintf(stderr, "离线模式不限速，不开实时调度 (会把一个核占死)\n");
+        rt.priority = 0;
+    }
+    if (pcm_stats_start(json_path, 1000) < 0) return 1;
+
+    if (offline) {
+        run_offline(&src);
+    } else {
+        pthread_t analysis_id;
+        pthread_create(&thread_id, NULL, audio_thread_func, &src);
+        pthread_create(&analysis_id, NULL, analysis_thread_func, &src);
+        run_ui(fps, peak_hold);
+        pthread_join(thread_id, NULL);
+        sem_post(&analysis_ready);
+        pthread_join(analysis_id, NULL);
+    }
+
+    if (stft.fft.frames > 0) {
+        spectrum_stft_report(&stft);
+        if (!offline) printf("UI 跳过 %lu 帧 (共发布 %lu 帧)\n", spectrum_chan.dropped, spectrum_chan.next_seq);
+    }
+    printf("播放欠载 %lu 次, 没来得及分析 %lu 帧, 分析积压合并 %lu 帧\n",
+           atomic_load(&backend.stats->xruns), atomic_load(&ring_dropped), atomic_load(&coalesced));
+    wav_source_report(&src, stdout);
+    pcm_ctl_report(&ctl, stdout);
+    rt_report(&rt, stdout);
+    pcm_stats_stop(stdout);
+    pcm_ctl_destroy(&ctl);
+    audio_backend_close(&backend);
+    spectrum_stft_destroy(&stft);
+    ringbuf_free(&analysis_ring);
+    sem_destroy(&analysis_ready);
+    sem_destroy(&analysis_space);
+    wav_source_close(&src);
     return 0;
 }
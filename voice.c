@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "voice.h"
+
+// GCC 向量扩展：一个 vfloat 就是 VOICE_LANES 个声部的同一个字段
+// 默认编译时拆成两条 SSE 指令，avx2 版本里就是一条 256 位指令
+typedef float vfloat __attribute__((vector_size(VOICE_LANES * sizeof(float))));
+
+static void *alloc_lanes(size_t n, size_t elem) {
+    size_t bytes = (n * elem + 31) & ~(size_t)31; // aligned_alloc 要求大小是对齐的整数倍
+    void *p = aligned_alloc(32, bytes);
+    if (p) memset(p, 0, bytes);
+    return p;
+}
+
+int voice_pool_init(voice_pool *vp, int max_voices, int rate) {
+    memset(vp, 0, sizeof(*vp));
+    if (max_voices < 1) max_voices = 1;
+    vp->max_voices = max_voices;
+    vp->groups = (max_voices + VOICE_LANES - 1) / VOICE_LANES;
+    vp->rate = rate;
+
+    // 凑满最后一组的那几个声部永远不会被分配，音量一直是 0；
+    // 末尾再多留一个全空的组，忙的组数是单数时拿它来凑对
+    size_t n = (size_t)(vp->groups + 1) * VOICE_LANES;
+    vp->osc_c = alloc_lanes(n, sizeof(float));
+    vp->osc_s = alloc_lanes(n, sizeof(float));
+    vp->rot_c = alloc_lanes(n, sizeof(float));
+    vp->rot_s = alloc_lanes(n, sizeof(float));
+    vp->amp = alloc_lanes(n, sizeof(float));
+    vp->env = alloc_lanes(n, sizeof(float));
+    vp->env_step = alloc_lanes(n, sizeof(float));
+    vp->phase = alloc_lanes(n, sizeof(double));
+    vp->inc = alloc_lanes(n, sizeof(double));
+    vp->stage_left = alloc_lanes(n, sizeof(long));
+    vp->stage = alloc_lanes(n, 1);
+    vp->note = alloc_lanes(n, sizeof(int));
+    vp->born = alloc_lanes(n, sizeof(unsigned long));
+    vp->adsr = alloc_lanes(n, sizeof(ADSR));
+
+    if (!vp->osc_c || !vp->osc_s || !vp->rot_c || !vp->rot_s || !vp->amp || !vp->env ||
+        !vp->env_step || !vp->phase || !vp->inc || !vp->stage_left || !vp->stage ||
+        !vp->note || !vp->born || !vp->adsr) {
+        voice_pool_free(vp);
+        return -1;
+    }
+    return 0;
+}
+
+void voice_pool_free(voice_pool *vp) {
+    free(vp->osc_c);
+    free(vp->osc_s);
+    free(vp->rot_c);
+    free(vp->rot_s);
+    free(vp->amp);
+    free(vp->env);
+    free(vp->env_step);
+    free(vp->phase);
+    free(vp->inc);
+    free(vp->stage_left);
+    free(vp->stage);
+    free(vp->note);
+    free(vp->born);
+    free(vp->adsr);
+    memset(vp, 0, sizeof(*vp));
+}
+
+// --- 包络 ---
+// 每个阶段都是一条直线：从当前值走到目标值，走 len 个采样。
+// 从当前值出发 (而不是从 0 / 1 出发)，所以偷来的声部、提前松手的音符都不会跳变。
+static void enter_stage(voice_pool *vp, int v, int st) {
+    const ADSR *a = &vp->adsr[v];
+    double secs = 0, target = 0;
+
+    while (1) {
+        vp->stage[v] = st;
+        switch (st) {
+        case VOICE_ATTACK:  secs = a->attack;  target = 1.0; break;
+        case VOICE_DECAY:   secs = a->decay;   target = a->sustain_level; break;
+        case VOICE_RELEASE: secs = a->release; target = 0.0; break;
+        case VOICE_SUSTAIN:
+            vp->env[v] = a->sustain_level;
+            vp->env_step[v] = 0;
+            vp->stage_left[v] = -1;
+            return;
+        default: // VOICE_IDLE
+            vp->env[v] = 0;
+            vp->env_step[v] = 0;
+            vp->amp[v] = 0;
+            vp->stage_left[v] = -1;
+            vp->active--;
+            return;
+        }
+
+        long len = secs * vp->rate;
+        if (len > 0) {
+            vp->env_step[v] = (target - vp->env[v]) / len;
+            vp->stage_left[v] = len;
+            return;
+        }
+        // 长度为 0 的阶段直接跳过
+        vp->env[v] = target;
+        st = st == VOICE_RELEASE ? VOICE_IDLE : st + 1;
+    }
+}
+
+// 当前阶段走完了：把包络值钉到目标上 (消掉 float 累加误差)，进入下一阶段
+static void finish_stage(voice_pool *vp, int v) {
+    const ADSR *a = &vp->adsr[v];
+    switch (vp->stage[v]) {
+    case VOICE_ATTACK:
+        vp->env[v] = 1.0f;
+        enter_stage(vp, v, VOICE_DECAY);
+        break;
+    case VOICE_DECAY:
+        vp->env[v] = a->sustain_level;
+        enter_stage(vp, v, VOICE_SUSTAIN);
+        break;
+    case VOICE_RELEASE:
+        enter_stage(vp, v, VOICE_IDLE);
+        break;
+    }
+}
+
+// --- 分配 / 偷声部 ---
+static int pick_voice(voice_pool *vp) {
+    int best = -1;
+
+    for (int v = 0; v < vp->max_voices; v++)
+        if (vp->stage[v] == VOICE_IDLE) return v;
+
+    // 满了：先偷正在释音的里面最小声的，听起来最不明显
+    for (int v = 0; v < vp->max_voices; v++) {
+        if (vp->stage[v] == VOICE_RELEASE && (best < 0 || vp->env[v] < vp->env[best])) best = v;
+    }
+    // 都还按着，就偷最老的那个
+    if (best < 0) {
+        best = 0;
+        for (int v = 1; v < vp->max_voices; v++)
+            if (vp->born[v] < vp->born[best]) best = v;
+    }
+    vp->stolen++;
+    return best;
+}
+
+void voice_note_on(voice_pool *vp, int note, double freq, float amp, ADSR env) {
+    int v = pick_voice(vp);
+
+    if (vp->stage[v] == VOICE_IDLE) {
+        vp->active++;
+        if (vp->active > vp->peak_active) vp->peak_active = vp->active;
+    }
+    vp->note[v] = note;
+    vp->born[v] = vp->clock;
+    vp->amp[v] = amp;
+    vp->adsr[v] = env;
+    vp->phase[v] = 0;
+    vp->inc[v] = freq / vp->rate;
+    vp->rot_c[v] = cos(2.0 * M_PI * vp->inc[v]);
+    vp->rot_s[v] = sin(2.0 * M_PI * vp->inc[v]);
+    // 偷来的声部 env 保持原值，从那里重新起音
+    enter_stage(vp, v, VOICE_ATTACK);
+}
+
+void voice_note_off(voice_pool *vp, int note) {
+    for (int v = 0; v < vp->max_voices; v++) {
+        int st = vp->stage[v];
+        if (vp->note[v] == note && st != VOICE_IDLE && st != VOICE_RELEASE)
+            enter_stage(vp, v, VOICE_RELEASE);
+    }
+}
+
+// --- 内核：两组 VOICE_LANES 个声部，len 个采样 ---
+// lanes[i] 的每一格各自累加一个声部，最后再横向求和，循环里没有跨声部的依赖。
+// 振荡器递推每个采样要等上一个采样的乘加做完，一次只算一组的话 CPU 大半时间在等，
+// 所以两组交错着算，两条依赖链互相填空。
+typedef struct {
+    vfloat c, s, rc, rs, a, e, de;
+} group_regs;
+
+static inline __attribute__((always_inline))
+void load_group(group_regs *r, const voice_pool *vp, int off) {
+    memcpy(&r->c, vp->osc_c + off, sizeof(vfloat));
+    memcpy(&r->s, vp->osc_s + off, sizeof(vfloat));
+    memcpy(&r->rc, vp->rot_c + off, sizeof(vfloat));
+    memcpy(&r->rs, vp->rot_s + off, sizeof(vfloat));
+    memcpy(&r->a, vp->amp + off, sizeof(vfloat));
+    memcpy(&r->e, vp->env + off, sizeof(vfloat));
+    memcpy(&r->de, vp->env_step + off, sizeof(vfloat));
+}
+
+static inline __attribute__((always_inline))
+void pair_kernel(vfloat *lanes, int len, voice_pool *vp, int off0, int off1) {
+    group_regs g0, g1;
+    load_group(&g0, vp, off0);
+    load_group(&g1, vp, off1);
+
+    for (int i = 0; i < len; i++) {
+        lanes[i] += g0.s * g0.a * g0.e + g1.s * g1.a * g1.e;
+        vfloat c0 = g0.c * g0.rc - g0.s * g0.rs;
+        vfloat c1 = g1.c * g1.rc - g1.s * g1.rs;
+        g0.s = g0.s * g0.rc + g0.c * g0.rs;
+        g1.s = g1.s * g1.rc + g1.c * g1.rs;
+        g0.c = c0;
+        g1.c = c1;
+        g0.e += g0.de;
+        g1.e += g1.de;
+    }
+    memcpy(vp->env + off0, &g0.e, sizeof(vfloat));
+    memcpy(vp->env + off1, &g1.e, sizeof(vfloat));
+}
+
+static void pair_generic(vfloat *lanes, int len, voice_pool *vp, int off0, int off1) {
+    pair_kernel(lanes, len, vp, off0, off1);
+}
+
+__attribute__((target("avx2")))
+static void pair_avx2(vfloat *lanes, int len, voice_pool *vp, int off0, int off1) {
+    pair_kernel(lanes, len, vp, off0, off1);
+}
+
+// 渲染一段，这一段里没有事件、也没有声部换阶段，所以每个声部的包络斜率不变
+static void render_segment(voice_pool *vp, float *out, int len, int use_avx2) {
+    vfloat lanes[SYNTH_BLOCK];
+
+    int pending = -1; // 等着配对的那一组
+    int any = 0;
+
+    memset(lanes, 0, sizeof(vfloat) * len);
+    for (int g = 0; g <= vp->groups; g++) {
+        int off = g * VOICE_LANES;
+
+        if (g == vp->groups) {
+            // 最后剩一组没配上对，和末尾的空组一起算
+            if (pending < 0) break;
+        } else {
+            int busy = 0;
+            for (int k = 0; k < VOICE_LANES; k++) {
+                int v = off + k;
+                if (vp->stage[v] == VOICE_IDLE) continue;
+                busy = 1;
+                // 每段开头用 double 相位重新定一次振荡器，递推误差不会累积
+                vp->osc_c[v] = cos(2.0 * M_PI * vp->phase[v]);
+                vp->osc_s[v] = sin(2.0 * M_PI * vp->phase[v]);
+                vp->phase[v] += vp->inc[v] * len;
+                vp->phase[v] -= floor(vp->phase[v]);
+            }
+            if (!busy) continue; // 整组都空闲，跳过
+            if (pending < 0) {
+                pending = off;
+                continue;
+            }
+        }
+
+        if (use_avx2) pair_avx2(lanes, len, vp, pending, off);
+        else pair_generic(lanes, len, vp, pending, off);
+        pending = -1;
+        any = 1;
+    }
+
+    if (!any) {
+        memset(out, 0, sizeof(float) * len);
+        return;
+    }
+    for (int i = 0; i < len; i++) {
+        float sum = 0;
+        for (int k = 0; k < VOICE_LANES; k++) sum += lanes[i][k];
+        out[i] = sum;
+    }
+}
+
+void voice_pool_run(voice_pool *vp, float *out, int n, const voice_event *events, int nev) {
+    int use_avx2 = strcmp(synth_isa(), "avx2") == 0;
+    int ei = 0;
+    int pos = 0;
+
+    while (pos < n) {
+        // 到点的事件先生效，保证精确到采样
+        for (; ei < nev && events[ei].at <= pos; ei++) {
+            const voice_event *ev = &events[ei];
+            if (ev->on) voice_note_on(vp, ev->note, ev->freq, ev->amp, ev->env);
+            else voice_note_off(vp, ev->note);
+        }
+
+        // 这一段渲染到：下一个事件 / 某个声部换阶段 / 块满，哪个先到算哪个
+        int len = n - pos < SYNTH_BLOCK ? n - pos : SYNTH_BLOCK;
+        if (ei < nev && events[ei].at - pos < len) len = events[ei].at - pos;
+        for (int v = 0; v < vp->max_voices; v++) {
+            long left = vp->stage_left[v];
+            if (vp->stage[v] != VOICE_IDLE && left > 0 && left < len) len = left;
+        }
+
+        render_segment(vp, out + pos, len, use_avx2);
+
+        for (int v = 0; v < vp->max_voices; v++) {
+            if (vp->stage[v] == VOICE_IDLE || vp->stage_left[v] < 0) continue;
+            vp->stage_left[v] -= len;
+            if (vp->stage_left[v] == 0) finish_stage(vp, v);
+        }
+        vp->clock += len;
+        pos += len;
+    }
+
+    // at 超出本次范围的事件当作在末尾发生
+    for (; ei < nev; ei++) {
+        if (events[ei].on) voice_note_on(vp, events[ei].note, events[ei].freq, events[ei].amp, events[ei].env);
+        else voice_note_off(vp, events[ei].note);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef VOICE_H
+#define VOICE_H
+
+#include "synth.h"
+
+// --- N 声部复音引擎 ---
+// 固定大小的声部池，每个声部自己记着相位和包络走到哪了，
+// 所以音符可以任意重叠 (上一个音的释音拖进下一个音里)，也不限于两个声部。
+//
+// 声部状态按 "结构体的数组" (SoA) 存：每个字段一条连续数组，
+// 内层循环一次处理 VOICE_LANES 个声部，编译器直接出向量指令。
+// 空闲声部的音量是 0，照样参与计算，循环里没有分支。
+
+// 一组多少个声部一起算 (8 个 float 正好一个 AVX 寄存器)
+#define VOICE_LANES 8
+
+// 包络阶段
+enum { VOICE_IDLE, VOICE_ATTACK, VOICE_DECAY, VOICE_SUSTAIN, VOICE_RELEASE };
+
+typedef struct {
+    int max_voices;
+    int groups;         // max_voices 向上取整到 VOICE_LANES 之后的组数
+    int rate;
+
+    // --- 每个声部一条，长度 groups * VOICE_LANES ---
+    float *osc_c;       // 振荡器旋转状态 cos/sin
+    float *osc_s;
+    float *rot_c;       // 每个采样转多少 (cos/sin(2π·f/rate))
+    float *rot_s;
+    float *amp;
+    float *env;         // 当前包络值
+    float *env_step;    // 每个采样包络变多少
+    double *phase;      // 精确相位 (周期数，0~1)，每段开头用它重新定一次 osc_c/osc_s
+    double *inc;        // 每个采样相位前进多少
+    long *stage_left;   // 当前阶段还剩多少采样，-1 表示一直保持 (sustain)
+    unsigned char *stage;
+    int *note;          // 是哪个音符占着这个声部 (note_off 按它找)
+    unsigned long *born;// 什么时候开始响的，偷声部时挑最老的
+    ADSR *adsr;
+
+    int active;         // 正在响的声部数 (含释音)
+    unsigned long clock;// 已经渲染了多少采样
+    long stolen;        // 一共偷了几次声部
+    int peak_active;
+} voice_pool;
+
+// 事件：at 是相对本次 voice_pool_run 开头的采样偏移，按 at 从小到大排好
+typedef struct {
+    int at;
+    int on;             // 1 = note_on, 0 = note_off
+    int note;
+    double freq;
+    float amp;
+    ADSR env;
+} voice_event;
+
+int voice_pool_init(voice_pool *vp, int max_voices, int rate);
+void voice_pool_free(voice_pool *vp);
+
+// 分配一个声部开始发音；池子满了就偷一个 (优先偷已经在释音的、最小声的，其次最老的)
+void voice_note_on(voice_pool *vp, int note, double freq, float amp, ADSR env);
+// 让占着 note 的声部进入释音
+void voice_note_off(voice_pool *vp, int note);
+
+// 渲染 n 个采样到 out (单声道，覆盖写)，events 在各自的 at 处精确生效
+void voice_pool_run(voice_pool *vp, float *out, int n, const voice_event *events, int nev);
+
+#endif
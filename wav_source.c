@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wav_source.h"
+
+// 每次往前预读多少 (字节)
+#define READAHEAD_BYTES (512 * 1024)
+
+// WAV 是小端的，一个字节一个字节拼，不管机器大小端都对
+static uint16_t rd16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+static uint32_t rd32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 解析 fmt 块
+static int parse_fmt(wav_source *src, const unsigned char *p, uint32_t size) {
+    if (size < 16) return -1;
+    src->format = rd16(p);
+    src->channels = rd16(p + 2);
+    src->sample_rate = rd32(p + 4);
+    src->block_align = rd16(p + 12);
+    src->bits_per_sample = rd16(p + 14);
+    src->valid_bits = src->bits_per_sample;
+
+    // WAVE_FORMAT_EXTENSIBLE: cbSize(2) + 有效位深(2) + 声道掩码(4) + 子格式 GUID(16)
+    // GUID 的前两个字节就是真正的格式号
+    if (src->format == WAV_FMT_EXTENSIBLE) {
+        if (size < 40) return -1;
+        src->valid_bits = rd16(p + 18);
+        src->format = rd16(p + 24);
+    }
+    if (src->channels == 0 || src->block_align == 0) return -1;
+    // 认不出的格式 (8 位、ADPCM...) 照样能打开，由工具决定拒不拒绝
+    src->sample_fmt = sf_from_wav(src->format, src->bits_per_sample);
+    if (src->block_align != src->channels * sf_bytes(src->sample_fmt)) src->sample_fmt = SF_UNKNOWN;
+    return 0;
+}
+
+// 在映射区里按块走一遍，找 fmt 和 data
+static int parse_chunks(wav_source *src) {
+    const unsigned char *p = src->map;
+    size_t len = src->map_len;
+
+    if (len < 12 || (memcmp(p, "RIFF", 4) != 0 && memcmp(p, "RF64", 4) != 0) ||
+        memcmp(p + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "不是 RIFF/WAVE 文件\n");
+        return -1;
+    }
+
+    int have_fmt = 0;
+    uint64_t ds64_data = 0; // RF64：超过 4GB 的 data 大小记在 ds64 块里
+    size_t off = 12;
+    while (off + 8 <= len) {
+        const unsigned char *id = p + off;
+        uint32_t size = rd32(p + off + 4);
+        const unsigned char *body = p + off + 8;
+        size_t avail = len - off - 8;
+
+        if (memcmp(id, "ds64", 4) == 0 && size >= 16 && size <= avail) {
+            ds64_data = (uint64_t)rd32(body + 8) | ((uint64_t)rd32(body + 12) << 32);
+        } else if (memcmp(id, "fmt ", 4) == 0) {
+            if (size > avail || parse_fmt(src, body, size) < 0) {
+                fprintf(stderr, "fmt 块损坏\n");
+                return -1;
+            }
+            have_fmt = 1;
+        } else if (memcmp(id, "data", 4) == 0) {
+            if (!have_fmt) {
+                fprintf(stderr, "data 块出现在 fmt 之前\n");
+                return -1;
+            }
+            // 录音中途被打断的文件，头里的大小可能是 0 或者超过实际长度，以文件为准
+            size_t data_len = size;
+            if (size == 0xFFFFFFFFu && ds64_data) data_len = ds64_data;
+            if (data_len == 0 || data_len > avail) data_len = avail;
+            src->data = body;
+            src->data_len = data_len - data_len % src->block_align;
+            src->frames = src->data_len / src->block_align;
+            return 0;
+        }
+        // LIST / fact / cue 之类的块都不关心，直接跳过 (块按 2 字节对齐)
+        off += 8 + (size_t)size + (size & 1);
+    }
+
+    fprintf(stderr, "找不到 data 块\n");
+    return -1;
+}
+
+// 提前告诉内核接下来要读哪一段，让它在后台把页读进来
+static void readahead(wav_source *src) {
+    if (src->lac || src->readahead_end >= src->data_len) return; // 压缩文件靠 MADV_SEQUENTIAL
+    if (src->pos + READAHEAD_BYTES / 2 < src->readahead_end) return;
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t start = (src->data - src->map) + src->readahead_end;
+    size_t end = start + READAHEAD_BYTES;
+    if (end > src->map_len) end = src->map_len;
+    start -= start % page; // madvise 要求按页对齐
+
+    madvise((void *)(src->map + start), end - start, MADV_WILLNEED);
+    src->readahead_end = end - (src->data - src->map);
+}
+
+// 压缩文件：头里的信息填到和 WAV 一样的字段上，数据靠 next 一块块解
+static int open_lac(wav_source *src) {
+    lac_decoder *d = malloc(sizeof(*d));
+    if (!d || lac_decoder_init(d, src->map, src->map_len) < 0) {
+        free(d);
+        return -1;
+    }
+    src->lac = d;
+    src->format = WAV_FMT_PCM;
+    src->channels = d->channels;
+    src->sample_rate = d->rate;
+    src->bits_per_sample = src->valid_bits = sf_bytes(d->fmt) * 8;
+    src->sample_fmt = d->fmt;
+    src->block_align = d->channels * sf_bytes(d->fmt);
+    src->frames = d->frames;
+    src->data_len = d->frames * src->block_align;
+    return 0;
+}
+
+int wav_source_open(wav_source *src, const char *path) {
+    struct stat st;
+    memset(src, 0, sizeof(*src));
+    src->fd = -1;
+
+    src->fd = open(path, O_RDONLY);
+    if (src->fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(src->fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: 空文件\n", path);
+        wav_source_close(src);
+        return -1;
+    }
+
+    src->map_len = st.st_size;
+    void *map = mmap(NULL, src->map_len, PROT_READ, MAP_PRIVATE, src->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        src->map = NULL;
+        wav_source_close(src);
+        return -1;
+    }
+    src->map = map;
+
+    if (lac_probe(src->map, src->map_len) ? open_lac(src) < 0 : parse_chunks(src) < 0) {
+        wav_source_close(src);
+        return -1;
+    }
+
+    // 顺序读：内核会更激进地预读，读过的页也会更早回收
+    madvise(map, src->map_len, MADV_SEQUENTIAL);
+    readahead(src);
+    return 0;
+}
+
+void wav_source_close(wav_source *src) {
+    if (src->lac) {
+        lac_decoder_free(src->lac);
+        free(src->lac);
+        src->lac = NULL;
+    }
+    if (src->decoded) munmap(src->decoded, src->decoded_len);
+    src->decoded = NULL;
+    if (src->map) munmap((void *)src->map, src->map_len);
+    if (src->fd >= 0) close(src->fd);
+    src->map = NULL;
+    src->fd = -1;
+}
+
+// 压缩文件：当前这块用完了就解下一块，一次最多给到块的结尾
+static const void *next_lac(wav_source *src, size_t *frames) {
+    lac_decoder *d = src->lac;
+    if (d->out_pos == d->out_frames && lac_decode_block(d) == 0) {
+        *frames = 0;
+        return NULL;
+    }
+    size_t left = d->out_frames - d->out_pos;
+    if (*frames > left) *frames = left;
+
+    const void *p = d->out + d->out_pos * src->block_align;
+    d->out_pos += *frames;
+    src->pos += *frames * src->block_align;
+    return p;
+}
+
+const void *wav_source_next(wav_source *src, size_t *frames) {
+    if (src->lac && !src->decoded) return next_lac(src, frames);
+    size_t left = (src->data_len - src->pos) / src->block_align;
+    if (left == 0) {
+        *frames = 0;
+        return NULL;
+    }
+    if (*frames > left) *frames = left;
+
+    const void *p = src->data + src->pos;
+    src->pos += *frames * src->block_align;
+    readahead(src);
+    return p;
+}
+
+void wav_source_rewind(wav_source *src) {
+    src->pos = 0;
+    if (src->lac && !src->decoded) {
+        lac_decoder_rewind(src->lac);
+        return;
+    }
+    src->readahead_end = 0;
+    readahead(src);
+}
+
+int wav_source_load(wav_source *src) {
+    if (!src->lac || src->decoded) return 0;
+
+    // 匿名映射，大文件也不用一次性真的占满内存 (解到哪才摸到哪)
+    size_t len = src->data_len ? src->data_len : 1;
+    void *buf = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    size_t got = 0, n;
+    lac_decoder_rewind(src->lac);
+    while (got < src->data_len && (n = lac_decode_block(src->lac)) > 0) {
+        size_t bytes = n * src->block_align;
+        if (bytes > src->data_len - got) bytes = src->data_len - got;
+        memcpy((unsigned char *)buf + got, src->lac->out, bytes);
+        got += bytes;
+    }
+    src->decoded = buf;
+    src->decoded_len = len;
+    src->data = buf;
+    src->data_len = got;
+    src->frames = got / src->block_align;
+    src->pos = 0;
+    return 0;
+}
+
+void wav_source_report(const wav_source *src, FILE *fp) {
+    if (src->lac) lac_decoder_report(src->lac, fp);
+}
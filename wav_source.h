@@ -0,0 +1,64 @@
+#ifndef WAV_SOURCE_H
+#define WAV_SOURCE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_fmt.h"
+#include "lac.h"
+
+// WAVE_FORMAT_xxx，extensible 的会被解析成里面真正的子格式
+#define WAV_FMT_PCM        1
+#define WAV_FMT_FLOAT      3
+#define WAV_FMT_EXTENSIBLE 0xFFFE
+
+// --- 内存映射的 WAV 音源 ---
+// 整个文件 mmap 进来，按 RIFF 块一个个走，找到真正的 fmt 和 data。
+// 播放时直接把映射区里的指针交出去，没有 fread，也没有拷贝。
+// 录音机写的 .lac 压缩文件也认 (看文件头，不看扩展名)：fmt 那些字段照样填好，
+// next 每次最多给一块 (4096 帧)，用完了当场解下一块，指针指向解码缓冲区。
+// 这时 data 是 NULL，要随机访问的 (导出频谱图) 先调 wav_source_load 整个解出来。
+typedef struct {
+    int fd;
+    const unsigned char *map;   // 整个文件的映射
+    size_t map_len;
+
+    // fmt 块里的信息
+    uint16_t format;            // WAV_FMT_PCM / WAV_FMT_FLOAT
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint16_t block_align;       // 一帧多少字节
+    uint16_t bits_per_sample;   // 容器位深
+    uint16_t valid_bits;        // 有效位深 (extensible 才可能和上面不一样)
+    sf_format sample_fmt;       // 对应的采样格式，SF_UNKNOWN = 不支持
+
+    // data 块
+    const unsigned char *data;
+    size_t data_len;            // 字节数 (已经裁到整帧)
+    size_t frames;              // 总帧数
+
+    size_t pos;                 // 当前读到 data 的第几个字节
+    size_t readahead_end;       // 已经 WILLNEED 到哪里了
+
+    lac_decoder *lac;           // 压缩文件才有
+    unsigned char *decoded;     // wav_source_load 解出来的整个文件
+    size_t decoded_len;
+} wav_source;
+
+// 成功返回 0，失败打印原因并返回 -1
+int wav_source_open(wav_source *src, const char *path);
+void wav_source_close(wav_source *src);
+
+// 拿下一段数据：*frames 传入想要的帧数，传出实际给的帧数
+// (文件最后一段可能不够一个周期)。读到结尾返回 NULL
+const void *wav_source_next(wav_source *src, size_t *frames);
+
+// 循环播放：只是把读指针拨回开头
+void wav_source_rewind(wav_source *src);
+
+// 压缩文件：整个解到内存里，之后 data 就能随机访问了 (普通 WAV 什么都不做)
+int wav_source_load(wav_source *src);
+// 压缩文件打印压缩比和解码速度，普通 WAV 不打印
+void wav_source_report(const wav_source *src, FILE *fp);
+
+#endif
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "wav_writer.h"
+
+// --- 定义 WAV 文件头结构体 ---
+// 比经典的 44 字节多了一个 36 字节的 JUNK 块，给 RF64 的 ds64 留位置
+// 多声道或者高于 16 位时 fmt 块是 WAVE_FORMAT_EXTENSIBLE 的 40 字节，
+// 否则是经典的 16 字节，中间那段扩展字段不写出去
+struct WAV_HEADER {
+    char riff_id[4];      // "RIFF" (超过 4GB 时是 "RF64")
+    uint32_t riff_sz;     // 文件总大小 - 8 (RF64 时是 0xFFFFFFFF)
+    char riff_fmt[4];     // "WAVE"
+    char ds64_id[4];      // "JUNK" (RF64 时是 "ds64")
+    uint32_t ds64_sz;     // 28
+    uint64_t riff_sz64;   // 以下是 ds64 的内容，JUNK 时全 0
+    uint64_t data_sz64;
+    uint64_t sample_count;
+    uint32_t table_len;
+    char fmt_id[4];       // "fmt "
+    uint32_t fmt_sz;      // fmt块大小 (16 或 40)
+    uint16_t audio_fmt;   // 格式 (1 = PCM, 3 = float, 0xFFFE = extensible)
+    uint16_t num_chn;     // 通道数 (2)
+    uint32_t sample_rate; // 采样率 (44100)
+    uint32_t byte_rate;   // 字节率 = 采样率 * 帧大小
+    uint16_t block_align; // 帧大小 (4)
+    uint16_t bits_per_sample; // 容器位深 (16)
+    uint16_t cb_size;     // 以下是 extensible 的扩展部分 (22 字节)
+    uint16_t valid_bits;  // 有效位深
+    uint32_t channel_mask;
+    uint8_t sub_format[16]; // 真正的格式，GUID 的头两个字节就是 1 / 3
+    char data_id[4];      // "data"
+    uint32_t data_sz;     // 纯音频数据的大小 (RF64 时是 0xFFFFFFFF)
+} __attribute__((packed));
+
+#define WAV_EXT_OFFSET offsetof(struct WAV_HEADER, cb_size)
+#define WAV_EXT_SIZE (offsetof(struct WAV_HEADER, data_id) - WAV_EXT_OFFSET)
+
+// KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT 共用的后 14 字节
+static const uint8_t ksdata_guid_tail[14] = {
+    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+static int use_extensible(const wav_writer *w) {
+    return w->channels > 2 || w->fmt != SF_S16;
+}
+
+// 头按格式拼进 buf，返回头的长度 (数据从这里开始)
+static size_t fill_header(const wav_writer *w, unsigned char *buf) {
+    struct WAV_HEADER hdr, *h = &hdr;
+    int ext = use_extensible(w);
+    size_t len = ext ? sizeof(*h) : sizeof(*h) - WAV_EXT_SIZE;
+    // 数据块是奇数字节的话后面补一个 0 (RIFF 的块要按 2 字节对齐)，补的算进 RIFF 大小，不算进 data 大小
+    uint64_t riff_sz = w->data_bytes + (w->data_bytes & 1) + len - 8;
+    int wav_fmt = sf_is_float(w->fmt) ? 3 : 1;
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->riff_fmt, "WAVE", 4);
+    h->ds64_sz = 28;
+    memcpy(h->fmt_id, "fmt ", 4);
+    h->fmt_sz = ext ? 40 : 16;
+    h->audio_fmt = ext ? 0xFFFE : wav_fmt;
+    h->num_chn = w->channels;
+    h->sample_rate = w->rate;
+    h->block_align = w->channels * sf_bytes(w->fmt);
+    h->byte_rate = w->rate * h->block_align;
+    h->bits_per_sample = sf_bytes(w->fmt) * 8;
+    h->cb_size = 22;
+    h->valid_bits = h->bits_per_sample;
+    // 按 WAVE 的声道顺序 (左前、右前、中置、LFE ...) 依次占位
+    h->channel_mask = w->channels >= 32 ? 0xFFFFFFFFu : (1u << w->channels) - 1;
+    h->sub_format[0] = wav_fmt;
+    memcpy(h->sub_format + 2, ksdata_guid_tail, sizeof(ksdata_guid_tail));
+    memcpy(h->data_id, "data", 4);
+
+    if (riff_sz > 0xFFFFFFFFu) {
+        // 32 位装不下了：RF64，真实大小放在 ds64 里
+        memcpy(h->riff_id, "RF64", 4);
+        h->riff_sz = 0xFFFFFFFFu;
+        memcpy(h->ds64_id, "ds64", 4);
+        h->riff_sz64 = riff_sz;
+        h->data_sz64 = w->data_bytes;
+        h->sample_count = w->data_bytes / h->block_align;
+        h->data_sz = 0xFFFFFFFFu;
+    } else {
+        memcpy(h->riff_id, "RIFF", 4);
+        h->riff_sz = riff_sz;
+        memcpy(h->ds64_id, "JUNK", 4);
+        h->data_sz = w->data_bytes;
+    }
+
+    if (ext) {
+        memcpy(buf, h, sizeof(*h));
+    } else {
+        // 跳过扩展部分，和以前的 16 位立体声文件一个字节都不差
+        memcpy(buf, h, WAV_EXT_OFFSET);
+        memcpy(buf + WAV_EXT_OFFSET, h->data_id, sizeof(*h) - offsetof(struct WAV_HEADER, data_id));
+    }
+    return len;
+}
+
+// write() 可能只写一部分，循环到写完为止
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int wav_writer_open(wav_writer *w, const char *path, unsigned int rate, int channels, sf_format fmt) {
+    unsigned char header[sizeof(struct WAV_HEADER)];
+
+    memset(w, 0, sizeof(*w));
+    w->rate = rate;
+    w->channels = channels;
+    w->fmt = fmt;
+    if (channels < 1 || sf_bytes(fmt) == 0) {
+        fprintf(stderr, "不支持的 WAV 格式: %d 声道 %s\n", channels, sf_name(fmt));
+        w->fd = -1;
+        return -1;
+    }
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    // 先占位，大小都是 0
+    size_t len = fill_header(w, header);
+    if (write_all(w->fd, header, len) < 0) {
+        perror("write");
+        close(w->fd);
+        w->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// --- 后台写盘线程 ---
+static void *writer_thread_func(void *arg) {
+    wav_writer *w = (wav_writer *)arg;
+
+    while (1) {
+        // 先看 closing 再看环：看到 closing 时，它之前写进环的数据一定也看得到
+        int closing = atomic_load(&w->closing);
+        const void *p;
+        size_t n = ringbuf_read_ptr(&w->ring, &p);
+        if (n == 0) {
+            if (closing) break;
+            sem_wait(&w->data_sem);
+            continue;
+        }
+        if (!w->error && write_all(w->fd, p, n) < 0) {
+            perror("write");
+            w->error = 1; // 出错后照样把环读空，别让生产者卡死
+        }
+        ringbuf_read_advance(&w->ring, n);
+        sem_post(&w->space_sem);
+    }
+    return NULL;
+}
+
+int wav_writer_start_async(wav_writer *w, size_t ring_bytes) {
+    if (ringbuf_init(&w->ring, ring_bytes) < 0) return -1;
+    sem_init(&w->data_sem, 0, 0);
+    sem_init(&w->space_sem, 0, 0);
+    if (pthread_create(&w->thread, NULL, writer_thread_func, w) != 0) {
+        ringbuf_free(&w->ring);
+        return -1;
+    }
+    w->async = 1;
+    return 0;
+}
+
+int wav_writer_write(wav_writer *w, const void *data, size_t len) {
+    if (w->error) return -1;
+
+    if (!w->async) {
+        if (write_all(w->fd, data, len) < 0) {
+            perror("write");
+            w->error = 1;
+            return -1;
+        }
+        w->data_bytes += len;
+        return 0;
+    }
+
+    const char *p = data;
+    size_t left = len;
+    while (left > 0) {
+        size_t n = ringbuf_write(&w->ring, p, left);
+        p += n;
+        left -= n;
+        sem_post(&w->data_sem);
+        if (left > 0) sem_wait(&w->space_sem); // 环满了，等写盘线程
+    }
+    w->data_bytes += len;
+    return 0;
+}
+
+int wav_writer_close(wav_writer *w) {
+    unsigned char header[sizeof(struct WAV_HEADER)];
+    int rc = 0;
+
+    if (w->fd < 0) return -1;
+
+    if (w->async) {
+        atomic_store(&w->closing, 1);
+        sem_post(&w->data_sem);
+        pthread_join(w->thread, NULL);
+        ringbuf_free(&w->ring);
+        sem_destroy(&w->data_sem);
+        sem_destroy(&w->space_sem);
+        w->async = 0;
+    }
+    if (w->error) rc = -1;
+
+    if (w->data_bytes & 1) {
+        unsigned char pad = 0;
+        if (write_all(w->fd, &pad, 1) < 0) {
+            perror("write");
+            rc = -1;
+        }
+    }
+    size_t len = fill_header(w, header);
+    if (pwrite(w->fd, header, len, 0) != (ssize_t)len) {
+        perror("pwrite");
+        rc = -1;
+    }
+    close(w->fd);
+    w->fd = -1;
+    return rc;
+}
@@ -0,0 +1,44 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "ringbuf.h"
+#include "sample_fmt.h"
+
+// --- 边写边记的 WAV 文件 ---
+// 开头先写一个大小为 0 的头占位，数据写多少算多少，
+// 关闭时再回到开头把 RIFF/data 的真实大小补上。
+// 所以录多久都行，中途丢了数据头也不会撒谎。
+// 头里预留了一个 JUNK 块，数据超过 4GB 时原地改写成 RF64 + ds64，
+// 不用挪动后面的音频数据。
+// 16 位立体声写经典的 PCM 头；多声道、24/32 位、float 写 WAVE_FORMAT_EXTENSIBLE。
+typedef struct {
+    int fd;
+    unsigned int rate;
+    int channels;
+    sf_format fmt;
+    uint64_t data_bytes;    // 已经写进去的纯音频字节数
+
+    // 后台写盘 (可选)：write 只往环里放，另一个线程负责真正写文件
+    int async;
+    ringbuf ring;
+    pthread_t thread;
+    sem_t data_sem;         // 环里有新数据了
+    sem_t space_sem;        // 环里腾出空间了
+    atomic_int closing;
+    volatile int error;
+} wav_writer;
+
+// 数据按 fmt 交错排好直接写进来，这里不做转换
+int wav_writer_open(wav_writer *w, const char *path, unsigned int rate, int channels, sf_format fmt);
+// 打开之后、写数据之前调用，开启后台写盘线程，ring_bytes 是中间环的大小
+int wav_writer_start_async(wav_writer *w, size_t ring_bytes);
+// 异步模式下环满了会等写盘线程腾地方
+int wav_writer_write(wav_writer *w, const void *data, size_t len);
+// 写完剩下的数据，补写文件头并关闭
+int wav_writer_close(wav_writer *w);
+
+#endif